@@ -0,0 +1,51 @@
+#include "plumed/lepton/Lepton.h"
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace PLMD;
+
+// Compare the block evaluation of a compiled expression with the scalar one.
+// Results are expected to be bitwise identical, since the same operations are used.
+int main() {
+  std::ofstream ofs("output");
+  const std::vector<std::string> expressions= {
+// POWER_CONSTANT, with positive, negative and non integer exponents
+    "x^5+y^7",
+    "x^(-3)-2*y^(-6)",
+    "x^1.5*y^0.25",
+// non sequential arguments
+    "(x+1)*(y+2)-(y-3)/(x+4)",
+// operations evaluated one point at a time
+    "erf(x)+atan(y)+acos(x/(1+x*x))",
+    "atan2(y+1,2*x)+select(x-y,x,y)",
+// a mix of the above
+    "exp(-(x-y)^4)*sqrt(abs(x))+min(x,y)^3+max(log(1+x*x),y)"
+  };
+// more than one block, with an incomplete last block
+  const int n=150;
+  std::vector<double> x(n),y(n);
+  for(int p=0; p<n; p++) {
+    x[p]=0.1+0.03*p;
+    y[p]=2.3-0.021*p;
+  }
+  for(const auto & e : expressions) {
+    lepton::CompiledExpression expression=lepton::Parser::parse(e).optimize().createCompiledExpression();
+    std::vector<const double*> values;
+    for(const auto & name : expression.getVariables()) values.push_back(name=="x" ? x.data() : y.data());
+    std::vector<double> results(n);
+    std::vector<double> workspace;
+    expression.evaluate(values.data(),results.data(),n,workspace);
+    int differences=0;
+    for(int p=0; p<n; p++) {
+      if(expression.getVariables().count("x")) expression.getVariableReference("x")=x[p];
+      if(expression.getVariables().count("y")) expression.getVariableReference("y")=y[p];
+      const double scalar=expression.evaluate();
+// nan are considered equal, as they are obtained in the same way
+      if(!(scalar==results[p] || (std::isnan(scalar) && std::isnan(results[p])))) differences++;
+    }
+    ofs<<e<<" : "<<differences<<" differences over "<<n<<" points\n";
+  }
+  return 0;
+}
@@ -27,9 +27,12 @@
 #include "core/FlexibleBin.h"
 #include "tools/Exception.h"
 #include "tools/Grid.h"
+#include "tools/KernelCells.h"
 #include "tools/Matrix.h"
 #include "tools/OpenMP.h"
 #include "tools/Random.h"
+#include "tools/SharedRingBuffer.h"
+#include "tools/BinaryHills.h"
 #include "tools/File.h"
 #include <ctime>
 #include <numeric>
@@ -81,6 +84,12 @@ In case you provide both PLUMED will use the most conservative choice (highest n
 In case you do not provide any information about bin size (neither GRID_BIN nor GRID_SPACING)
 PLUMED will use 1/5 of the Gaussian width (SIGMA) as grid spacing if the width is fixed or 1/5 of the minimum
 Gaussian width (SIGMA_MIN) if the width is variable. This default choice should be reasonable for most applications.
+Large grids, e.g. in three dimensions or with many walkers on the same node, can take a lot of memory.
+With GRID_FLOAT the grid is stored in single precision, and with GRID_NODERIV the derivatives are not stored
+but computed when needed by finite differences of the neighboring values. Together, they reduce the memory
+used by the grid by a factor between 2 and 8, at the price of slightly less accurate bias and forces.
+The error of finite differences grows with the square of the grid spacing, so GRID_NODERIV should be used
+with a spacing of at most 1/5 of the Gaussian width.
 
 Alternatively to the use of grids, it is possible to use a neighbor list to decrease the cost of evaluating the bias,
 this can be enabled using NLIST. NLIST can be beneficial with more than 2 collective variables, where GRID becomes
@@ -90,6 +99,16 @@ is within 6.*DP2CUTOFF*sigma*sigma. While the list is updated if the CVs are far
 standard deviation of the Gaussian center distribution of the list. These parameters (6 and 0.5) can be modified using
 NLIST_PARAMETERS. Note that the use of neighbor list does not provide the exact bias.
 
+Without grids, hills are also indexed in a uniform grid of cells in the CV space, so that only the hills
+close enough to the CVs are summed, both when computing the bias and when building the neighbor list.
+This does not change the bias, since the other hills are beyond the cutoff where Gaussians are truncated.
+For long simulations, the number of stored hills can be reduced with COMPRESSION_THRESHOLD: a new hill whose
+center is closer than this threshold (in units of sigma) to an existing one is merged with it, in the same
+way as kernels are merged in \ref OPES_METAD. The merged hill has the same total volume, center and variance
+as the two original ones, so that the bias is only approximately preserved.
+Compression is only available without grids and for hills with fixed widths.
+The HILLS file still contains all the deposited hills, which are compressed again when restarting.
+
 Metadynamics can be restarted either from a HILLS file as well as from a GRID, in this second
 case one can first save a GRID using GRID_WFILE (and GRID_WSTRIDE) and at a later stage read
 it using GRID_RFILE.
@@ -236,6 +255,32 @@ where all the walkers are located. WALKERS_RSTRIDE is the number of step between
 one update and the other. Since version 2.2.5, hills files are automatically
 flushed every WALKERS_RSTRIDE steps.
 
+When all the walkers run on the same node, reading the hills files of all the other walkers
+every WALKERS_RSTRIDE steps can be replaced by the much cheaper WALKERS_SHM option.
+Each walker then appends its hills to a memory-mapped buffer, and reads the new hills
+from the buffers of the others. Hills files are still written, but they are only
+used when restarting, and are not flushed every WALKERS_RSTRIDE steps.
+\plumedfile
+DISTANCE ATOMS=3,5 LABEL=d1
+METAD ...
+   ARG=d1 SIGMA=0.05 HEIGHT=0.3 PACE=500 LABEL=restraint
+   WALKERS_N=10
+   WALKERS_ID=3
+   WALKERS_DIR=../
+   WALKERS_RSTRIDE=100
+   WALKERS_SHM=/dev/shm/restraint
+... METAD
+\endplumedfile
+Here the buffers are files /dev/shm/restraint.0, /dev/shm/restraint.1, etc., which are located in memory.
+Each buffer contains at most WALKERS_SHM_SIZE hills, which should be enough to store the hills deposited
+by a walker between two reads from the slowest of the others.
+Buffers are reinitialized by their walker when it starts, and marked as closed when it ends,
+so that the buffers left by previous runs are not read.
+When restarting from the hills files, hills that have been read from the file of another walker
+are skipped in its buffer, so that a walker can also be restarted while the others are running.
+When restarting from a grid, only the hills deposited after a walker has started are read from the buffers.
+All the walkers should thus be restarted in the same way.
+
 \par
 The \f$c(t)\f$ reweighting factor can be calculated on the fly using the equations
 presented in \cite Tiwary_jp504920s as described above.
@@ -261,6 +306,26 @@ normalized using the \f$c(t)\f$ reweighting factor is given in the rbias compone
 [rbias=bias-rct] which can be used to obtain a reweighted histogram or
 free energy surface using the \ref HISTOGRAM analysis.
 
+\par
+Both the \f$c(t)\f$ reweighting factor and the maximum of the bias (CALC_MAX_BIAS) require
+a loop over the whole grid, which can be expensive for large grids.
+With INCREMENTAL_STRIDE these quantities are instead updated using only the grid points
+changed by each hill, so that they can be cheaply computed at every deposition.
+The whole grid is still used every INCREMENTAL_STRIDE hills,
+to remove the numerical error accumulated by the incremental updates.
+\plumedfile
+phi: TORSION ATOMS=1,2,3,4
+psi: TORSION ATOMS=5,6,7,8
+
+METAD ...
+ LABEL=metad
+ ARG=phi,psi SIGMA=0.20,0.20 HEIGHT=1.20 BIASFACTOR=5 TEMP=300.0 PACE=500
+ GRID_MIN=-pi,-pi GRID_MAX=pi,pi GRID_BIN=150,150
+ CALC_RCT
+ INCREMENTAL_STRIDE=100
+... METAD
+\endplumedfile
+
 \par
 The kinetics of the transitions between basins can also be analyzed on the fly as
 in \cite PRL230602. The flag ACCELERATION turn on accumulation of the acceleration
@@ -411,6 +476,7 @@ private:
   double biasf_;
   // output files format
   std::string fmt_;
+  bool binary_hills_;
   // first step?
   bool isFirstStep_;
   // Gaussian starting parameters
@@ -420,6 +486,11 @@ private:
   std::vector<double> sigma0max_;
   // Gaussians
   std::vector<Gaussian> hills_;
+  // spatial index of hills_, used without grid
+  KernelCells hills_cells_;
+  std::vector<unsigned> hills_neigh_;
+  // hills are merged if closer than this (squared, in units of sigma)
+  double compression_threshold2_;
   std::unique_ptr<FlexibleBin> flexbin_;
   int adaptive_;
   OFile hillsOfile_;
@@ -436,6 +507,11 @@ private:
   std::string mw_dir_;
   int mw_id_;
   int mw_rstride_;
+  std::string mw_shm_;
+  unsigned mw_shm_size_;
+  std::vector<std::unique_ptr<SharedRingBuffer>> mw_buffers_;
+  // index of the first hill of each walker that should be read from its buffer
+  std::vector<std::uint64_t> mw_shm_start_;
   bool walkers_mpi_;
   unsigned mpi_nw_;
   // flying gaussians
@@ -470,6 +546,12 @@ private:
   bool calc_rct_;
   double reweight_factor_;
   unsigned rct_ustride_;
+  // incremental update of c(t) and of the maximum bias
+  unsigned incremental_stride_;
+  unsigned incremental_count_;
+  bool incremental_valid_;
+  double Z_0_;
+  double Z_V_;
   // work
   double work_;
   // neighbour list stuff
@@ -484,9 +566,18 @@ private:
   static void registerTemperingKeywords(const std::string &name_stem, const std::string &name, Keywords &keys);
   void   readTemperingSpecs(TemperingSpecs &t_specs);
   void   logTemperingSpecs(const TemperingSpecs &t_specs);
-  void   readGaussians(IFile*);
+  unsigned readGaussians(IFile*);
+  unsigned readBinaryGaussians(const std::string&);
+  BinaryHills::Header getBinaryHillsHeader();
+  std::vector<double> getFileSigma(const Gaussian&) const;
+  unsigned getHillRecordSize() const;
+  std::vector<double> getHillRecord(const Gaussian&) const;
+  void   readSharedGaussians();
   void   writeGaussian(const Gaussian&,OFile&);
   void   addGaussian(const Gaussian&);
+  std::vector<double> getHillExtent(const Gaussian&);
+  void getHillNeighbors(const std::vector<double>&, std::vector<unsigned>&);
+  void   mergeHills(Gaussian&, const Gaussian&);
   double getHeight(const std::vector<double>&);
   void   temperHeight(double &height, const TemperingSpecs &t_specs, const double tempering_bias);
   double getBias(const std::vector<double>&);
@@ -497,6 +588,9 @@ private:
   std::vector<unsigned> getGaussianSupport(const Gaussian&);
   bool   scanOneHill(IFile* ifile, std::vector<Value>& v, std::vector<double>& center, std::vector<double>& sigma, double& height, bool& multivariate);
   void   computeReweightingFactor();
+  void   updateMaxBias();
+  void   computeGridSums();
+  void   updateGridSums(const std::vector<Grid::index_t>&, const std::vector<double>&);
   double getTransitionBarrierBias();
   void   updateFrequencyAdaptiveStride();
   void   updateNlist();
@@ -523,12 +617,14 @@ void MetaD::registerKeywords(Keywords& keys) {
   keys.addOutputComponent("pace","FREQUENCY_ADAPTIVE","the hill addition frequency when employing frequency adaptive metadynamics");
   keys.addOutputComponent("nlker","NLIST","number of hills in the neighbor list");
   keys.addOutputComponent("nlsteps","NLIST","number of steps from last neighbor list update");
+  keys.addOutputComponent("nker","COMPRESSION_THRESHOLD","number of hills stored after compression");
   keys.use("ARG");
   keys.add("compulsory","SIGMA","the widths of the Gaussian hills");
   keys.add("compulsory","PACE","the frequency for hill addition");
   keys.add("compulsory","FILE","HILLS","a file in which the list of added hills is stored");
   keys.add("optional","HEIGHT","the heights of the Gaussian hills. Compulsory unless TAU and either BIASFACTOR or DAMPFACTOR are given");
   keys.add("optional","FMT","specify format for HILLS files (useful for decrease the number of digits in regtests)");
+  keys.addFlag("BINARY_HILLS",false,"write the HILLS file in binary format, which is much faster to read when restarting. Binary files can be converted to text and back with \\ref convert_hills, and cannot be compressed");
   keys.add("optional","BIASFACTOR","use well tempered metadynamics and use this bias factor.  Please note you must also specify temp");
   keys.addFlag("CALC_WORK",false,"calculate the work done by the bias between each update");
   keys.add("optional","RECT","list of bias factors for all the replicas");
@@ -543,11 +639,16 @@ void MetaD::registerKeywords(Keywords& keys) {
                "This method is not compatible with metadynamics not on a grid.");
   keys.add("optional","RCT_USTRIDE","the update stride for calculating the \\f$c(t)\\f$ reweighting factor."
            "The default 1, so \\f$c(t)\\f$ is updated every time the bias is updated.");
+  keys.add("optional","INCREMENTAL_STRIDE","if larger than zero, the \\f$c(t)\\f$ reweighting factor and the maximum bias are updated using only the grid points "
+           "changed by each hill, and recomputed from the whole grid every INCREMENTAL_STRIDE hills to remove the accumulated numerical error. "
+           "This option is useful with large grids.");
   keys.add("optional","GRID_MIN","the lower bounds for the grid");
   keys.add("optional","GRID_MAX","the upper bounds for the grid");
   keys.add("optional","GRID_BIN","the number of bins for the grid");
   keys.add("optional","GRID_SPACING","the approximate grid spacing (to be used as an alternative or together with GRID_BIN)");
   keys.addFlag("GRID_SPARSE",false,"use a sparse grid to store hills");
+  keys.addFlag("GRID_FLOAT",false,"store the grid in single precision, to reduce memory usage");
+  keys.addFlag("GRID_NODERIV",false,"do not store derivatives on the grid, and compute them by finite differences when needed, to reduce memory usage");
   keys.addFlag("GRID_NOSPLINE",false,"don't use spline interpolation with grids");
   keys.add("optional","GRID_WSTRIDE","write the grid to a file every N steps");
   keys.add("optional","GRID_WFILE","the file on which to write the grid");
@@ -555,6 +656,7 @@ void MetaD::registerKeywords(Keywords& keys) {
   keys.addFlag("STORE_GRIDS",false,"store all the grid files the calculation generates. They will be deleted if this keyword is not present");
   keys.addFlag("NLIST",false,"Use neighbor list for kernels summation, faster but experimental");
   keys.add("optional", "NLIST_PARAMETERS","(default=6.,0.5) the two cutoff parameters for the Gaussians neighbor list");
+  keys.add("optional","COMPRESSION_THRESHOLD","merge a new hill with the closest stored one if their distance in units of sigma is below this threshold. Only without grids");
   keys.add("optional","ADAPTIVE","use a geometric (=GEOM) or diffusion (=DIFF) based hills width scheme. Sigma is one number that has distance units or time step dimensions");
   keys.add("optional","SIGMA_MAX","the upper bounds for the sigmas (in CV units) when using adaptive hills. Negative number means no bounds ");
   keys.add("optional","SIGMA_MIN","the lower bounds for the sigmas (in CV units) when using adaptive hills. Negative number means no bounds ");
@@ -562,6 +664,8 @@ void MetaD::registerKeywords(Keywords& keys) {
   keys.add("optional","WALKERS_N", "number of walkers");
   keys.add("optional","WALKERS_DIR", "shared directory with the hills files from all the walkers");
   keys.add("optional","WALKERS_RSTRIDE","stride for reading hills files");
+  keys.add("optional","WALKERS_SHM","prefix for the names of the memory-mapped buffers used to exchange hills between walkers running on the same node, e.g. /dev/shm/metad");
+  keys.add("optional","WALKERS_SHM_SIZE","number of hills that can be stored in the buffer of each walker. The default is 10000");
   keys.addFlag("WALKERS_MPI",false,"Switch on MPI version of multiple walkers - not compatible with WALKERS_* options other than WALKERS_DIR");
   keys.add("optional","INTERVAL","one dimensional lower and upper limits, outside the limits the system will not feel the biasing force.");
   keys.addFlag("FLYING_GAUSSIAN",false,"Switch on flying Gaussian method, must be used with WALKERS_MPI");
@@ -594,12 +698,15 @@ MetaD::MetaD(const ActionOptions& ao):
   calc_work_(false),
   welltemp_(false),
   biasf_(-1.0),
+  binary_hills_(false),
   isFirstStep_(true),
   height0_(std::numeric_limits<double>::max()),
+  compression_threshold2_(0.0),
   adaptive_(FlexibleBin::none),
   grid_(false),
   wgridstride_(0),
   mw_n_(1), mw_dir_(""), mw_id_(0), mw_rstride_(1),
+  mw_shm_(""), mw_shm_size_(10000),
   walkers_mpi_(false), mpi_nw_(0),
   flying_(false),
   acceleration_(false), acc_(0.0), acc_restart_mean_(0.0),
@@ -616,6 +723,11 @@ MetaD::MetaD(const ActionOptions& ao):
   calc_rct_(false),
   reweight_factor_(0.0),
   rct_ustride_(1),
+  incremental_stride_(0),
+  incremental_count_(0),
+  incremental_valid_(false),
+  Z_0_(0.0),
+  Z_V_(0.0),
   work_(0),
   nlist_(false),
   nlist_update_(false),
@@ -802,6 +914,11 @@ MetaD::MetaD(const ActionOptions& ao):
 
   bool sparsegrid=false;
   parseFlag("GRID_SPARSE",sparsegrid);
+  bool floatgrid=false;
+  parseFlag("GRID_FLOAT",floatgrid);
+  bool noderivgrid=false;
+  parseFlag("GRID_NODERIV",noderivgrid);
+  if(sparsegrid && (floatgrid || noderivgrid)) error("GRID_SPARSE cannot be combined with GRID_FLOAT or GRID_NODERIV");
   bool nospline=false;
   parseFlag("GRID_NOSPLINE",nospline);
   bool spline=!nospline;
@@ -845,10 +962,35 @@ MetaD::MetaD(const ActionOptions& ao):
     nlist_param_[1]=nlist_param[1];
   }
 
+  // without grid, hills are indexed in cells
+  if(!grid_) {
+    hills_cells_.resize(getNumberOfArguments());
+    for(unsigned i=0; i<getNumberOfArguments(); ++i) {
+      if(getPntrToArgument(i)->isPeriodic()) {
+        double min,max;
+        getPntrToArgument(i)->getDomain(min,max);
+        hills_cells_.setPeriodicity(i,min,max);
+      }
+    }
+  }
+  double compression_threshold=0.0;
+  parse("COMPRESSION_THRESHOLD",compression_threshold);
+  if(compression_threshold<0) error("COMPRESSION_THRESHOLD cannot be negative");
+  if(compression_threshold>0) {
+    if(grid_) error("COMPRESSION_THRESHOLD cannot be used with GRID");
+    if(adaptive_!=FlexibleBin::none) error("COMPRESSION_THRESHOLD cannot be used with ADAPTIVE hills");
+    compression_threshold2_=compression_threshold*compression_threshold;
+  }
+
   // Reweighting factor rct
   parseFlag("CALC_RCT",calc_rct_);
   if (calc_rct_) plumed_massert(grid_,"CALC_RCT is supported only if bias is on a grid");
   parse("RCT_USTRIDE",rct_ustride_);
+  parse("INCREMENTAL_STRIDE",incremental_stride_);
+  if(incremental_stride_>0) {
+    if(!calc_rct_ && !calc_max_bias_) error("INCREMENTAL_STRIDE can only be used with CALC_RCT or CALC_MAX_BIAS");
+    if(!grid_) error("INCREMENTAL_STRIDE can only be used with a grid");
+  }
 
   if(dampfactor_>0.0) {
     if(!grid_) error("With DAMPFACTOR you should use grids");
@@ -860,6 +1002,16 @@ MetaD::MetaD(const ActionOptions& ao):
   if(mw_n_<=mw_id_) error("walker ID should be a numerical value less than the total number of walkers");
   parse("WALKERS_DIR",mw_dir_);
   parse("WALKERS_RSTRIDE",mw_rstride_);
+  parse("WALKERS_SHM",mw_shm_);
+  parse("WALKERS_SHM_SIZE",mw_shm_size_);
+  if(mw_shm_.length()>0) {
+    if(mw_n_<=1) error("WALKERS_SHM can only be used with WALKERS_N");
+    if(!SharedRingBuffer::isAvailable()) error("WALKERS_SHM requires memory-mapped files, which are not available on this system");
+  }
+
+  parseFlag("BINARY_HILLS",binary_hills_);
+  if(binary_hills_ && mw_n_>1 && mw_shm_.length()==0) error("BINARY_HILLS with WALKERS_N requires WALKERS_SHM, since hills files of other walkers are read as text");
+  if(binary_hills_ && Tools::extension(hillsfname)=="gz") error("BINARY_HILLS cannot be used with a compressed FILE");
 
   // MPI version
   parseFlag("WALKERS_MPI",walkers_mpi_);
@@ -920,6 +1072,7 @@ MetaD::MetaD(const ActionOptions& ao):
   log.printf("  Gaussian height %f\n",height0_);
   log.printf("  Gaussian deposition pace %d\n",stride_);
   log.printf("  Gaussian file %s\n",hillsfname.c_str());
+  if(binary_hills_) log.printf("  Gaussian file is written in binary format\n");
   if(welltemp_) {
     log.printf("  Well-Tempered Bias Factor %f\n",biasf_);
     log.printf("  Hills relaxation time (tau) %f\n",tau);
@@ -996,6 +1149,8 @@ MetaD::MetaD(const ActionOptions& ao):
     log.printf("\n");
     if(spline) {log.printf("  Grid uses spline interpolation\n");}
     if(sparsegrid) {log.printf("  Grid uses sparse grid\n");}
+    if(floatgrid) {log.printf("  Grid is stored in single precision\n");}
+    if(noderivgrid) {log.printf("  Grid derivatives are computed by finite differences\n");}
     if(wgridstride_>0) {log.printf("  Grid is written on file %s with stride %d\n",gridfilename_.c_str(),wgridstride_);}
   }
 
@@ -1005,6 +1160,7 @@ MetaD::MetaD(const ActionOptions& ao):
     log.printf("  walker id %d\n",mw_id_);
     log.printf("  reading stride %d\n",mw_rstride_);
     if(mw_dir_!="")log.printf("  directory with hills files %s\n",mw_dir_.c_str());
+    if(mw_shm_!="")log.printf("  hills are exchanged through memory-mapped buffers %s.*, with room for %u hills\n",mw_shm_.c_str(),mw_shm_size_);
   } else {
     if(walkers_mpi_) {
       log.printf("  Multiple walkers active using MPI communnication\n");
@@ -1031,10 +1187,17 @@ MetaD::MetaD(const ActionOptions& ao):
     componentIsNotPeriodic("nlsteps");
   }
 
+  if(compression_threshold2_>0) {
+    log.printf("  Hills closer than %f sigma are merged\n",std::sqrt(compression_threshold2_));
+    addComponent("nker");
+    componentIsNotPeriodic("nker");
+  }
+
   if(calc_rct_) {
     addComponent("rbias"); componentIsNotPeriodic("rbias");
     addComponent("rct"); componentIsNotPeriodic("rct");
     log.printf("  The c(t) reweighting factor will be calculated every %u hills\n",rct_ustride_);
+    if(incremental_stride_>0) log.printf("  using only the grid points changed by each hill, and the whole grid every %u hills\n",incremental_stride_);
     getPntrToComponent("rct")->set(reweight_factor_);
   }
 
@@ -1087,6 +1250,7 @@ MetaD::MetaD(const ActionOptions& ao):
   if (calc_max_bias_) {
     if (!grid_) error("Calculating the maximum bias on the fly works only with a grid");
     log.printf("  calculation on the fly of the maximum bias max(V(s,t)) \n");
+    if(incremental_stride_>0) log.printf("  using only the grid points changed by each hill, and the whole grid every %u hills\n",incremental_stride_);
     addComponent("maxbias");
     componentIsNotPeriodic("maxbias");
   }
@@ -1159,8 +1323,11 @@ MetaD::MetaD(const ActionOptions& ao):
         }
       }
       std::string funcl=getLabel() + ".bias";
-      if(!sparsegrid) {BiasGrid_=Tools::make_unique<Grid>(funcl,getArguments(),gmin,gmax,gbin,spline,true);}
-      else {BiasGrid_=Tools::make_unique<SparseGrid>(funcl,getArguments(),gmin,gmax,gbin,spline,true);}
+      if(sparsegrid && incremental_stride_>0) error("INCREMENTAL_STRIDE cannot be used with GRID_SPARSE");
+      if(sparsegrid) {BiasGrid_=Tools::make_unique<SparseGrid>(funcl,getArguments(),gmin,gmax,gbin,spline,true);}
+      else if(floatgrid) {BiasGrid_=Tools::make_unique<CompactGrid<float>>(funcl,getArguments(),gmin,gmax,gbin,spline,true,!noderivgrid);}
+      else if(noderivgrid) {BiasGrid_=Tools::make_unique<CompactGrid<double>>(funcl,getArguments(),gmin,gmax,gbin,spline,true,false);}
+      else {BiasGrid_=Tools::make_unique<Grid>(funcl,getArguments(),gmin,gmax,gbin,spline,true);}
       std::vector<std::string> actualmin=BiasGrid_->getMin();
       std::vector<std::string> actualmax=BiasGrid_->getMax();
       for(unsigned i=0; i<getNumberOfArguments(); i++) {
@@ -1191,7 +1358,7 @@ MetaD::MetaD(const ActionOptions& ao):
         error("The GRID file you want to read: " + gridreadfilename_ + ", cannot be found!");
       }
       std::string funcl=getLabel() + ".bias";
-      BiasGrid_=GridBase::create(funcl, getArguments(), gridfile, gmin, gmax, gbin, sparsegrid, spline, true);
+      BiasGrid_=GridBase::create(funcl, getArguments(), gridfile, gmin, gmax, gbin, sparsegrid, spline, true, floatgrid, !noderivgrid);
       if(BiasGrid_->getDimension()!=getNumberOfArguments()) error("mismatch between dimensionality of input grid and number of arguments");
       for(unsigned i=0; i<getNumberOfArguments(); ++i) {
         if( getPntrToArgument(i)->isPeriodic()!=BiasGrid_->getIsPeriodic()[i] ) error("periodicity mismatch between arguments and input bias");
@@ -1231,6 +1398,10 @@ MetaD::MetaD(const ActionOptions& ao):
   // creating std::vector of ifile* for hills reading
   // open all files at the beginning and read Gaussians if restarting
   bool restartedFromHills=false;  // restart from hills files
+  bool appendToHills=false;  // the header of the hills file of this walker is already there
+  // the hills that other walkers have deposited before are in the grid, or will be read from their files
+  mw_shm_start_.assign(mw_n_,restartedFromGrid?SharedRingBuffer::allWritten:0);
+  mw_shm_start_[mw_id_]=0;
   for(int i=0; i<mw_n_; ++i) {
     std::string fname;
     if(mw_dir_!="") {
@@ -1255,16 +1426,38 @@ MetaD::MetaD(const ActionOptions& ao):
     IFile *ifile = ifiles_.back().get();
     ifilesnames_.push_back(fname);
     ifile->link(*this);
-    if(ifile->FileExist(fname)) {
+    if(ifile->FileExist(fname) && BinaryHills::isBinary(ifile->getPath())) {
+      // binary files are loaded in a single shot and never kept open
+      if(getRestart()&&!restartedFromGrid) {
+        log.printf("  Restarting from binary file %s:",ifilesnames_[i].c_str());
+        mw_shm_start_[i]=readBinaryGaussians(ifile->getPath());
+        restartedFromHills=true;
+      }
+      if(i==mw_id_ && getRestart()) {
+        if(!binary_hills_) error("cannot append text hills to binary file "+fname+", use BINARY_HILLS");
+        // new records should be the same as those in the file, also when restarting from a grid
+        std::string diff;
+        {
+          BinaryHills hills(ifile->getPath());
+          diff=getBinaryHillsHeader().difference(hills.getHeader());
+        }
+        if(diff.length()>0) error("cannot append to binary hills file "+fname+", which has a "+diff);
+        // an incomplete record written by a run that crashed would misalign the new ones
+        if(comm.Get_rank()==0) BinaryHills::truncate(ifile->getPath());
+        comm.Barrier();
+        appendToHills=true;
+      }
+    } else if(ifile->FileExist(fname)) {
       ifile->open(fname);
       if(getRestart()&&!restartedFromGrid) {
         log.printf("  Restarting from %s:",ifilesnames_[i].c_str());
-        readGaussians(ifiles_[i].get());
+        mw_shm_start_[i]=readGaussians(ifiles_[i].get());
         restartedFromHills=true;
       }
       ifiles_[i]->reset(false);
       // close only the walker own hills file for later writing
       if(i==mw_id_) ifiles_[i]->close();
+      if(i==mw_id_ && getRestart() && binary_hills_) error("cannot append binary hills to text file "+fname+", convert it with plumed convert_hills");
     } else {
       // in case a file does not exist and we are restarting, complain that the file was not found
       if(getRestart()&&!restartedFromGrid) error("restart file "+fname+" not found");
@@ -1307,7 +1500,7 @@ MetaD::MetaD(const ActionOptions& ao):
     if(calc_rct_) computeReweightingFactor();
     // Calculate all special bias quantities desired if restarting with nonzero bias.
     if(calc_max_bias_) {
-      max_bias_ = BiasGrid_->getMaxValue();
+      updateMaxBias();
       getPntrToComponent("maxbias")->set(max_bias_);
     }
     if(calc_transition_bias_) {
@@ -1341,6 +1534,7 @@ MetaD::MetaD(const ActionOptions& ao):
   }
   if(mw_n_>1) hillsOfile_.enforceSuffix("");
   hillsOfile_.open(ifilesnames_[mw_id_]);
+  if(binary_hills_ && !appendToHills) BinaryHills::writeHeader(hillsOfile_,getBinaryHillsHeader());
   if(fmt_.length()>0) hillsOfile_.fmtField(fmt_);
   hillsOfile_.addConstantField("multivariate");
   hillsOfile_.addConstantField("kerneltype");
@@ -1348,10 +1542,21 @@ MetaD::MetaD(const ActionOptions& ao):
     hillsOfile_.addConstantField("lower_int").printField("lower_int",lowI_);
     hillsOfile_.addConstantField("upper_int").printField("upper_int",uppI_);
   }
-  hillsOfile_.setHeavyFlush();
+  // with shared buffers, the hills file is only a log
+  if(mw_shm_.length()==0) hillsOfile_.setHeavyFlush();
   // output periodicities of variables
   for(unsigned i=0; i<getNumberOfArguments(); ++i) hillsOfile_.setupPrintValue( getPntrToArgument(i) );
 
+  // with shared buffers, the hills files of the other walkers are not read anymore
+  if(mw_shm_.length()>0) {
+    for(int i=0; i<mw_n_; ++i) {
+      if(i!=mw_id_ && ifiles_[i]->isOpen()) ifiles_[i]->close();
+      mw_buffers_.emplace_back(Tools::make_unique<SharedRingBuffer>());
+    }
+    // hills are numbered from those already in the hills file, so that walkers that have read it skip them
+    if(comm.Get_rank()==0) mw_buffers_[mw_id_]->create(mw_shm_+"."+std::to_string(mw_id_),mw_shm_size_,getHillRecordSize(),mw_shm_start_[mw_id_]);
+  }
+
   bool concurrent=false;
   const ActionSet&actionSet(plumed.getActionSet());
   for(const auto & p : actionSet) if(dynamic_cast<MetaD*>(p.get())) { concurrent=true; break; }
@@ -1417,7 +1622,7 @@ void MetaD::logTemperingSpecs(const TemperingSpecs &t_specs)
   if (t_specs.alpha != 1.0) log.printf("  %s decay shape parameter alpha %f\n", t_specs.name.c_str(), t_specs.alpha);
 }
 
-void MetaD::readGaussians(IFile *ifile)
+unsigned MetaD::readGaussians(IFile *ifile)
 {
   unsigned ncv=getNumberOfArguments();
   std::vector<double> center(ncv);
@@ -1437,11 +1642,154 @@ void MetaD::readGaussians(IFile *ifile)
     addGaussian(Gaussian(multivariate,height,center,sigma));
   }
   log.printf("      %d Gaussians read\n",nhills);
+  return nhills;
+}
+
+unsigned MetaD::readBinaryGaussians(const std::string& path)
+{
+  BinaryHills hills(path);
+  const BinaryHills::Header& header=hills.getHeader();
+  unsigned ncv=getNumberOfArguments();
+  if(header.getNumberOfArguments()!=ncv) error("number of variables in binary hills file "+path+" does not match the number of arguments");
+  for(unsigned i=0; i<ncv; ++i) {
+    if(header.names[i]!=getPntrToArgument(i)->getName()) error("variable "+header.names[i]+" in binary hills file "+path+" does not match argument "+getPntrToArgument(i)->getName());
+    std::string rmin, rmax;
+    if(getPntrToArgument(i)->isPeriodic()) getPntrToArgument(i)->getDomain(rmin,rmax);
+    if(header.min[i]!=rmin || header.max[i]!=rmax) error("in hills file periodicity for variable " + header.names[i] + " does not match periodicity in input");
+  }
+  std::vector<double> center(ncv);
+  std::vector<double> sigma;
+  for(std::size_t k=0; k<hills.size(); ++k) {
+    const double* c=hills.getCenter(k);
+    for(unsigned i=0; i<ncv; ++i) center[i]=c[i];
+    hills.getSigma(k,sigma);
+    double height=hills.getHeight(k);
+    // note that for gamma=1 we store directly -F
+    if(welltemp_ && biasf_>1.0) height*=(biasf_-1.0)/biasf_;
+    addGaussian(Gaussian(header.multivariate,height,center,sigma));
+  }
+  log.printf("      %u Gaussians read\n",unsigned(hills.size()));
+  return hills.size();
+}
+
+BinaryHills::Header MetaD::getBinaryHillsHeader()
+{
+  BinaryHills::Header header;
+  header.multivariate=(adaptive_!=FlexibleBin::none);
+  for(unsigned i=0; i<getNumberOfArguments(); ++i) {
+    std::string min,max;
+    if(getPntrToArgument(i)->isPeriodic()) getPntrToArgument(i)->getDomain(min,max);
+    header.addArgument(getPntrToArgument(i)->getName(),min,max);
+  }
+  if(doInt_) {
+    Tools::convert(lowI_,header.lower_int);
+    Tools::convert(uppI_,header.upper_int);
+  }
+  return header;
+}
+
+unsigned MetaD::getHillRecordSize() const
+{
+  unsigned ncv=getNumberOfArguments();
+  // multivariate flag, height, center and (possibly multivariate) sigma
+  return 2+ncv+(ncv*(ncv+1))/2;
+}
+
+std::vector<double> MetaD::getHillRecord(const Gaussian& hill) const
+{
+  std::vector<double> record(getHillRecordSize(),0.0);
+  record[0]=(hill.multivariate?1.0:0.0);
+  record[1]=hill.height;
+  unsigned ncv=hill.center.size();
+  for(unsigned i=0; i<ncv; ++i) record[2+i]=hill.center[i];
+  for(unsigned i=0; i<hill.sigma.size(); ++i) record[2+ncv+i]=hill.sigma[i];
+  return record;
+}
+
+void MetaD::readSharedGaussians()
+{
+  unsigned ncv=getNumberOfArguments();
+  unsigned recordsize=getHillRecordSize();
+  std::vector<double> data;
+  std::vector<double> center(ncv);
+  for(int i=0; i<mw_n_; ++i) {
+    // don't read your own Gaussians
+    if(i==mw_id_) continue;
+    // only the root of each walker accesses the buffers, since the other processes could be on other nodes
+    unsigned nhills=0;
+    data.clear();
+    if(comm.Get_rank()==0) {
+      if(!mw_buffers_[i]->isOpen()) mw_buffers_[i]->attach(mw_shm_+"."+std::to_string(i),mw_shm_start_[i]);
+      if(mw_buffers_[i]->isOpen()) nhills=mw_buffers_[i]->read(data);
+    }
+    comm.Bcast(nhills,0);
+    if(nhills==0) continue;
+    data.resize(nhills*recordsize);
+    comm.Bcast(data,0);
+    for(unsigned k=0; k<nhills; ++k) {
+      const double* record=&data[k*recordsize];
+      bool multivariate=(record[0]>0.5);
+      for(unsigned j=0; j<ncv; ++j) center[j]=record[2+j];
+      std::vector<double> sigma(record+2+ncv,record+2+ncv+(multivariate?(ncv*(ncv+1))/2:ncv));
+      addGaussian(Gaussian(multivariate,record[1],center,sigma));
+    }
+  }
+}
+
+std::vector<double> MetaD::getFileSigma(const Gaussian& hill) const
+{
+  unsigned ncv=getNumberOfArguments();
+  if(!hill.multivariate) return hill.sigma;
+  Matrix<double> mymatrix(ncv,ncv);
+  unsigned k=0;
+  for(unsigned i=0; i<ncv; i++) {
+    for(unsigned j=i; j<ncv; j++) {
+      // recompose the full inverse matrix
+      mymatrix(i,j)=mymatrix(j,i)=hill.sigma[k];
+      k++;
+    }
+  }
+  // invert it
+  Matrix<double> invmatrix(ncv,ncv);
+  Invert(mymatrix,invmatrix);
+  // enforce symmetry
+  for(unsigned i=0; i<ncv; i++) {
+    for(unsigned j=i; j<ncv; j++) {
+      invmatrix(i,j)=invmatrix(j,i);
+    }
+  }
+
+  // do cholesky so to have a "sigma like" number
+  Matrix<double> lower(ncv,ncv);
+  cholesky(invmatrix,lower);
+  // loop in band form
+  std::vector<double> filesigma;
+  for(unsigned i=0; i<ncv; i++) {
+    for(unsigned j=0; j<ncv-i; j++) {
+      filesigma.push_back(lower(j+i,j));
+    }
+  }
+  return filesigma;
 }
 
 void MetaD::writeGaussian(const Gaussian& hill, OFile&file)
 {
   unsigned ncv=getNumberOfArguments();
+  std::vector<double> filesigma=getFileSigma(hill);
+  double height=hill.height;
+  // note that for gamma=1 we store directly -F
+  if(welltemp_ && biasf_>1.0) height*=biasf_/(biasf_-1.0);
+  if(binary_hills_) {
+    // same numbers as in the text file, clock excluded
+    std::vector<double> record;
+    record.push_back(getTimeStep()*getStep());
+    record.insert(record.end(),hill.center.begin(),hill.center.end());
+    record.insert(record.end(),filesigma.begin(),filesigma.end());
+    record.push_back(height);
+    record.push_back(biasf_);
+    BinaryHills::writeRecord(file,record);
+    return;
+  }
   file.printField("time",getTimeStep()*getStep());
   for(unsigned i=0; i<ncv; ++i) {
     file.printField(getPntrToArgument(i),hill.center[i]);
@@ -1449,42 +1797,18 @@ void MetaD::writeGaussian(const Gaussian& hill, OFile&file)
   hillsOfile_.printField("kerneltype","gaussian");
   if(hill.multivariate) {
     hillsOfile_.printField("multivariate","true");
-    Matrix<double> mymatrix(ncv,ncv);
     unsigned k=0;
-    for(unsigned i=0; i<ncv; i++) {
-      for(unsigned j=i; j<ncv; j++) {
-        // recompose the full inverse matrix
-        mymatrix(i,j)=mymatrix(j,i)=hill.sigma[k];
-        k++;
-      }
-    }
-    // invert it
-    Matrix<double> invmatrix(ncv,ncv);
-    Invert(mymatrix,invmatrix);
-    // enforce symmetry
-    for(unsigned i=0; i<ncv; i++) {
-      for(unsigned j=i; j<ncv; j++) {
-        invmatrix(i,j)=invmatrix(j,i);
-      }
-    }
-
-    // do cholesky so to have a "sigma like" number
-    Matrix<double> lower(ncv,ncv);
-    cholesky(invmatrix,lower);
-    // loop in band form
     for(unsigned i=0; i<ncv; i++) {
       for(unsigned j=0; j<ncv-i; j++) {
-        file.printField("sigma_"+getPntrToArgument(j+i)->getName()+"_"+getPntrToArgument(j)->getName(),lower(j+i,j));
+        file.printField("sigma_"+getPntrToArgument(j+i)->getName()+"_"+getPntrToArgument(j)->getName(),filesigma[k]);
+        k++;
       }
     }
   } else {
     hillsOfile_.printField("multivariate","false");
     for(unsigned i=0; i<ncv; ++i)
-      file.printField("sigma_"+getPntrToArgument(i)->getName(),hill.sigma[i]);
+      file.printField("sigma_"+getPntrToArgument(i)->getName(),filesigma[i]);
   }
-  double height=hill.height;
-  // note that for gamma=1 we store directly -F
-  if(welltemp_ && biasf_>1.0) height*=biasf_/(biasf_-1.0);
   file.printField("height",height).printField("biasf",biasf_);
   if(mw_n_>1) file.printField("clock",int(std::time(0)));
   file.printField();
@@ -1495,43 +1819,184 @@ void MetaD::addGaussian(const Gaussian& hill)
   if(grid_) {
     size_t ncv=getNumberOfArguments();
     std::vector<unsigned> nneighb=getGaussianSupport(hill);
-    std::vector<Grid::index_t> neighbors=BiasGrid_->getNeighbors(hill.center,nneighb);
-    std::vector<double> der(ncv);
-    std::vector<double> xx(ncv);
-    if(comm.Get_size()==1) {
-      // for performance reasons and thread safety
-      std::vector<double> dp(ncv);
-      for(size_t i=0; i<neighbors.size(); ++i) {
-        Grid::index_t ineigh=neighbors[i];
-        for(unsigned j=0; j<ncv; ++j) der[j]=0.0;
-        BiasGrid_->getPoint(ineigh,xx);
-        double bias=evaluateGaussianAndDerivatives(xx,hill,der,dp);
-        BiasGrid_->addValueAndDerivatives(ineigh,bias,der);
+    // the grid points in the support are the outer product of one dimensional lists,
+    // so that distances from the center are only computed once per grid line
+    std::vector<std::vector<unsigned> > axes;
+    std::vector<std::vector<double> > points;
+    BiasGrid_->getNeighborAxes(hill.center,nneighb,axes,points);
+    std::vector<std::vector<double> > dist(ncv);
+    for(unsigned j=0; j<ncv; ++j) {
+      dist[j].resize(points[j].size());
+      for(unsigned k=0; k<points[j].size(); ++k) {
+        double x=points[j][k];
+        // see evaluateGaussianAndDerivatives()
+        if(doInt_) {
+          if(x<lowI_) x=lowI_;
+          if(x>uppI_) x=uppI_;
+        }
+        dist[j][k]=difference(j,hill.center[j],x);
+        if(!hill.multivariate) dist[j][k]*=hill.invsigma[j];
       }
-    } else {
-      unsigned stride=comm.Get_size();
-      unsigned rank=comm.Get_rank();
-      std::vector<double> allder(ncv*neighbors.size(),0.0);
-      std::vector<double> n_der(ncv,0.0);
-      std::vector<double> allbias(neighbors.size(),0.0);
-      // for performance reasons and thread safety
+    }
+    // with doInt_ there is only one CV, and derivatives vanish outside the interval
+    std::vector<bool> noder;
+    if(doInt_) {
+      noder.resize(points[0].size());
+      for(unsigned k=0; k<points[0].size(); ++k) noder[k]=(points[0][k]<lowI_ || points[0][k]>uppI_);
+    }
+    Matrix<double> mymatrix;
+    if(hill.multivariate) {
+      mymatrix.resize(ncv,ncv);
+      unsigned k=0;
+      for(unsigned i=0; i<ncv; i++) {
+        for(unsigned j=i; j<ncv; j++) {
+          mymatrix(i,j)=mymatrix(j,i)=hill.sigma[k]; // recompose the full inverse matrix
+          k++;
+        }
+      }
+    }
+
+    Grid::index_t nneigh=1;
+    for(unsigned j=0; j<ncv; ++j) nneigh*=axes[j].size();
+    std::vector<Grid::index_t> neighbors(nneigh);
+    std::vector<double> allbias(nneigh,0.0);
+    std::vector<double> allder(ncv*nneigh,0.0);
+    unsigned stride=comm.Get_size();
+    unsigned rank=comm.Get_rank();
+    unsigned nt=OpenMP::getNumThreads();
+    if(nt*stride*10>nneigh) nt=nneigh/stride/10;
+    if(nt==0) nt=1;
+    #pragma omp parallel num_threads(nt)
+    {
+      std::vector<unsigned> pos(ncv);
       std::vector<double> dp(ncv);
-      for(unsigned i=rank; i<neighbors.size(); i+=stride) {
-        Grid::index_t ineigh=neighbors[i];
-        for(unsigned j=0; j<ncv; ++j) n_der[j]=0.0;
-        BiasGrid_->getPoint(ineigh,xx);
-        allbias[i]=evaluateGaussianAndDerivatives(xx,hill,n_der,dp);
-        for(unsigned j=0; j<ncv; j++) allder[ncv*i+j]=n_der[j];
+      #pragma omp for
+      for(Grid::index_t i=0; i<nneigh; ++i) {
+        neighbors[i]=BiasGrid_->getAxesNeighbor(i,axes,pos);
+        if(i%stride!=rank) continue;
+        for(unsigned j=0; j<ncv; ++j) dp[j]=dist[j][pos[j]];
+        // same arithmetic as in evaluateGaussianAndDerivatives()
+        double* der=&allder[ncv*i];
+        double dp2=0.0;
+        if(hill.multivariate) {
+          for(unsigned j=0; j<ncv; j++) {
+            for(unsigned l=j; l<ncv; l++) {
+              if(j==l) dp2+=dp[j]*dp[j]*mymatrix(j,l)*0.5;
+              else dp2+=dp[j]*dp[l]*mymatrix(j,l);
+            }
+          }
+        } else {
+          for(unsigned j=0; j<ncv; j++) dp2+=dp[j]*dp[j];
+          dp2*=0.5;
+        }
+        if(dp2<DP2CUTOFF) {
+          double bias=hill.height*std::exp(-dp2);
+          allbias[i]=bias;
+          if(!doInt_ || !noder[pos[0]]) {
+            if(hill.multivariate) {
+              for(unsigned j=0; j<ncv; j++) {
+                double tmp=0.0;
+                for(unsigned l=0; l<ncv; l++) tmp += dp[l]*mymatrix(j,l)*bias;
+                der[j]-=tmp;
+              }
+            } else {
+              for(unsigned j=0; j<ncv; j++) der[j]-=bias*dp[j]*hill.invsigma[j];
+            }
+          }
+        }
       }
+    }
+    if(stride>1) {
       comm.Sum(allbias);
       comm.Sum(allder);
-      for(unsigned i=0; i<neighbors.size(); ++i) {
-        Grid::index_t ineigh=neighbors[i];
-        for(unsigned j=0; j<ncv; ++j) der[j]=allder[ncv*i+j];
-        BiasGrid_->addValueAndDerivatives(ineigh,allbias[i],der);
+    }
+    // neighbors can be repeated when the support is larger than a periodic grid,
+    // so they are accumulated serially
+    if(incremental_stride_>0 && incremental_valid_) {
+      bool repeated=false;
+      std::vector<unsigned> nbin=BiasGrid_->getNbin();
+      for(unsigned j=0; j<ncv; ++j) if(axes[j].size()>nbin[j]) repeated=true;
+      if(repeated) incremental_valid_=false;
+      else updateGridSums(neighbors,allbias);
+    }
+    std::vector<double> der(ncv);
+    for(Grid::index_t i=0; i<nneigh; ++i) {
+      for(unsigned j=0; j<ncv; ++j) der[j]=allder[ncv*i+j];
+      BiasGrid_->addValueAndDerivatives(neighbors[i],allbias[i],der);
+    }
+  } else {
+    // a nearby hill can absorb the new one
+    if(compression_threshold2_>0 && !hill.multivariate) {
+      hills_cells_.getNeighbors(hill.center,std::sqrt(compression_threshold2_),hills_neigh_);
+      double min_norm2=compression_threshold2_;
+      unsigned taker=hills_.size();
+      for(unsigned n=0; n<hills_neigh_.size(); ++n) {
+        const Gaussian& other=hills_[hills_neigh_[n]];
+        double norm2=0.0;
+        for(unsigned i=0; i<getNumberOfArguments() && norm2<min_norm2; ++i) {
+          const double d=difference(i,other.center[i],hill.center[i])*other.invsigma[i];
+          norm2+=d*d;
+        }
+        if(norm2<min_norm2) {
+          min_norm2=norm2;
+          taker=hills_neigh_[n];
+        }
+      }
+      if(taker<hills_.size()) {
+        hills_cells_.remove(taker,hills_[taker].center);
+        mergeHills(hills_[taker],hill);
+        hills_cells_.add(taker,hills_[taker].center,getHillExtent(hills_[taker]),std::sqrt(2.0*DP2CUTOFF));
+        return;
       }
     }
-  } else hills_.push_back(hill);
+    hills_.push_back(hill);
+    hills_cells_.add(hills_.size()-1,hill.center,getHillExtent(hill),std::sqrt(2.0*DP2CUTOFF));
+  }
+}
+
+std::vector<double> MetaD::getHillExtent(const Gaussian& hill)
+{
+  // width of the hill along each CV, so that it vanishes beyond sqrt(2*DP2CUTOFF) times this width
+  if(!hill.multivariate) return hill.sigma;
+  unsigned ncv=getNumberOfArguments();
+  unsigned k=0;
+  Matrix<double> mymatrix(ncv,ncv);
+  for(unsigned i=0; i<ncv; i++) {
+    for(unsigned j=i; j<ncv; j++) {
+      mymatrix(i,j)=mymatrix(j,i)=hill.sigma[k]; // recompose the full inverse matrix
+      k++;
+    }
+  }
+  Matrix<double> myinv(ncv,ncv);
+  Invert(mymatrix,myinv);
+  std::vector<double> extent(ncv);
+  for(unsigned i=0; i<ncv; i++) extent[i]=std::sqrt(myinv(i,i));
+  return extent;
+}
+
+void MetaD::mergeHills(Gaussian& taker, const Gaussian& giver)
+{
+  // same as for OPES kernels, but weighting with the volume of the hills, which is preserved
+  unsigned ncv=getNumberOfArguments();
+  double m1=taker.height, m2=giver.height;
+  for(unsigned i=0; i<ncv; i++) {
+    m1*=taker.sigma[i];
+    m2*=giver.sigma[i];
+  }
+  const double m=m1+m2;
+  double volume=1.0;
+  for(unsigned i=0; i<ncv; i++) {
+    // center of the taker in the same periodic image as the giver
+    const double c1=giver.center[i]+difference(i,giver.center[i],taker.center[i]);
+    const double c2=giver.center[i];
+    const double c=(m1*c1+m2*c2)/m;
+    const double ss=(m1*(taker.sigma[i]*taker.sigma[i]+c1*c1)+m2*(giver.sigma[i]*giver.sigma[i]+c2*c2))/m-c*c;
+    taker.center[i]=(getPntrToArgument(i)->isPeriodic()?getPntrToArgument(i)->bringBackInPbc(c):c);
+    taker.sigma[i]=std::sqrt(ss);
+    taker.invsigma[i]=1.0/taker.sigma[i];
+    volume*=taker.sigma[i];
+  }
+  taker.height=m/volume;
 }
 
 std::vector<unsigned> MetaD::getGaussianSupport(const Gaussian& hill)
@@ -1588,6 +2053,17 @@ std::vector<unsigned> MetaD::getGaussianSupport(const Gaussian& hill)
   return nneigh;
 }
 
+void MetaD::getHillNeighbors(const std::vector<double>& cv, std::vector<unsigned>& neigh)
+{
+  // hills farther than the cutoff give exactly zero, so only the ones in the nearby cells are needed
+  if(doInt_) {
+    std::vector<double> tmpcv(1,cv[0]);
+    if(cv[0]<lowI_) tmpcv[0]=lowI_;
+    if(cv[0]>uppI_) tmpcv[0]=uppI_;
+    hills_cells_.getNeighbors(tmpcv,std::sqrt(2.0*DP2CUTOFF),neigh);
+  } else hills_cells_.getNeighbors(cv,std::sqrt(2.0*DP2CUTOFF),neigh);
+}
+
 double MetaD::getBias(const std::vector<double>& cv)
 {
   double bias=0.0;
@@ -1598,10 +2074,12 @@ double MetaD::getBias(const std::vector<double>& cv)
     unsigned rank=comm.Get_rank();
 
     if(!nlist_) {
+      std::vector<unsigned> neigh;
+      getHillNeighbors(cv,neigh);
       #pragma omp parallel num_threads(nt)
       {
         #pragma omp for reduction(+:bias) nowait
-        for(unsigned i=rank; i<hills_.size(); i+=stride) bias+=evaluateGaussian(cv,hills_[i]);
+        for(unsigned i=rank; i<neigh.size(); i+=stride) bias+=evaluateGaussian(cv,hills_[neigh[i]]);
       }
     } else {
       #pragma omp parallel num_threads(nt)
@@ -1630,11 +2108,12 @@ double MetaD::getBiasAndDerivatives(const std::vector<double>& cv, std::vector<d
     unsigned rank=comm.Get_rank();
 
     if(!nlist_) {
-      if(hills_.size()<2*nt*stride||nt==1) {
+      getHillNeighbors(cv,hills_neigh_);
+      if(hills_neigh_.size()<2*nt*stride||nt==1) {
         // for performance reasons and thread safety
         std::vector<double> dp(ncv);
-        for(unsigned i=rank; i<hills_.size(); i+=stride) {
-          bias+=evaluateGaussianAndDerivatives(cv,hills_[i],der,dp);
+        for(unsigned i=rank; i<hills_neigh_.size(); i+=stride) {
+          bias+=evaluateGaussianAndDerivatives(cv,hills_[hills_neigh_[i]],der,dp);
         }
       } else {
         #pragma omp parallel num_threads(nt)
@@ -1643,8 +2122,8 @@ double MetaD::getBiasAndDerivatives(const std::vector<double>& cv, std::vector<d
           // for performance reasons and thread safety
           std::vector<double> dp(ncv);
           #pragma omp for reduction(+:bias) nowait
-          for(unsigned i=rank; i<hills_.size(); i+=stride) {
-            bias+=evaluateGaussianAndDerivatives(cv,hills_[i],omp_deriv,dp);
+          for(unsigned i=rank; i<hills_neigh_.size(); i+=stride) {
+            bias+=evaluateGaussianAndDerivatives(cv,hills_[hills_neigh_[i]],omp_deriv,dp);
           }
           #pragma omp critical
           for(unsigned i=0; i<ncv; i++) der[i]+=omp_deriv[i];
@@ -1901,6 +2380,7 @@ void MetaD::calculate()
   for(unsigned i=0; i<ncv; i++) setOutputForce(i,-der[i]);
 
   if(calc_work_) getPntrToComponent("work")->set(work_);
+  if(compression_threshold2_>0) getPntrToComponent("nker")->set(hills_.size());
   if(calc_rct_) getPntrToComponent("rbias")->set(ene - reweight_factor_);
   // calculate the acceleration factor
   if(acceleration_&&!isFirstStep_) {
@@ -1973,6 +2453,7 @@ void MetaD::update()
       // Flying Gaussian
       if (flying_) {
         hills_.clear();
+        hills_cells_.clear();
         comm.Barrier();
       }
 
@@ -1992,6 +2473,7 @@ void MetaD::update()
       Gaussian newhill=Gaussian(multivariate,height,cv,thissigma);
       addGaussian(newhill);
       writeGaussian(newhill,hillsOfile_);
+      if(mw_buffers_.size()>0 && comm.Get_rank()==0) mw_buffers_[mw_id_]->push(getHillRecord(newhill));
     }
 
     // this is to update the hills neighbor list
@@ -2000,7 +2482,7 @@ void MetaD::update()
 
   // this should be outside of the if block in case
   // mw_rstride_ is not a multiple of stride_
-  if(mw_n_>1 && getStep()%mw_rstride_==0) hillsOfile_.flush();
+  if(mw_n_>1 && mw_buffers_.size()==0 && getStep()%mw_rstride_==0) hillsOfile_.flush();
 
   if(calc_work_) {
     if(nlist_) updateNlist();
@@ -2034,7 +2516,8 @@ void MetaD::update()
   }
 
   // if multiple walkers and time to read Gaussians
-  if(mw_n_>1 && getStep()%mw_rstride_==0) {
+  if(mw_n_>1 && getStep()%mw_rstride_==0 && mw_buffers_.size()>0) readSharedGaussians();
+  else if(mw_n_>1 && getStep()%mw_rstride_==0) {
     for(int i=0; i<mw_n_; ++i) {
       // don't read your own Gaussians
       if(i==mw_id_) continue;
@@ -2060,7 +2543,7 @@ void MetaD::update()
   bool bias_has_changed = (nowAddAHill || (mw_n_ > 1 && getStep() % mw_rstride_ == 0));
   if (calc_rct_ && bias_has_changed && getStep()%(stride_*rct_ustride_)==0) computeReweightingFactor();
   if (calc_max_bias_ && bias_has_changed) {
-    max_bias_ = BiasGrid_->getMaxValue();
+    updateMaxBias();
     getPntrToComponent("maxbias")->set(max_bias_);
   }
   if (calc_transition_bias_ && bias_has_changed) {
@@ -2151,6 +2634,14 @@ void MetaD::computeReweightingFactor()
     return;
   }
 
+  if(incremental_stride_>0) {
+    // Z_0_ and Z_V_ are kept up to date by addGaussian()
+    updateMaxBias();
+    reweight_factor_=kbt_*std::log(Z_0_/Z_V_)+max_bias_;
+    getPntrToComponent("rct")->set(reweight_factor_);
+    return;
+  }
+
   double Z_0=0; //proportional to the integral of exp(-beta*F)
   double Z_V=0; //proportional to the integral of exp(-beta*(F+V))
   double minusBetaF=biasf_/(biasf_-1.)/kbt_;
@@ -2175,6 +2666,87 @@ void MetaD::computeReweightingFactor()
   getPntrToComponent("rct")->set(reweight_factor_);
 }
 
+void MetaD::updateMaxBias()
+{
+  if(incremental_stride_==0) max_bias_=BiasGrid_->getMaxValue();
+  else if(!incremental_valid_ || incremental_count_>=incremental_stride_) computeGridSums();
+}
+
+void MetaD::computeGridSums()
+{
+  // the sums are computed with respect to the maximum bias, to avoid exp overflow
+  max_bias_=BiasGrid_->getMaxValue();
+  Z_0_=Z_V_=0.0;
+  if(calc_rct_ && biasf_!=1.0) {
+    double minusBetaF=biasf_/(biasf_-1.)/kbt_;
+    double minusBetaFplusV=1./(biasf_-1.)/kbt_;
+    if (biasf_==-1.0) { //non well-tempered case
+      minusBetaF=1./kbt_;
+      minusBetaFplusV=0;
+    }
+    const unsigned rank=comm.Get_rank();
+    const unsigned stride=comm.Get_size();
+    for (Grid::index_t t=rank; t<BiasGrid_->getSize(); t+=stride) {
+      const double val=BiasGrid_->getValue(t);
+      Z_0_+=std::exp(minusBetaF*(val-max_bias_));
+      Z_V_+=std::exp(minusBetaFplusV*(val-max_bias_));
+    }
+    comm.Sum(Z_0_);
+    comm.Sum(Z_V_);
+  }
+  incremental_count_=0;
+  incremental_valid_=true;
+}
+
+void MetaD::updateGridSums(const std::vector<Grid::index_t>& neighbors, const std::vector<double>& allbias)
+{
+  // this is called before the hill is added, so that the grid still contains the old values.
+  // All the ranks have the same grid, so they all do the full calculation and no communication is needed
+  const Grid::index_t nneigh=neighbors.size();
+  double newmax=max_bias_;
+  bool negative=false;
+  unsigned nt=OpenMP::getNumThreads();
+  if(nt*10>nneigh) nt=nneigh/10;
+  if(nt==0) nt=1;
+  #pragma omp parallel for num_threads(nt) reduction(max:newmax) reduction(||:negative)
+  for(Grid::index_t i=0; i<nneigh; ++i) {
+    const double val=BiasGrid_->getValue(neighbors[i])+allbias[i];
+    if(val>newmax) newmax=val;
+    if(allbias[i]<0.0) negative=true;
+  }
+  // the maximum could have decreased somewhere else
+  if(negative) {
+    incremental_valid_=false;
+    return;
+  }
+  if(calc_rct_ && biasf_!=1.0) {
+    double minusBetaF=biasf_/(biasf_-1.)/kbt_;
+    double minusBetaFplusV=1./(biasf_-1.)/kbt_;
+    if (biasf_==-1.0) { //non well-tempered case
+      minusBetaF=1./kbt_;
+      minusBetaFplusV=0;
+    }
+    // move the reference to the new maximum
+    if(newmax>max_bias_) {
+      Z_0_*=std::exp(minusBetaF*(max_bias_-newmax));
+      Z_V_*=std::exp(minusBetaFplusV*(max_bias_-newmax));
+    }
+    double dZ_0=0.0;
+    double dZ_V=0.0;
+    #pragma omp parallel for num_threads(nt) reduction(+:dZ_0,dZ_V)
+    for(Grid::index_t i=0; i<nneigh; ++i) {
+      const double oldval=BiasGrid_->getValue(neighbors[i]);
+      const double newval=oldval+allbias[i];
+      dZ_0+=std::exp(minusBetaF*(newval-newmax))-std::exp(minusBetaF*(oldval-newmax));
+      dZ_V+=std::exp(minusBetaFplusV*(newval-newmax))-std::exp(minusBetaFplusV*(oldval-newmax));
+    }
+    Z_0_+=dZ_0;
+    Z_V_+=dZ_V;
+  }
+  max_bias_=newmax;
+  incremental_count_++;
+}
+
 double MetaD::getTransitionBarrierBias()
 {
   // If there is only one well of interest, return the bias at that well point.
@@ -2239,15 +2811,26 @@ void MetaD::updateNlist()
 
   // here we generate the neighbor list
   nlist_hills_.clear();
+  // with fixed hills the candidates can be taken from the nearby cells only
+  std::vector<unsigned> candidates;
+  if(adaptive_==FlexibleBin::none) {
+    std::vector<double> cv(getNumberOfArguments());
+    for(unsigned i=0; i<getNumberOfArguments(); i++) cv[i]=getArgument(i);
+    hills_cells_.getNeighbors(cv,std::sqrt(nlist_param_[0]*DP2CUTOFF),candidates);
+  } else {
+    candidates.resize(hills_.size());
+    for(unsigned k=0; k<hills_.size(); k++) candidates[k]=k;
+  }
   std::vector<Gaussian> local_flat_nl;
   unsigned nt=OpenMP::getNumThreads();
-  if(hills_.size()<2*nt) nt=1;
+  if(candidates.size()<2*nt) nt=1;
   #pragma omp parallel num_threads(nt)
   {
     std::vector<Gaussian> private_flat_nl;
     #pragma omp for nowait
-    for(unsigned k=0; k<hills_.size(); k++)
+    for(unsigned n=0; n<candidates.size(); n++)
     {
+      const unsigned k=candidates[n];
       double dist2=0;
       for(unsigned i=0; i<getNumberOfArguments(); i++)
       {
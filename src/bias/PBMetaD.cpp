@@ -31,6 +31,7 @@
 #include "tools/OpenMP.h"
 #include "tools/Random.h"
 #include "tools/File.h"
+#include "tools/SharedRingBuffer.h"
 #include <ctime>
 #include <numeric>
 #if defined(__PLUMED_HAS_GETCWD)
@@ -210,6 +211,10 @@ id of the present walker (starting from 0 ) and the WALKERS_DIR is the directory
 where all the walkers are located. WALKERS_RSTRIDE is the number of step between
 one update and the other.
 
+As in \ref METAD, when all the walkers run on the same node the hills can be exchanged
+through memory-mapped buffers by adding for instance WALKERS_SHM=/dev/shm/pb.
+The hills files of the other walkers are then only read when restarting.
+
 */
 //+ENDPLUMEDOC
 
@@ -260,6 +265,9 @@ private:
   std::string mw_dir_;
   int mw_id_;
   int mw_rstride_;
+  std::string mw_shm_;
+  unsigned mw_shm_size_;
+  std::vector<std::unique_ptr<SharedRingBuffer>> mw_buffers_;
   bool walkers_mpi_;
   size_t mpi_nw_;
   unsigned mpi_id_;
@@ -275,6 +283,7 @@ private:
   unsigned current_value_;
 
   void   readGaussians(unsigned iarg, IFile*);
+  void   readSharedGaussians();
   void   writeGaussian(unsigned iarg, const Gaussian&, OFile*);
   void   addGaussian(unsigned iarg, const Gaussian&);
   double getBiasAndDerivatives(unsigned iarg, const std::vector<double>&, double* der=NULL);
@@ -308,6 +317,8 @@ void PBMetaD::registerKeywords(Keywords& keys) {
   keys.add("optional","GRID_BIN","the number of bins for the grid");
   keys.add("optional","GRID_SPACING","the approximate grid spacing (to be used as an alternative or together with GRID_BIN)");
   keys.addFlag("GRID_SPARSE",false,"use a sparse grid to store hills");
+  keys.addFlag("GRID_FLOAT",false,"store the grids in single precision, to reduce memory usage");
+  keys.addFlag("GRID_NODERIV",false,"do not store derivatives on the grids, and compute them by finite differences when needed, to reduce memory usage");
   keys.addFlag("GRID_NOSPLINE",false,"don't use spline interpolation with grids");
   keys.add("optional","GRID_WSTRIDE", "frequency for dumping the grid");
   keys.add("optional","GRID_WFILES", "dump grid for the bias, default names are used if GRID_WSTRIDE is used without GRID_WFILES.");
@@ -321,6 +332,8 @@ void PBMetaD::registerKeywords(Keywords& keys) {
   keys.add("optional","WALKERS_N", "number of walkers");
   keys.add("optional","WALKERS_DIR", "shared directory with the hills files from all the walkers");
   keys.add("optional","WALKERS_RSTRIDE","stride for reading hills files");
+  keys.add("optional","WALKERS_SHM","prefix for the names of the memory-mapped buffers used to exchange hills between walkers running on the same node, e.g. /dev/shm/pb");
+  keys.add("optional","WALKERS_SHM_SIZE","number of depositions that can be stored in the buffer of each walker. The default is 10000");
   keys.addFlag("WALKERS_MPI",false,"Switch on MPI version of multiple walkers - not compatible with WALKERS_* options other than WALKERS_DIR");
   keys.add("optional","INTERVAL_MIN","one dimensional lower limits, outside the limits the system will not feel the biasing force.");
   keys.add("optional","INTERVAL_MAX","one dimensional upper limits, outside the limits the system will not feel the biasing force.");
@@ -341,6 +354,7 @@ PBMetaD::PBMetaD(const ActionOptions& ao):
   grid_(false),
   wgridstride_(0),
   mw_n_(1), mw_dir_(""), mw_id_(0), mw_rstride_(1),
+  mw_shm_(""), mw_shm_size_(10000),
   walkers_mpi_(false), mpi_nw_(0),
   do_select_(false)
 {
@@ -444,6 +458,12 @@ PBMetaD::PBMetaD(const ActionOptions& ao):
   if(mw_n_<=mw_id_) error("walker ID should be a numerical value less than the total number of walkers");
   parse("WALKERS_DIR",mw_dir_);
   parse("WALKERS_RSTRIDE",mw_rstride_);
+  parse("WALKERS_SHM",mw_shm_);
+  parse("WALKERS_SHM_SIZE",mw_shm_size_);
+  if(mw_shm_.length()>0) {
+    if(mw_n_<=1) error("WALKERS_SHM can only be used with WALKERS_N");
+    if(!SharedRingBuffer::isAvailable()) error("WALKERS_SHM requires memory-mapped files, which are not available on this system");
+  }
 
   // MPI version
   parseFlag("WALKERS_MPI",walkers_mpi_);
@@ -514,6 +534,11 @@ PBMetaD::PBMetaD(const ActionOptions& ao):
 
   bool sparsegrid=false;
   parseFlag("GRID_SPARSE",sparsegrid);
+  bool floatgrid=false;
+  parseFlag("GRID_FLOAT",floatgrid);
+  bool noderivgrid=false;
+  parseFlag("GRID_NODERIV",noderivgrid);
+  if(sparsegrid && (floatgrid || noderivgrid)) error("GRID_SPARSE cannot be combined with GRID_FLOAT or GRID_NODERIV");
   bool nospline=false;
   parseFlag("GRID_NOSPLINE",nospline);
   bool spline=!nospline;
@@ -568,6 +593,7 @@ PBMetaD::PBMetaD(const ActionOptions& ao):
     log.printf("  walker id %d\n",mw_id_);
     log.printf("  reading stride %d\n",mw_rstride_);
     if(mw_dir_!="")log.printf("  directory with hills files %s\n",mw_dir_.c_str());
+    if(mw_shm_!="")log.printf("  hills are exchanged through memory-mapped buffers %s.*, with room for %u depositions\n",mw_shm_.c_str(),mw_shm_size_);
   } else {
     if(walkers_mpi_) {
       log.printf("  Multiple walkers active using MPI communnication\n");
@@ -599,6 +625,8 @@ PBMetaD::PBMetaD(const ActionOptions& ao):
     log.printf("\n");
     if(spline) {log.printf("  Grid uses spline interpolation\n");}
     if(sparsegrid) {log.printf("  Grid uses sparse grid\n");}
+    if(floatgrid) {log.printf("  Grid is stored in single precision\n");}
+    if(noderivgrid) {log.printf("  Grid derivatives are computed by finite differences\n");}
     if(wgridstride_>0) {
       for(unsigned i=0; i<gridfilenames_.size(); ++i) {
         log.printf("  Grid is written on file %s with stride %d\n",gridfilenames_[i].c_str(),wgridstride_);
@@ -652,7 +680,7 @@ PBMetaD::PBMetaD(const ActionOptions& ao):
           error("The GRID file you want to read: " + gridreadfilenames_[i] + ", cannot be found!");
         }
         std::string funcl = getLabel() + ".bias";
-        BiasGrid_=GridBase::create(funcl, args, gridfile, gmin_t, gmax_t, gbin_t, sparsegrid, spline, true);
+        BiasGrid_=GridBase::create(funcl, args, gridfile, gmin_t, gmax_t, gbin_t, sparsegrid, spline, true, floatgrid, !noderivgrid);
         if(BiasGrid_->getDimension() != args.size()) {
           error("mismatch between dimensionality of input grid and number of arguments");
         }
@@ -662,8 +690,10 @@ PBMetaD::PBMetaD(const ActionOptions& ao):
         log.printf("  Restarting from %s:\n",gridreadfilenames_[i].c_str());
         if(getRestart()) restartedFromGrid=true;
       } else {
-        if(!sparsegrid) {BiasGrid_=Tools::make_unique<Grid>(funcl,args,gmin_t,gmax_t,gbin_t,spline,true);}
-        else           {BiasGrid_=Tools::make_unique<SparseGrid>(funcl,args,gmin_t,gmax_t,gbin_t,spline,true);}
+        if(sparsegrid)       {BiasGrid_=Tools::make_unique<SparseGrid>(funcl,args,gmin_t,gmax_t,gbin_t,spline,true);}
+        else if(floatgrid)   {BiasGrid_=Tools::make_unique<CompactGrid<float>>(funcl,args,gmin_t,gmax_t,gbin_t,spline,true,!noderivgrid);}
+        else if(noderivgrid) {BiasGrid_=Tools::make_unique<CompactGrid<double>>(funcl,args,gmin_t,gmax_t,gbin_t,spline,true,false);}
+        else                 {BiasGrid_=Tools::make_unique<Grid>(funcl,args,gmin_t,gmax_t,gbin_t,spline,true);}
         std::vector<std::string> actualmin=BiasGrid_->getMin();
         std::vector<std::string> actualmax=BiasGrid_->getMax();
         std::string is;
@@ -744,13 +774,27 @@ PBMetaD::PBMetaD(const ActionOptions& ao):
       ofile->addConstantField("lower_int").printField("lower_int",lowI_[i]);
       ofile->addConstantField("upper_int").printField("upper_int",uppI_[i]);
     }
-    ofile->setHeavyFlush();
+    // with shared buffers, the hills file is only a log
+    if(mw_shm_.length()==0) ofile->setHeavyFlush();
     // output periodicities of variables
     ofile->setupPrintValue( getPntrToArgument(i) );
     // push back
     hillsOfiles_.emplace_back(std::move(ofile));
   }
 
+  // with shared buffers, the hills files of the other walkers are not read anymore
+  if(mw_shm_.length()>0) {
+    for(int j=0; j<mw_n_; ++j) {
+      for(unsigned i=0; i<hillsfname_.size(); ++i) {
+        unsigned k=j*hillsfname_.size()+i;
+        if(j!=mw_id_ && ifiles_[k]->isOpen()) ifiles_[k]->close();
+      }
+      mw_buffers_.emplace_back(Tools::make_unique<SharedRingBuffer>());
+    }
+    // each record contains the multivariate flag and center, sigma and height for all the arguments
+    if(comm.Get_rank()==0) mw_buffers_[mw_id_]->create(mw_shm_+"."+std::to_string(mw_id_),mw_shm_size_,1+3*getNumberOfArguments());
+  }
+
   // Dump grid to files
   if(wgridstride_ > 0) {
     for(unsigned i = 0; i < gridfilenames_.size(); ++i) {
@@ -805,6 +849,39 @@ void PBMetaD::readGaussians(unsigned iarg, IFile *ifile)
   log.printf("      %d Gaussians read\n",nhills);
 }
 
+void PBMetaD::readSharedGaussians()
+{
+  unsigned ncv=getNumberOfArguments();
+  unsigned recordsize=1+3*ncv;
+  std::vector<double> data;
+  std::vector<double> center(1);
+  std::vector<double> sigma(1);
+  for(int j=0; j<mw_n_; ++j) {
+    // don't read your own Gaussians
+    if(j==mw_id_) continue;
+    // only the root of each walker accesses the buffers, since the other processes could be on other nodes
+    unsigned nrecords=0;
+    data.clear();
+    if(comm.Get_rank()==0) {
+      if(!mw_buffers_[j]->isOpen()) mw_buffers_[j]->attach(mw_shm_+"."+std::to_string(j));
+      if(mw_buffers_[j]->isOpen()) nrecords=mw_buffers_[j]->read(data);
+    }
+    comm.Bcast(nrecords,0);
+    if(nrecords==0) continue;
+    data.resize(nrecords*recordsize);
+    comm.Bcast(data,0);
+    for(unsigned k=0; k<nrecords; ++k) {
+      const double* record=&data[k*recordsize];
+      bool multivariate=(record[0]>0.5);
+      for(unsigned i=0; i<ncv; ++i) {
+        center[0]=record[1+i];
+        sigma[0]=record[1+ncv+i];
+        addGaussian(i, Gaussian(center,sigma,record[1+2*ncv+i],multivariate));
+      }
+    }
+  }
+}
+
 void PBMetaD::writeGaussian(unsigned iarg, const Gaussian& hill, OFile *ofile)
 {
   ofile->printField("time",getTimeStep()*getStep());
@@ -1083,14 +1160,21 @@ void PBMetaD::update()
       }
       // just add your own hills
     } else {
-      for(unsigned i=0; i<getNumberOfArguments(); ++i) {
+      unsigned ncv=getNumberOfArguments();
+      std::vector<double> record(1+3*ncv);
+      record[0]=(multivariate?1.0:0.0);
+      for(unsigned i=0; i<ncv; ++i) {
         cv_tmp[0] = cv[i];
         if(adaptive_!=FlexibleBin::none) sigma_tmp[0]=thissigma[i];
         else sigma_tmp[0] = sigma0_[i];
         Gaussian newhill = Gaussian(cv_tmp, sigma_tmp, height[i], multivariate);
         addGaussian(i, newhill);
         writeGaussian(i, newhill, hillsOfiles_[i].get());
+        record[1+i]=cv_tmp[0];
+        record[1+ncv+i]=sigma_tmp[0];
+        record[1+2*ncv+i]=height[i];
       }
+      if(mw_buffers_.size()>0 && comm.Get_rank()==0) mw_buffers_[mw_id_]->push(record);
     }
   }
 
@@ -1111,7 +1195,8 @@ void PBMetaD::update()
   }
 
   // if multiple walkers and time to read Gaussians
-  if(mw_n_>1 && getStep()%mw_rstride_==0) {
+  if(mw_n_>1 && getStep()%mw_rstride_==0 && mw_buffers_.size()>0) readSharedGaussians();
+  else if(mw_n_>1 && getStep()%mw_rstride_==0) {
     for(int j=0; j<mw_n_; ++j) {
       for(unsigned i=0; i<hillsfname_.size(); ++i) {
         unsigned k=j*hillsfname_.size()+i;
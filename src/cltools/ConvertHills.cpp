@@ -0,0 +1,208 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2021 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "CLTool.h"
+#include "CLToolRegister.h"
+#include "tools/Tools.h"
+#include "tools/File.h"
+#include "tools/BinaryHills.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace PLMD {
+namespace cltools {
+
+//+PLUMEDOC TOOLS convert_hills
+/*
+convert_hills converts a hills file written by METAD from text to binary format or vice versa
+
+Binary hills files are written by \ref METAD when the BINARY_HILLS flag is used.
+They can be read much faster than text files when restarting, or when computing the free energy
+with \ref sum_hills. The direction of the conversion is detected from the format of the input file.
+Text files can be compressed, whereas binary files cannot: a compressed input file is always read as a text file.
+
+\par Examples
+
+The following command converts an existing text hills file into a binary one,
+that can be used to restart a simulation with BINARY_HILLS:
+
+\verbatim
+plumed convert_hills --input HILLS --output HILLS.bin
+\endverbatim
+
+The following command converts it back to text, writing numbers with a given format:
+
+\verbatim
+plumed convert_hills --input HILLS.bin --output HILLS.txt --fmt %14.9f
+\endverbatim
+
+*/
+//+ENDPLUMEDOC
+
+class ConvertHills:
+  public CLTool
+{
+  void toBinary(const std::string& input,const std::string& output);
+  void toText(const std::string& input,const std::string& output,const std::string& fmt);
+public:
+  static void registerKeywords( Keywords& keys );
+  explicit ConvertHills(const CLToolOptions& co );
+  int main(FILE* in, FILE*out,Communicator& pc) override;
+  std::string description()const override {
+    return "convert hills files between text and binary format";
+  }
+};
+
+PLUMED_REGISTER_CLTOOL(ConvertHills,"convert_hills")
+
+void ConvertHills::registerKeywords( Keywords& keys ) {
+  CLTool::registerKeywords( keys );
+  keys.add("compulsory","--input","the hills file to be converted");
+  keys.add("compulsory","--output","the converted hills file");
+  keys.add("optional","--fmt","the format used for numbers when writing a text file");
+}
+
+ConvertHills::ConvertHills(const CLToolOptions& co ):
+  CLTool(co)
+{
+  inputdata=commandline;
+}
+
+int ConvertHills::main(FILE* in, FILE*out,Communicator& pc) {
+  std::string input; parse("--input",input);
+  std::string output; parse("--output",output);
+  std::string fmt; parse("--fmt",fmt);
+  if(BinaryHills::isBinary(input)) {
+    toText(input,output,fmt);
+    std::fprintf(out,"converted binary hills file %s to text file %s\n",input.c_str(),output.c_str());
+  } else {
+    plumed_massert(Tools::extension(output)!="gz","binary hills files cannot be compressed");
+    toBinary(input,output);
+    std::fprintf(out,"converted text hills file %s to binary file %s\n",input.c_str(),output.c_str());
+  }
+  return 0;
+}
+
+void ConvertHills::toBinary(const std::string& input,const std::string& output) {
+  BinaryHills::Header header;
+// the variables are the fields between time and the first sigma, as in sum_hills
+  {
+    IFile ifile;
+    ifile.allowIgnoredFields();
+    plumed_massert(ifile.FileExist(input),"file "+input+" does not exist");
+    ifile.open(input);
+    std::vector<std::string> fields;
+    ifile.scanFieldList(fields);
+    for(unsigned i=0; i<fields.size(); i++) {
+      if(fields[i]=="time") continue;
+      if(fields[i].find("sigma_")==0 || fields[i]=="height" || fields[i]=="multivariate" || fields[i]=="kerneltype") break;
+      if(fields[i].find("min_")==0 || fields[i].find("max_")==0) continue;
+      std::string min,max;
+      if(ifile.FieldExist("min_"+fields[i])) {
+        ifile.scanField("min_"+fields[i],min);
+        ifile.scanField("max_"+fields[i],max);
+      }
+      header.addArgument(fields[i],min,max);
+    }
+    std::string sss;
+    if(ifile.FieldExist("multivariate")) ifile.scanField("multivariate",sss);
+    header.multivariate=(sss=="true");
+    if(ifile.FieldExist("lower_int")) {
+      ifile.scanField("lower_int",header.lower_int);
+      ifile.scanField("upper_int",header.upper_int);
+    }
+    ifile.scanField();
+  }
+  plumed_massert(header.getNumberOfArguments()>0,"no variables found in file "+input);
+
+  const unsigned ncv=header.getNumberOfArguments();
+  std::vector<std::string> sigmanames;
+  if(header.multivariate) {
+    for(unsigned i=0; i<ncv; i++) for(unsigned j=0; j<ncv-i; j++) sigmanames.push_back("sigma_"+header.names[j+i]+"_"+header.names[j]);
+  } else {
+    for(unsigned i=0; i<ncv; i++) sigmanames.push_back("sigma_"+header.names[i]);
+  }
+
+  IFile ifile;
+  ifile.allowIgnoredFields();
+  ifile.open(input);
+  OFile ofile;
+  ofile.open(output);
+  BinaryHills::writeHeader(ofile,header);
+  std::vector<double> record(header.getRecordSize());
+  double time;
+  while(ifile.scanField("time",time)) {
+    unsigned k=0;
+    record[k++]=time;
+    for(unsigned i=0; i<ncv; i++) ifile.scanField(header.names[i],record[k++]);
+    std::string sss;
+    if(ifile.FieldExist("multivariate")) ifile.scanField("multivariate",sss);
+    plumed_massert((sss=="true")==header.multivariate,"binary hills files cannot contain both multivariate and diagonal hills");
+    for(unsigned i=0; i<sigmanames.size(); i++) ifile.scanField(sigmanames[i],record[k++]);
+    ifile.scanField("height",record[k++]);
+    double biasf=1.0;
+    if(ifile.FieldExist("biasf")) ifile.scanField("biasf",biasf);
+    record[k++]=biasf;
+    ifile.scanField();
+    BinaryHills::writeRecord(ofile,record);
+  }
+}
+
+void ConvertHills::toText(const std::string& input,const std::string& output,const std::string& fmt) {
+  BinaryHills hills(input);
+  const BinaryHills::Header& header=hills.getHeader();
+  const unsigned ncv=header.getNumberOfArguments();
+  OFile ofile;
+  ofile.open(output);
+  if(fmt.length()>0) ofile.fmtField(" "+fmt);
+  ofile.addConstantField("multivariate");
+  ofile.addConstantField("kerneltype");
+  if(header.lower_int.length()>0) {
+    ofile.addConstantField("lower_int").printField("lower_int",header.lower_int);
+    ofile.addConstantField("upper_int").printField("upper_int",header.upper_int);
+  }
+  for(unsigned i=0; i<ncv; i++) {
+    if(!header.isPeriodic(i)) continue;
+    ofile.addConstantField("min_"+header.names[i]).printField("min_"+header.names[i],header.min[i]);
+    ofile.addConstantField("max_"+header.names[i]).printField("max_"+header.names[i],header.max[i]);
+  }
+  for(std::size_t n=0; n<hills.size(); n++) {
+    ofile.printField("time",hills.getTime(n));
+    const double* center=hills.getCenter(n);
+    for(unsigned i=0; i<ncv; i++) ofile.printField(header.names[i],center[i]);
+    ofile.printField("kerneltype","gaussian");
+    ofile.printField("multivariate",header.multivariate?"true":"false");
+    const double* sigma=hills.getFileSigma(n);
+    unsigned k=0;
+    if(header.multivariate) {
+      for(unsigned i=0; i<ncv; i++) for(unsigned j=0; j<ncv-i; j++) ofile.printField("sigma_"+header.names[j+i]+"_"+header.names[j],sigma[k++]);
+    } else {
+      for(unsigned i=0; i<ncv; i++) ofile.printField("sigma_"+header.names[i],sigma[k++]);
+    }
+    ofile.printField("height",hills.getHeight(n));
+    ofile.printField("biasf",hills.getBiasFactor(n));
+    ofile.printField();
+  }
+}
+
+} // End of namespace
+}
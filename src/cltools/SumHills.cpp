@@ -34,6 +34,7 @@
 #include "tools/File.h"
 #include "core/Value.h"
 #include "tools/Matrix.h"
+#include "tools/BinaryHills.h"
 
 namespace PLMD {
 namespace cltools {
@@ -42,6 +43,15 @@ namespace cltools {
 /*
 sum_hills is a tool that allows one to to use plumed to post-process an existing hills/colvar file
 
+Hills files written by \ref METAD with the BINARY_HILLS flag, or converted with \ref convert_hills,
+can be used with --hills in the same way as text files, and are read much faster.
+
+Hills are read in chunks and each of them is only added on the grid points within its support.
+The grid is split in slabs that are filled in parallel using the number of threads
+set with the PLUMED_NUM_THREADS environment variable. When running with mpirun, slabs are also
+distributed among the processes. With --stride, the free energy written at each
+step is obtained by accumulating only the newly read hills.
+
 \par Examples
 
 a typical case is about the integration of a hills file:
@@ -536,7 +546,32 @@ bool CLToolSumHills::findCvsAndPeriodic(std::string filename, std::vector< std::
   IFile ifile;
   ifile.allowIgnoredFields();
   std::vector<std::string> fields;
-  if(ifile.FileExist(filename)) {
+  if(ifile.FileExist(filename) && BinaryHills::isBinary(ifile.getPath())) {
+    // binary files describe the variables in their header
+    BinaryHills hills(ifile.getPath());
+    const BinaryHills::Header& header=hills.getHeader();
+    cvs.clear(); pmin.clear(); pmax.clear();
+    for(unsigned i=0; i<header.getNumberOfArguments(); i++) {
+      std::vector<std::string> ss;
+      size_t dot=header.names[i].find_first_of('.');
+      if(dot!=std::string::npos) {
+        ss.push_back(header.names[i].substr(0,dot));
+        ss.push_back(header.names[i].substr(dot+1));
+      } else ss.push_back(header.names[i]);
+      cvs.push_back(ss);
+      pmin.push_back(header.isPeriodic(i)?header.min[i]:"none");
+      pmax.push_back(header.isPeriodic(i)?header.max[i]:"none");
+    }
+    multivariate=header.multivariate;
+    if(header.lower_int.length()>0) {
+      lowI_=header.lower_int;
+      uppI_=header.upper_int;
+    } else {
+      lowI_="-1.";
+      uppI_="-1.";
+    }
+    return true;
+  } else if(ifile.FileExist(filename)) {
     cvs.clear(); pmin.clear(); pmax.clear();
     ifile.open(filename);
     ifile.scanFieldList(fields);
@@ -100,6 +100,7 @@ public:
 // active methods:
   static void registerKeywords( Keywords& keys );
   double pairing(double distance,double&dfunc,unsigned i,unsigned j)const override;
+  void pairings(unsigned n,const double* distance,const unsigned* i,const unsigned* j,double* result,double* dfunc)const override;
 };
 
 PLUMED_REGISTER_ACTION(Coordination,"COORDINATION")
@@ -149,6 +150,12 @@ double Coordination::pairing(double distance,double&dfunc,unsigned i,unsigned j)
   return switchingFunction.calculateSqr(distance,dfunc);
 }
 
+void Coordination::pairings(unsigned n,const double* distance,const unsigned* i,const unsigned* j,double* result,double* dfunc)const {
+  (void) i; // avoid warnings
+  (void) j; // avoid warnings
+  switchingFunction.calculateSqr(distance,result,dfunc,n);
+}
+
 }
 
 }
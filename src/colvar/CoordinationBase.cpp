@@ -23,17 +23,30 @@
 #include "tools/NeighborList.h"
 #include "tools/Communicator.h"
 #include "tools/OpenMP.h"
+#include <algorithm>
+#include <array>
 
 namespace PLMD {
 namespace colvar {
 
+void CoordinationBase::pairings(unsigned n,const double* distance,const unsigned* i,const unsigned* j,double* result,double* dfunc)const {
+  for(unsigned p=0; p<n; p++) {
+    dfunc[p]=0.;
+    result[p]=pairing(distance[p],dfunc[p],i[p],j[p]);
+  }
+}
+
 void CoordinationBase::registerKeywords( Keywords& keys ) {
   Colvar::registerKeywords(keys);
+  keys.use("SPARSE_DERIVATIVES");
   keys.addFlag("SERIAL",false,"Perform the calculation in serial - for debug purpose");
   keys.addFlag("PAIR",false,"Pair only 1st element of the 1st group with 1st element in the second, etc");
   keys.addFlag("NLIST",false,"Use a neighbor list to speed up the calculation");
   keys.add("optional","NL_CUTOFF","The cutoff for the neighbor list");
-  keys.add("optional","NL_STRIDE","The frequency with which we are updating the atoms in the neighbor list");
+  keys.add("optional","NL_STRIDE","The frequency with which we are updating the atoms in the neighbor list (not used with NL_SKIN)");
+  keys.add("optional","NL_SKIN","Verlet skin for the neighbor list. Pairs closer than NL_CUTOFF+NL_SKIN are stored. All the atoms are retrieved "
+           "at every step, and the pairs are searched again as soon as some atom has moved by more than half the skin since the last search. "
+           "The result is thus the same as without neighbor list, for any value of the skin");
   keys.add("atoms","GROUPA","First list of atoms");
   keys.add("atoms","GROUPB","Second list of atoms (if empty, N*(N-1)/2 pairs in GROUPA are counted)");
 }
@@ -43,7 +56,8 @@ CoordinationBase::CoordinationBase(const ActionOptions&ao):
   pbc(true),
   serial(false),
   invalidateList(true),
-  firsttime(true)
+  firsttime(true),
+  rebuildCount(0)
 {
 
   parseFlag("SERIAL",serial);
@@ -63,21 +77,28 @@ CoordinationBase::CoordinationBase(const ActionOptions&ao):
 // neighbor list stuff
   bool doneigh=false;
   double nl_cut=0.0;
+  double nl_skin=0.0;
   int nl_st=0;
   parseFlag("NLIST",doneigh);
   if(doneigh) {
     parse("NL_CUTOFF",nl_cut);
     if(nl_cut<=0.0) error("NL_CUTOFF should be explicitly specified and positive");
+    parse("NL_SKIN",nl_skin);
+    if(nl_skin<0.0) error("NL_SKIN should be positive");
     parse("NL_STRIDE",nl_st);
-    if(nl_st<=0) error("NL_STRIDE should be explicitly specified and positive");
+    if(nl_skin>0.0) {
+// with a skin the displacements of all the atoms are checked at every step
+      if(nl_st>0) error("NL_STRIDE cannot be used together with NL_SKIN");
+      nl_st=1;
+    } else if(nl_st<=0) error("NL_STRIDE should be explicitly specified and positive");
   }
 
   addValueWithDerivatives(); setNotPeriodic();
   if(gb_lista.size()>0) {
-    if(doneigh)  nl=Tools::make_unique<NeighborList>(ga_lista,gb_lista,serial,dopair,pbc,getPbc(),comm,nl_cut,nl_st);
+    if(doneigh)  nl=Tools::make_unique<NeighborList>(ga_lista,gb_lista,serial,dopair,pbc,getPbc(),comm,nl_cut,nl_st,nl_skin);
     else         nl=Tools::make_unique<NeighborList>(ga_lista,gb_lista,serial,dopair,pbc,getPbc(),comm);
   } else {
-    if(doneigh)  nl=Tools::make_unique<NeighborList>(ga_lista,serial,pbc,getPbc(),comm,nl_cut,nl_st);
+    if(doneigh)  nl=Tools::make_unique<NeighborList>(ga_lista,serial,pbc,getPbc(),comm,nl_cut,nl_st,nl_skin);
     else         nl=Tools::make_unique<NeighborList>(ga_lista,serial,pbc,getPbc(),comm);
   }
 
@@ -100,7 +121,8 @@ CoordinationBase::CoordinationBase(const ActionOptions&ao):
   if(dopair) log.printf("  with PAIR option\n");
   if(doneigh) {
     log.printf("  using neighbor lists with\n");
-    log.printf("  update every %d steps and cutoff %f\n",nl_st,nl_cut);
+    if(nl_skin>0.0) log.printf("  cutoff %f and verlet skin %f, the list is updated when an atom moves by more than %f\n",nl_cut,nl_skin,0.5*nl_skin);
+    else log.printf("  update every %d steps and cutoff %f\n",nl_st,nl_cut);
   }
 }
 
@@ -132,7 +154,24 @@ void CoordinationBase::calculate()
   std::vector<Vector> deriv(getNumberOfAtoms());
 
   if(nl->getStride()>0 && invalidateList) {
-    nl->update(getPositions());
+    if(nl->update(getPositions()) && nl->getSkin()>0.0) {
+      rebuildCount++;
+      log.printf("  %s: neighbor list pairs searched at step %ld (%u times so far)\n",getLabel().c_str(),getStep(),rebuildCount);
+    }
+  }
+
+  const bool sparse=getPntrToValue()->hasSparseDerivatives();
+  if(sparse) {
+// only the atoms that appear in some pair can have a non zero derivative
+    pairAtoms.clear();
+    isPairAtom.resize(getNumberOfAtoms(),false);
+    for(unsigned i=0; i<nl->size(); i++) {
+      for(const unsigned a : {nl->getClosePair(i).first,nl->getClosePair(i).second}) if(!isPairAtom[a]) {
+          isPairAtom[a]=true;
+          pairAtoms.push_back(a);
+        }
+    }
+    for(const auto & a : pairAtoms) isPairAtom[a]=false;
   }
 
   unsigned stride;
@@ -149,56 +188,83 @@ void CoordinationBase::calculate()
   const unsigned nn=nl->size();
   if(nt*stride*10>nn) nt=1;
 
+  if(nt>1) derivBuffer.resize(nt,getPositions().size());
+// per-thread sums, added in thread order after the parallel region so that the result
+// does not depend on thread scheduling. Slots are a cache line apart to avoid false sharing
+  const unsigned vpad=(OpenMP::getCachelineSize()+sizeof(Tensor)-1)/sizeof(Tensor);
+  const unsigned cpad=(OpenMP::getCachelineSize()+sizeof(double)-1)/sizeof(double);
+  std::vector<Tensor> threadVirial(nt*vpad);
+  std::vector<double> threadCoord(nt*cpad,0.0);
+
   #pragma omp parallel num_threads(nt)
   {
-    std::vector<Vector> omp_deriv(getPositions().size());
+    const unsigned t=OpenMP::getThreadNum();
+    Vector* omp_deriv=(nt>1 ? derivBuffer.getClearedBuffer(t) : deriv.data());
     Tensor omp_virial;
-
-    #pragma omp for reduction(+:ncoord) nowait
-    for(unsigned int i=rank; i<nn; i+=stride) {
-
-      Vector distance;
-      unsigned i0=nl->getClosePair(i).first;
-      unsigned i1=nl->getClosePair(i).second;
-
-      if(getAbsoluteIndex(i0)==getAbsoluteIndex(i1)) continue;
-
-      if(pbc) {
-        distance=pbcDistance(getPosition(i0),getPosition(i1));
-      } else {
-        distance=delta(getPosition(i0),getPosition(i1));
+    double omp_ncoord=0.0;
+
+    // pairs are processed in blocks, so that the pairing function is computed on many distances at once
+    constexpr unsigned block=64;
+    std::array<Vector,block> distance;
+    std::array<double,block> distance2,result,dfunc;
+    std::array<unsigned,block> atom0,atom1;
+    const unsigned npairs=(nn>rank ? (nn-rank+stride-1)/stride : 0); // pairs of this rank
+    #pragma omp for schedule(static) nowait
+    for(unsigned first=0; first<npairs; first+=block) {
+      unsigned np=0;
+      for(unsigned k=first; k<npairs && k<first+block; k++) {
+        const unsigned i=rank+k*stride;
+        unsigned i0=nl->getClosePair(i).first;
+        unsigned i1=nl->getClosePair(i).second;
+
+        if(getAbsoluteIndex(i0)==getAbsoluteIndex(i1)) continue;
+
+        if(pbc) {
+          distance[np]=pbcDistance(getPosition(i0),getPosition(i1));
+        } else {
+          distance[np]=delta(getPosition(i0),getPosition(i1));
+        }
+        distance2[np]=distance[np].modulo2();
+        atom0[np]=i0;
+        atom1[np]=i1;
+        np++;
       }
 
-      double dfunc=0.;
-      ncoord += pairing(distance.modulo2(), dfunc,i0,i1);
+      pairings(np,distance2.data(),atom0.data(),atom1.data(),result.data(),dfunc.data());
 
-      Vector dd(dfunc*distance);
-      Tensor vv(dd,distance);
-      if(nt>1) {
-        omp_deriv[i0]-=dd;
-        omp_deriv[i1]+=dd;
+      for(unsigned p=0; p<np; p++) {
+        omp_ncoord += result[p];
+
+        Vector dd(dfunc[p]*distance[p]);
+        Tensor vv(dd,distance[p]);
+        omp_deriv[atom0[p]]-=dd;
+        omp_deriv[atom1[p]]+=dd;
         omp_virial-=vv;
-      } else {
-        deriv[i0]-=dd;
-        deriv[i1]+=dd;
-        virial-=vv;
       }
-
-    }
-    #pragma omp critical
-    if(nt>1) {
-      for(unsigned i=0; i<getPositions().size(); i++) deriv[i]+=omp_deriv[i];
-      virial+=omp_virial;
     }
+    threadVirial[t*vpad]=omp_virial;
+    threadCoord[t*cpad]=omp_ncoord;
+// sum the contributions of the threads, each thread taking care of a block of atoms
+    if(nt>1) derivBuffer.reduce(deriv);
+  }
+  for(unsigned t=0; t<nt; t++) {
+    virial+=threadVirial[t*vpad];
+    ncoord+=threadCoord[t*cpad];
   }
 
   if(!serial) {
     comm.Sum(ncoord);
-    if(!deriv.empty()) comm.Sum(&deriv[0][0],3*deriv.size());
+    if(sparse) {
+      std::vector<Vector> packed(pairAtoms.size());
+      for(unsigned k=0; k<pairAtoms.size(); k++) packed[k]=deriv[pairAtoms[k]];
+      if(!packed.empty()) comm.Sum(&packed[0][0],3*packed.size());
+      for(unsigned k=0; k<pairAtoms.size(); k++) deriv[pairAtoms[k]]=packed[k];
+    } else if(!deriv.empty()) comm.Sum(&deriv[0][0],3*deriv.size());
     comm.Sum(virial);
   }
 
-  for(unsigned i=0; i<deriv.size(); ++i) setAtomsDerivatives(i,deriv[i]);
+  if(sparse) for(const auto & a : pairAtoms) setAtomsDerivatives(a,deriv[a]);
+  else for(unsigned i=0; i<deriv.size(); ++i) setAtomsDerivatives(i,deriv[i]);
   setValue           (ncoord);
   setBoxDerivatives  (virial);
 
@@ -22,6 +22,7 @@
 #ifndef __PLUMED_colvar_CoordinationBase_h
 #define __PLUMED_colvar_CoordinationBase_h
 #include "Colvar.h"
+#include "tools/ThreadBuffer.h"
 #include <memory>
 
 namespace PLMD {
@@ -36,6 +37,14 @@ class CoordinationBase : public Colvar {
   std::unique_ptr<NeighborList> nl;
   bool invalidateList;
   bool firsttime;
+/// Per-thread derivatives, kept between steps
+  ThreadBuffer<Vector> derivBuffer;
+/// Number of times the pairs have been searched (only with NL_SKIN)
+  unsigned rebuildCount;
+/// Atoms that appear in at least one pair (only with SPARSE_DERIVATIVES)
+  std::vector<unsigned> pairAtoms;
+/// Flags used to build pairAtoms, always false between calls
+  std::vector<bool> isPairAtom;
 
 public:
   explicit CoordinationBase(const ActionOptions&);
@@ -44,6 +53,9 @@ public:
   void calculate() override;
   void prepare() override;
   virtual double pairing(double distance,double&dfunc,unsigned i,unsigned j)const=0;
+/// Compute the pairing function for n pairs at once, with the same conventions as pairing().
+/// The default implementation calls pairing() for each pair
+  virtual void pairings(unsigned n,const double* distance,const unsigned* i,const unsigned* j,double* result,double* dfunc)const;
   static void registerKeywords( Keywords& keys );
 };
 
@@ -28,6 +28,9 @@
 #include "core/PlumedMain.h"
 #include "core/GenericMolInfo.h"
 #include "tools/OpenMP.h"
+#include "tools/ThreadBuffer.h"
+#include "tools/LinkCells.h"
+#include <algorithm>
 #include <initializer_list>
 
 #define INV_PI_SQRT_PI 0.179587122
@@ -88,6 +91,10 @@ private:
   std::vector<std::vector<unsigned> > nl;
   std::vector<std::vector<bool> > nlexpo;
   std::vector<std::vector<double> > parameter;
+/// Link cells used to build the neighbor list
+  LinkCells linkcells;
+/// Per-thread derivatives, kept between steps
+  ThreadBuffer<Vector> derivBuffer;
   void setupConstants(const std::vector<AtomNumber> &atoms, std::vector<std::vector<double> > &parameter, bool tcorr);
   std::map<std::string, std::map<std::string, std::string> > setupTypeMap();
   std::map<std::string, std::vector<double> > setupValueMap();
@@ -117,7 +124,8 @@ EEFSolv::EEFSolv(const ActionOptions&ao):
   delta_g_ref(0.),
   nl_buffer(0.1),
   nl_stride(40),
-  nl_update(0)
+  nl_update(0),
+  linkcells(comm)
 {
   std::vector<AtomNumber> atoms;
   parseAtomList("ATOMS", atoms);
@@ -150,29 +158,76 @@ EEFSolv::EEFSolv(const ActionOptions&ao):
 void EEFSolv::update_neighb() {
   const double lower_c2 = 0.24 * 0.24; // this is the cut-off for bonded atoms
   const unsigned size = getNumberOfAtoms();
+  if(size==0) return;
 
+  // The largest cutoff among all pairs is used for the link cells
+  double maxlambda = 0.;
+  for (unsigned i=0; i<size; i++) if (1./parameter[i][2] > maxlambda) maxlambda = 1./parameter[i][2];
+  const double maxcut = 2. * maxlambda + nl_buffer;
+
+  // Distances are computed without pbc (molecules are made whole), so link cells are
+  // built in a box around the atoms, which are shifted to its center
+  Pbc cellpbc;
+  const Vector shift = LinkCells::setEnclosingBox(getPositions(), maxcut, cellpbc);
+  const double cellsize = LinkCells::findCellSize(cellpbc, maxcut, size);
+  std::vector<Vector> cellpos(size);
+  std::vector<unsigned> indices(size);
   for (unsigned i=0; i<size; i++) {
-    nl[i].clear();
-    nlexpo[i].clear();
-    const Vector posi = getPosition(i);
-    // Loop through neighboring atoms, add the ones below cutoff
-    for (unsigned j=i+1; j<size; j++) {
-      if(parameter[i][1]==0&&parameter[j][1]==0) continue;
-      const double d2 = delta(posi, getPosition(j)).modulo2();
-      if (d2 < lower_c2 && j < i+14) {
-        // crude approximation for i-i+1/2 interactions,
-        // we want to exclude atoms separated by less than three bonds
-        continue;
-      }
-      // We choose the maximum lambda value and use a more conservative cutoff
-      double mlambda = 1./parameter[i][2];
-      if (1./parameter[j][2] > mlambda) mlambda = 1./parameter[j][2];
-      const double c2 = (2. * mlambda + nl_buffer) * (2. * mlambda + nl_buffer);
-      if (d2 < c2 ) {
-        nl[i].push_back(j);
-        if(parameter[i][2] == parameter[j][2] && parameter[i][3] == parameter[j][3]) {
-          nlexpo[i].push_back(true);
-        } else nlexpo[i].push_back(false);
+    cellpos[i] = getPosition(i) + shift;
+    indices[i] = i;
+  }
+  linkcells.setCutoff(cellsize);
+  linkcells.buildCellLists(cellpos, indices, cellpbc);
+
+  // Each process only needs the lists of the atoms it takes care of in calculate()
+  unsigned stride;
+  unsigned rank;
+  if(serial) {
+    stride=1;
+    rank=0;
+  } else {
+    stride=comm.Get_size();
+    rank=comm.Get_rank();
+  }
+
+  unsigned nt=OpenMP::getNumThreads();
+  if(nt*stride*10>size) nt=1;
+
+  #pragma omp parallel num_threads(nt)
+  {
+    std::vector<unsigned> cells_required(linkcells.getNumberOfCells());
+    std::vector<unsigned> neighbors(size+1);
+    #pragma omp for schedule(dynamic,16)
+    for (unsigned i=rank; i<size; i+=stride) {
+      nl[i].clear();
+      nlexpo[i].clear();
+      const Vector posi = getPosition(i);
+      unsigned natomsper = 1;
+      neighbors[0] = i;
+      linkcells.retrieveNeighboringAtoms(cellpos[i], cells_required, natomsper, neighbors);
+      // keep the list ordered as the atoms, so that sums are done always in the same order
+      std::sort(neighbors.begin()+1, neighbors.begin()+natomsper);
+      // Loop through neighboring atoms, add the ones below cutoff
+      for (unsigned k=1; k<natomsper; k++) {
+        const unsigned j = neighbors[k];
+        if (j<=i) continue;
+        if(parameter[i][1]==0&&parameter[j][1]==0) continue;
+        const double d2 = delta(posi, getPosition(j)).modulo2();
+        if (d2 < lower_c2 && j < i+14) {
+          // crude approximation for i-i+1/2 interactions,
+          // we want to exclude atoms separated by less than three bonds
+          continue;
+        }
+        // We choose the maximum lambda value and use a more conservative cutoff
+        double mlambda = 1./parameter[i][2];
+        if (1./parameter[j][2] > mlambda) mlambda = 1./parameter[j][2];
+        const double c2 = (2. * mlambda + nl_buffer) * (2. * mlambda + nl_buffer);
+        if (d2 < c2 ) {
+          nl[i].push_back(j);
+          if(parameter[i][2] == parameter[j][2] && parameter[i][3] == parameter[j][3]) {
+            nlexpo[i].push_back(true);
+          } else nlexpo[i].push_back(false);
+        }
       }
     }
   }
@@ -200,9 +255,11 @@ void EEFSolv::calculate() {
   unsigned nt=OpenMP::getNumThreads();
   if(nt*stride*10>size) nt=1;
 
+  if(nt>1) derivBuffer.resize(nt,size);
+
   #pragma omp parallel num_threads(nt)
   {
-    std::vector<Vector> deriv_omp(size, Vector(0,0,0));
+    Vector* deriv_omp=(nt>1 ? derivBuffer.getClearedBuffer(OpenMP::getThreadNum()) : deriv.data());
     #pragma omp for reduction(+:bias) nowait
     for (unsigned i=rank; i<size; i+=stride) {
       const Vector posi = getPosition(i);
@@ -240,8 +297,7 @@ void EEFSolv::calculate() {
             const Vector dd    = e_deriv*dist;
             fedensity    += fact;
             deriv_i      += dd;
-            if(nt>1) deriv_omp[j] -= dd;
-            else deriv[j] -= dd;
+            deriv_omp[j] -= dd;
           }
 
           // j-i interaction
@@ -254,8 +310,7 @@ void EEFSolv::calculate() {
             const Vector dd    = e_deriv*dist;
             fedensity    += fact;
             deriv_i      += dd;
-            if(nt>1) deriv_omp[j] -= dd;
-            else deriv[j] -= dd;
+            deriv_omp[j] -= dd;
           }
         } else {
           // i-j interaction
@@ -268,18 +323,16 @@ void EEFSolv::calculate() {
             const Vector dd    = e_deriv*dist;
             fedensity    += fact;
             deriv_i      += dd;
-            if(nt>1) deriv_omp[j] -= dd;
-            else deriv[j] -= dd;
+            deriv_omp[j] -= dd;
           }
         }
 
       }
-      if(nt>1) deriv_omp[i] += deriv_i;
-      else deriv[i] += deriv_i;
+      deriv_omp[i] += deriv_i;
       bias += 0.5*fedensity;
     }
-    #pragma omp critical
-    if(nt>1) for(unsigned i=0; i<size; i++) deriv[i]+=deriv_omp[i];
+// sum the contributions of the threads, each thread taking care of a block of atoms
+    if(nt>1) derivBuffer.reduce(deriv);
   }
 
   if(!serial) {
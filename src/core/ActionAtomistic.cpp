@@ -74,7 +74,7 @@ void ActionAtomistic::requestAtoms(const std::vector<AtomNumber> & a, const bool
     else unique.insert(indexes[i]);
   }
   updateUniqueLocal();
-  atoms.unique.clear();
+  atoms.uniqueIsOutdated=true;
 }
 
 Vector ActionAtomistic::pbcDistance(const Vector &v1,const Vector &v2)const {
@@ -39,6 +39,7 @@ class PlumedMain;
 
 Atoms::Atoms(PlumedMain&plumed):
   natoms(0),
+  uniqueIsOutdated(true),
   md_energy(0.0),
   energy(0.0),
   dataCanBeSet(false),
@@ -142,43 +143,74 @@ void Atoms::share() {
     return;
   }
 
-  if(!(int(gatindex.size())==natoms && shuffledAtoms==0)) {
-    for(unsigned i=0; i<actions.size(); i++) {
-      if(actions[i]->isActive()) {
-        if(!actions[i]->getUnique().empty()) {
-          atomsNeeded=true;
-          // unique are the local atoms
-          unique.insert(actions[i]->getUniqueLocal().begin(),actions[i]->getUniqueLocal().end());
-        }
+  bool changed=uniqueIsOutdated;
+  unsigned nactive=0;
+  for(unsigned i=0; i<actions.size(); i++) {
+    if(actions[i]->isActive()) {
+      if(!actions[i]->getUnique().empty()) {
+        atomsNeeded=true;
+        if(nactive>=uniqueActions.size() || uniqueActions[nactive]!=actions[i]) changed=true;
+        nactive++;
       }
     }
-  } else {
-    for(unsigned i=0; i<actions.size(); i++) {
-      if(actions[i]->isActive()) {
-        if(!actions[i]->getUnique().empty()) {
-          atomsNeeded=true;
+  }
+  if(nactive!=uniqueActions.size()) changed=true;
+
+// unique is only used when atoms are shuffled
+  if(changed && !(int(gatindex.size())==natoms && shuffledAtoms==0)) updateUnique();
+
+  share(unique);
+}
+
+void Atoms::updateUnique() {
+  for(const auto & p : unique) uniqueMask[p.index()]=false;
+  unique.clear();
+  uniqueActions.clear();
+  for(unsigned i=0; i<actions.size(); i++) {
+    if(actions[i]->isActive()) {
+      if(!actions[i]->getUnique().empty()) {
+        uniqueActions.push_back(actions[i]);
+        // unique are the local atoms
+        for(const auto & p : actions[i]->getUniqueLocal()) {
+          if(!uniqueMask[p.index()]) {
+            uniqueMask[p.index()]=true;
+            unique.push_back(p);
+          }
         }
       }
     }
-
   }
+  std::sort(unique.begin(),unique.end());
+  updateUniqIndex();
+  uniqueIsOutdated=false;
+}
 
-  share(unique);
+void Atoms::updateUniqIndex() {
+  uniq_index.clear();
+  if(shuffledAtoms>0) {
+    uniq_index.reserve(unique.size());
+    for(const auto & p : unique) uniq_index.push_back(g2l[p.index()]);
+  }
 }
 
 void Atoms::shareAll() {
+  for(const auto & p : unique) uniqueMask[p.index()]=false;
   unique.clear();
   // keep in unique only those atoms that are local
   if(dd && shuffledAtoms>0) {
-    for(int i=0; i<natoms; i++) if(g2l[i]>=0) unique.insert(AtomNumber::index(i));
+    for(int i=0; i<natoms; i++) if(g2l[i]>=0) unique.push_back(AtomNumber::index(i));
   } else {
-    for(int i=0; i<natoms; i++) unique.insert(AtomNumber::index(i));
+    for(int i=0; i<natoms; i++) unique.push_back(AtomNumber::index(i));
   }
+  for(const auto & p : unique) uniqueMask[p.index()]=true;
+  updateUniqIndex();
+// the list of atoms requested by actions should be recomputed at next step
+  uniqueIsOutdated=true;
   atomsNeeded=true;
   share(unique);
 }
 
-void Atoms::share(const std::set<AtomNumber>& unique) {
+void Atoms::share(const std::vector<AtomNumber>& unique) {
   plumed_assert( positionsHaveBeenSet==3 && massesHaveBeenSet );
 
   virial.zero();
@@ -198,11 +230,6 @@ void Atoms::share(const std::set<AtomNumber>& unique) {
 // faster version, which retrieves all atoms
     mdatoms->getPositions(0,natoms,positions);
   } else {
-    uniq_index.clear();
-    uniq_index.reserve(unique.size());
-    if(shuffledAtoms>0) {
-      for(const auto & p : unique) uniq_index.push_back(g2l[p.index()]);
-    }
     mdatoms->getPositions(unique,uniq_index,positions);
   }
 
@@ -220,51 +247,60 @@ void Atoms::share(const std::set<AtomNumber>& unique) {
   if(dd && shuffledAtoms>0) {
     if(dd.async) {
       for(unsigned i=0; i<dd.mpi_request_positions.size(); i++) dd.mpi_request_positions[i].wait();
-      for(unsigned i=0; i<dd.mpi_request_index.size(); i++)     dd.mpi_request_index[i].wait();
     }
+// each record contains the atom index followed by ndata doubles
+    const int nrecord=ndata+1;
     int count=0;
     for(const auto & p : unique) {
-      dd.indexToBeSent[count]=p.index();
-      dd.positionsToBeSent[ndata*count+0]=positions[p.index()][0];
-      dd.positionsToBeSent[ndata*count+1]=positions[p.index()][1];
-      dd.positionsToBeSent[ndata*count+2]=positions[p.index()][2];
+      double* rec=&dd.positionsToBeSent[nrecord*count];
+      rec[0]=p.index();
+      rec[1]=positions[p.index()][0];
+      rec[2]=positions[p.index()][1];
+      rec[3]=positions[p.index()][2];
       if(!massAndChargeOK) {
-        dd.positionsToBeSent[ndata*count+3]=masses[p.index()];
-        dd.positionsToBeSent[ndata*count+4]=charges[p.index()];
+        rec[4]=masses[p.index()];
+        rec[5]=charges[p.index()];
       }
       count++;
     }
     if(dd.async) {
       asyncSent=true;
+// receives are posted before sending so that data can be transferred
+// directly to its final location while the MD code keeps computing
+      if(dd.receiveOffsetIsOutdated) dd.updateReceiveOffset(gatindex.size());
+      dd.mpi_request_receive.resize(dd.Get_size());
+      for(int i=0; i<dd.Get_size(); i++) {
+        const int offset=dd.receiveOffset[i];
+        dd.mpi_request_receive[i]=dd.Irecv(&dd.positionsToBeReceived[DomainDecomposition::maxRecordSize*offset],nrecord*(dd.receiveOffset[i+1]-offset),i,667);
+      }
       dd.mpi_request_positions.resize(dd.Get_size());
-      dd.mpi_request_index.resize(dd.Get_size());
       for(int i=0; i<dd.Get_size(); i++) {
-        dd.mpi_request_index[i]=dd.Isend(&dd.indexToBeSent[0],count,i,666);
-        dd.mpi_request_positions[i]=dd.Isend(&dd.positionsToBeSent[0],ndata*count,i,667);
+        dd.mpi_request_positions[i]=dd.Isend(&dd.positionsToBeSent[0],nrecord*count,i,667);
       }
     } else {
       const int n=(dd.Get_size());
       std::vector<int> counts(n);
       std::vector<int> displ(n);
-      std::vector<int> counts5(n);
-      std::vector<int> displ5(n);
-      dd.Allgather(count,counts);
+      dd.Allgather(nrecord*count,counts);
       displ[0]=0;
       for(int i=1; i<n; ++i) displ[i]=displ[i-1]+counts[i-1];
-      for(int i=0; i<n; ++i) counts5[i]=counts[i]*ndata;
-      for(int i=0; i<n; ++i) displ5[i]=displ[i]*ndata;
-      dd.Allgatherv(&dd.indexToBeSent[0],count,&dd.indexToBeReceived[0],&counts[0],&displ[0]);
-      dd.Allgatherv(&dd.positionsToBeSent[0],ndata*count,&dd.positionsToBeReceived[0],&counts5[0],&displ5[0]);
-      int tot=displ[n-1]+counts[n-1];
-      for(int i=0; i<tot; i++) {
-        positions[dd.indexToBeReceived[i]][0]=dd.positionsToBeReceived[ndata*i+0];
-        positions[dd.indexToBeReceived[i]][1]=dd.positionsToBeReceived[ndata*i+1];
-        positions[dd.indexToBeReceived[i]][2]=dd.positionsToBeReceived[ndata*i+2];
-        if(!massAndChargeOK) {
-          masses[dd.indexToBeReceived[i]]      =dd.positionsToBeReceived[ndata*i+3];
-          charges[dd.indexToBeReceived[i]]     =dd.positionsToBeReceived[ndata*i+4];
-        }
-      }
+      dd.Allgatherv(&dd.positionsToBeSent[0],nrecord*count,&dd.positionsToBeReceived[0],&counts[0],&displ[0]);
+      unpackReceived(&dd.positionsToBeReceived[0],(displ[n-1]+counts[n-1])/nrecord,ndata);
+    }
+  }
+}
+
+void Atoms::unpackReceived(const double*buffer,unsigned nrecv,unsigned ndata) {
+  const unsigned nrecord=ndata+1;
+  for(unsigned i=0; i<nrecv; i++) {
+    const double* rec=buffer+nrecord*i;
+    const unsigned index=static_cast<unsigned>(rec[0]);
+    positions[index][0]=rec[1];
+    positions[index][1]=rec[2];
+    positions[index][2]=rec[3];
+    if(ndata>3) {
+      masses[index] =rec[4];
+      charges[index]=rec[5];
     }
   }
 }
@@ -285,22 +321,10 @@ void Atoms::wait() {
   if(dd && shuffledAtoms>0) {
 // receive toBeReceived
     if(asyncSent) {
+// data from each rank is unpacked as soon as it arrives
       Communicator::Status status;
-      std::size_t count=0;
-      for(int i=0; i<dd.Get_size(); i++) {
-        dd.Recv(&dd.indexToBeReceived[count],dd.indexToBeReceived.size()-count,i,666,status);
-        int c=status.Get_count<int>();
-        dd.Recv(&dd.positionsToBeReceived[ndata*count],dd.positionsToBeReceived.size()-ndata*count,i,667);
-        count+=c;
-      }
-      for(int i=0; i<count; i++) {
-        positions[dd.indexToBeReceived[i]][0]=dd.positionsToBeReceived[ndata*i+0];
-        positions[dd.indexToBeReceived[i]][1]=dd.positionsToBeReceived[ndata*i+1];
-        positions[dd.indexToBeReceived[i]][2]=dd.positionsToBeReceived[ndata*i+2];
-        if(!massAndChargeOK) {
-          masses[dd.indexToBeReceived[i]]      =dd.positionsToBeReceived[ndata*i+3];
-          charges[dd.indexToBeReceived[i]]     =dd.positionsToBeReceived[ndata*i+4];
-        }
+      for(int i=Communicator::Waitany(dd.mpi_request_receive,status); i>=0; i=Communicator::Waitany(dd.mpi_request_receive,status)) {
+        unpackReceived(&dd.positionsToBeReceived[DomainDecomposition::maxRecordSize*dd.receiveOffset[i]],status.Get_count<double>()/(ndata+1),ndata);
       }
       asyncSent=false;
     }
@@ -335,17 +359,22 @@ void Atoms::setNatoms(int n) {
   charges.resize(n);
   gatindex.resize(n);
   for(unsigned i=0; i<gatindex.size(); i++) gatindex[i]=i;
+  unique.clear();
+  uniqueMask.assign(n,false);
+  uniqueIsOutdated=true;
 }
 
 
 void Atoms::add(ActionAtomistic*a) {
   actions.push_back(a);
+  uniqueIsOutdated=true;
 }
 
 void Atoms::remove(ActionAtomistic*a) {
   auto f=find(actions.begin(),actions.end(),a);
   plumed_massert(f!=actions.end(),"cannot remove an action registered to atoms");
   actions.erase(f);
+  uniqueIsOutdated=true;
 }
 
 
@@ -361,19 +390,29 @@ void Atoms::DomainDecomposition::enable(Communicator& c) {
   }
 }
 
+void Atoms::DomainDecomposition::updateReceiveOffset(int nlocal) {
+  const int n=Get_size();
+  std::vector<int> counts(n);
+  Allgather(nlocal,counts);
+  receiveOffset.resize(n+1);
+  receiveOffset[0]=0;
+  for(int i=0; i<n; i++) receiveOffset[i+1]=receiveOffset[i]+counts[i];
+  if(positionsToBeReceived.size()<maxRecordSize*std::size_t(receiveOffset[n])) positionsToBeReceived.resize(maxRecordSize*receiveOffset[n],0.0);
+  receiveOffsetIsOutdated=false;
+}
+
 void Atoms::setAtomsNlocal(int n) {
   gatindex.resize(n);
   g2l.resize(natoms,-1);
   if(dd) {
+    dd.receiveOffsetIsOutdated=true;
 // Since these vectors are sent with MPI by using e.g.
 // &dd.positionsToBeSent[0]
 // we make sure they are non-zero-sized so as to
 // avoid errors when doing boundary check
     if(n==0) n++;
-    dd.positionsToBeSent.resize(n*5,0.0);
-    dd.positionsToBeReceived.resize(natoms*5,0.0);
-    dd.indexToBeSent.resize(n,0);
-    dd.indexToBeReceived.resize(natoms,0);
+    dd.positionsToBeSent.resize(n*DomainDecomposition::maxRecordSize,0.0);
+    dd.positionsToBeReceived.resize(natoms*DomainDecomposition::maxRecordSize,0.0);
   }
 }
 
@@ -403,7 +442,7 @@ void Atoms::setAtomsGatindex(int*g,bool fortran) {
     // keep in unique only those atoms that are local
     actions[i]->updateUniqueLocal();
   }
-  unique.clear();
+  uniqueIsOutdated=true;
 }
 
 void Atoms::setAtomsContiguous(int start) {
@@ -416,7 +455,7 @@ void Atoms::setAtomsContiguous(int start) {
     // keep in unique only those atoms that are local
     actions[i]->updateUniqueLocal();
   }
-  unique.clear();
+  uniqueIsOutdated=true;
 }
 
 void Atoms::setRealPrecision(int p) {
@@ -466,22 +505,23 @@ void Atoms::createFullList(int*n) {
     fullList.resize(natoms);
     for(unsigned i=0; i<natoms; i++) fullList[i]=i;
   } else {
-// We update here the unique list defined at Atoms::unique.
-// This is not very clear, and probably should be coded differently.
+// The list of atoms needed by the actions is computed here from scratch
+// and Atoms::unique is marked as outdated so that it will be rebuilt
+// consistently at the next share().
 // Hopefully this fix the longstanding issue with NAMD.
-    unique.clear();
+    std::set<AtomNumber> needed;
     for(unsigned i=0; i<actions.size(); i++) {
       if(actions[i]->isActive()) {
         if(!actions[i]->getUnique().empty()) {
           atomsNeeded=true;
-          // unique are the local atoms
-          unique.insert(actions[i]->getUnique().begin(),actions[i]->getUnique().end());
+          needed.insert(actions[i]->getUnique().begin(),actions[i]->getUnique().end());
         }
       }
     }
+    uniqueIsOutdated=true;
     fullList.resize(0);
-    fullList.reserve(unique.size());
-    for(const auto & p : unique) fullList.push_back(p.index());
+    fullList.reserve(needed.size());
+    for(const auto & p : needed) fullList.push_back(p.index());
     *n=fullList.size();
   }
 }
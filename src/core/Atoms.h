@@ -49,8 +49,18 @@ class Atoms
   friend class ActionAtomistic;
   friend class ActionWithVirtualAtom;
   int natoms;
-  std::set<AtomNumber> unique;
+/// Sorted list of the local atoms needed by the active actions.
+/// It is cached across steps and only rebuilt when the atoms are redistributed,
+/// when an action changes its requests, or when the set of active actions changes.
+  std::vector<AtomNumber> unique;
+/// Local indexes of the atoms in unique
   std::vector<unsigned> uniq_index;
+/// Membership bitmap, uniqueMask[i] is true if atom i is in unique
+  std::vector<bool> uniqueMask;
+/// Active actions that contributed to unique when it was last built
+  std::vector<const ActionAtomistic*> uniqueActions;
+/// If true, unique should be rebuilt at next share()
+  bool uniqueIsOutdated;
 /// Map global indexes to local indexes
 /// E.g. g2l[i] is the position of atom i in the array passed from the MD engine.
 /// Called "global to local" since originally it was used to map global indexes to local
@@ -123,23 +133,39 @@ class Atoms
     bool async;
 
     std::vector<Communicator::Request> mpi_request_positions;
-    std::vector<Communicator::Request> mpi_request_index;
-
+    std::vector<Communicator::Request> mpi_request_receive;
+/// In asynchronous mode, rank i sends its records to a reserved portion of
+/// positionsToBeReceived starting at record receiveOffset[i].
+/// This allows receives to be posted in advance, before data is sent.
+    std::vector<int> receiveOffset;
+    bool receiveOffsetIsOutdated;
+
+/// Packed send/receive buffers. Each atom occupies one record made of
+/// its global index (stored as a double) followed by the shared data,
+/// so that a single message per peer is enough to transfer everything.
     std::vector<double> positionsToBeSent;
     std::vector<double> positionsToBeReceived;
-    std::vector<int>    indexToBeSent;
-    std::vector<int>    indexToBeReceived;
+/// Maximum size of a record: the index, the position, the mass and the charge
+    static const unsigned maxRecordSize=6;
     operator bool() const {return on;}
     DomainDecomposition():
-      on(false), async(false)
+      on(false), async(false), receiveOffsetIsOutdated(true)
     {}
     void enable(Communicator& c);
+/// Recompute receiveOffset from the number of local atoms of each rank
+    void updateReceiveOffset(int nlocal);
   };
 
   DomainDecomposition dd;
   long int ddStep;  //last step in which dd happened
 
-  void share(const std::set<AtomNumber>&);
+  void share(const std::vector<AtomNumber>&);
+/// Rebuild unique and uniq_index from the atoms requested by the active actions
+  void updateUnique();
+/// Recompute uniq_index from unique
+  void updateUniqIndex();
+/// Copy nrecv packed records starting at buffer to the global arrays
+  void unpackReceived(const double*buffer,unsigned nrecv,unsigned ndata);
 
 public:
 
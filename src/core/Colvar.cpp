@@ -31,8 +31,11 @@ Colvar::Colvar(const ActionOptions&ao):
   ActionAtomistic(ao),
   ActionWithValue(ao),
   isEnergy(false),
-  isExtraCV(false)
+  isExtraCV(false),
+  sparseDerivatives(false)
 {
+  if( keywords.exists("SPARSE_DERIVATIVES") ) parseFlag("SPARSE_DERIVATIVES",sparseDerivatives);
+  if(sparseDerivatives) log.printf("  only non-zero derivatives are stored and used to apply forces\n");
 }
 
 void Colvar::registerKeywords( Keywords& keys ) {
@@ -40,6 +43,9 @@ void Colvar::registerKeywords( Keywords& keys ) {
   ActionWithValue::registerKeywords( keys );
   ActionAtomistic::registerKeywords( keys );
   keys.addFlag("NOPBC",false,"ignore the periodic boundary conditions when calculating distances");
+  keys.reserveFlag("SPARSE_DERIVATIVES",false,"only keep track of the derivatives that are different from zero. "
+                   "This makes clearing the derivatives and applying the forces cheaper when the collective variable depends "
+                   "on a small fraction of the requested atoms at each step");
 }
 
 void Colvar::requestAtoms(const std::vector<AtomNumber> & a) {
@@ -47,7 +53,10 @@ void Colvar::requestAtoms(const std::vector<AtomNumber> & a) {
 // Tell actionAtomistic what atoms we are getting
   ActionAtomistic::requestAtoms(a);
 // Resize the derivatives of all atoms
-  for(int i=0; i<getNumberOfComponents(); ++i) getPntrToComponent(i)->resizeDerivatives(3*a.size()+9);
+  for(int i=0; i<getNumberOfComponents(); ++i) {
+    getPntrToComponent(i)->setSparseDerivatives(sparseDerivatives);
+    getPntrToComponent(i)->resizeDerivatives(3*a.size()+9);
+  }
 }
 
 void Colvar::apply() {
@@ -68,34 +77,44 @@ void Colvar::apply() {
   if(nt>ncp/(4*stride)) nt=1;
 
   if(!isEnergy && !isExtraCV) {
-    #pragma omp parallel num_threads(nt)
-    {
-      std::vector<Vector> omp_f(fsz);
-      Tensor              omp_v;
-      std::vector<double> forces(3*nat+9);
-      #pragma omp for
-      for(unsigned i=rank; i<ncp; i+=stride) {
-        if(getPntrToComponent(i)->applyForce(forces)) {
-          for(unsigned j=0; j<nat; ++j) {
-            omp_f[j][0]+=forces[3*j+0];
-            omp_f[j][1]+=forces[3*j+1];
-            omp_f[j][2]+=forces[3*j+2];
+// components with sparse derivatives add their forces directly, looping only over the active derivatives
+    bool dense=false;
+    for(unsigned i=rank; i<ncp; i+=stride) {
+      if(getPntrToComponent(i)->hasSparseDerivatives()) getPntrToComponent(i)->applySparseForce(f,v);
+      else dense=true;
+    }
+
+    if(dense) {
+      #pragma omp parallel num_threads(nt)
+      {
+        std::vector<Vector> omp_f(fsz);
+        Tensor              omp_v;
+        std::vector<double> forces(3*nat+9);
+        #pragma omp for
+        for(unsigned i=rank; i<ncp; i+=stride) {
+          if(getPntrToComponent(i)->hasSparseDerivatives()) continue;
+          if(getPntrToComponent(i)->applyForce(forces)) {
+            for(unsigned j=0; j<nat; ++j) {
+              omp_f[j][0]+=forces[3*j+0];
+              omp_f[j][1]+=forces[3*j+1];
+              omp_f[j][2]+=forces[3*j+2];
+            }
+            omp_v(0,0)+=forces[3*nat+0];
+            omp_v(0,1)+=forces[3*nat+1];
+            omp_v(0,2)+=forces[3*nat+2];
+            omp_v(1,0)+=forces[3*nat+3];
+            omp_v(1,1)+=forces[3*nat+4];
+            omp_v(1,2)+=forces[3*nat+5];
+            omp_v(2,0)+=forces[3*nat+6];
+            omp_v(2,1)+=forces[3*nat+7];
+            omp_v(2,2)+=forces[3*nat+8];
           }
-          omp_v(0,0)+=forces[3*nat+0];
-          omp_v(0,1)+=forces[3*nat+1];
-          omp_v(0,2)+=forces[3*nat+2];
-          omp_v(1,0)+=forces[3*nat+3];
-          omp_v(1,1)+=forces[3*nat+4];
-          omp_v(1,2)+=forces[3*nat+5];
-          omp_v(2,0)+=forces[3*nat+6];
-          omp_v(2,1)+=forces[3*nat+7];
-          omp_v(2,2)+=forces[3*nat+8];
         }
-      }
-      #pragma omp critical
-      {
-        for(unsigned j=0; j<nat; ++j) f[j]+=omp_f[j];
-        v+=omp_v;
+        #pragma omp critical
+        {
+          for(unsigned j=0; j<nat; ++j) f[j]+=omp_f[j];
+          v+=omp_v;
+        }
       }
     }
 
@@ -44,6 +44,8 @@ private:
 protected:
   bool isEnergy;
   bool isExtraCV;
+/// Only keep track of non-zero derivatives (see Value::setSparseDerivatives)
+  bool sparseDerivatives;
   void requestAtoms(const std::vector<AtomNumber> & a);
 // Set the derivatives for a particular atom equal to the input Vector
 // This routine is called setAtomsDerivatives because not because you
@@ -73,6 +75,8 @@ public:
 
 inline
 void Colvar::setAtomsDerivatives(Value*v,int i,const Vector&d) {
+// with sparse derivatives, there is no need to register atoms that do not contribute
+  if(v->hasSparseDerivatives() && d[0]==0.0 && d[1]==0.0 && d[2]==0.0) return;
   v->addDerivative(3*i+0,d[0]);
   v->addDerivative(3*i+1,d[1]);
   v->addDerivative(3*i+2,d[2]);
@@ -90,14 +90,14 @@ public:
   }
   void getBox(Tensor &) const override;
   void getPositions(const std::vector<int>&index,std::vector<Vector>&positions) const override;
-  void getPositions(const std::set<AtomNumber>&index,const std::vector<unsigned>&i,std::vector<Vector>&positions) const override;
+  void getPositions(const std::vector<AtomNumber>&index,const std::vector<unsigned>&i,std::vector<Vector>&positions) const override;
   void getPositions(unsigned j,unsigned k,std::vector<Vector>&positions) const override;
   void getLocalPositions(std::vector<Vector>&p) const override;
   void getMasses(const std::vector<int>&index,std::vector<double>&) const override;
   void getCharges(const std::vector<int>&index,std::vector<double>&) const override;
   void updateVirial(const Tensor&) const override;
   void updateForces(const std::vector<int>&index,const std::vector<Vector>&) override;
-  void updateForces(const std::set<AtomNumber>&index,const std::vector<unsigned>&i,const std::vector<Vector>&forces) override;
+  void updateForces(const std::vector<AtomNumber>&index,const std::vector<unsigned>&i,const std::vector<Vector>&forces) override;
   void rescaleForces(const std::vector<int>&index,double factor) override;
   unsigned  getRealPrecision()const override;
 };
@@ -135,14 +135,13 @@ void MDAtomsTyped<T>::getPositions(const std::vector<int>&index,std::vector<Vect
 }
 
 template <class T>
-void MDAtomsTyped<T>::getPositions(const std::set<AtomNumber>&index,const std::vector<unsigned>&i, std::vector<Vector>&positions)const {
+void MDAtomsTyped<T>::getPositions(const std::vector<AtomNumber>&index,const std::vector<unsigned>&i, std::vector<Vector>&positions)const {
 // cannot be parallelized with omp because access to positions is not ordered
-  unsigned k=0;
-  for(const auto & p : index) {
-    positions[p.index()][0]=px[stride*i[k]]*scalep;
-    positions[p.index()][1]=py[stride*i[k]]*scalep;
-    positions[p.index()][2]=pz[stride*i[k]]*scalep;
-    k++;
+  for(unsigned k=0; k<index.size(); ++k) {
+    const unsigned p=index[k].index();
+    positions[p][0]=px[stride*i[k]]*scalep;
+    positions[p][1]=py[stride*i[k]]*scalep;
+    positions[p][2]=pz[stride*i[k]]*scalep;
   }
 }
 
@@ -186,13 +185,13 @@ void MDAtomsTyped<T>::updateVirial(const Tensor&virial)const {
 }
 
 template <class T>
-void MDAtomsTyped<T>::updateForces(const std::set<AtomNumber>&index,const std::vector<unsigned>&i,const std::vector<Vector>&forces) {
-  unsigned k=0;
-  for(const auto & p : index) {
-    fx[stride*i[k]]+=scalef*T(forces[p.index()][0]);
-    fy[stride*i[k]]+=scalef*T(forces[p.index()][1]);
-    fz[stride*i[k]]+=scalef*T(forces[p.index()][2]);
-    k++;
+void MDAtomsTyped<T>::updateForces(const std::vector<AtomNumber>&index,const std::vector<unsigned>&i,const std::vector<Vector>&forces) {
+  #pragma omp parallel for num_threads(OpenMP::getGoodNumThreads(fx,stride*index.size()))
+  for(unsigned k=0; k<index.size(); ++k) {
+    const unsigned p=index[k].index();
+    fx[stride*i[k]]+=scalef*T(forces[p][0]);
+    fy[stride*i[k]]+=scalef*T(forces[p][1]);
+    fz[stride*i[k]]+=scalef*T(forces[p][2]);
   }
 }
 
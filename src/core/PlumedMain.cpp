@@ -42,6 +42,7 @@
 #include "tools/Stopwatch.h"
 #include "lepton/Exception.h"
 #include "DataFetchingObject.h"
+#include <algorithm>
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
@@ -138,7 +139,8 @@ PlumedMain::PlumedMain():
   stopFlag(NULL),
   stopNow(false),
   novirial(false),
-  detailedTimers(false)
+  detailedTimers(false),
+  concurrentActions(false)
 {
   log.link(comm);
   log.setLinePrefix("PLUMED: ");
@@ -804,6 +806,15 @@ void PlumedMain::justCalculate() {
   bias=0.0;
   work=0.0;
 
+// actions are only run concurrently when this is safe and useful.
+// detailed timers are not thread safe and actions might perform
+// MPI communications in their calculate() method, either within
+// a replica or across replicas (e.g. ENSEMBLE)
+  if(concurrentActions && !detailedTimers && comm.Get_size()==1 && multi_sim_comm.Get_size()==1 && OpenMP::getNumThreads()>1) {
+    justCalculateConcurrently();
+    return;
+  }
+
   int iaction=0;
 // calculate the active actions in order (assuming *backward* dependence)
   for(const auto & pp : actionSet) {
@@ -821,29 +832,96 @@ void PlumedMain::justCalculate() {
         for(int i=0; i<pad; i++) actionNumberLabel=" "+actionNumberLabel;
         sw=stopwatch.startStop("4A "+actionNumberLabel+" "+p->getLabel());
       }
+      calculateAction(p);
       ActionWithValue*av=dynamic_cast<ActionWithValue*>(p);
-      ActionAtomistic*aa=dynamic_cast<ActionAtomistic*>(p);
-      {
-        if(av) av->clearInputForces();
-        if(av) av->clearDerivatives();
-      }
-      {
-        if(aa) aa->clearOutputForces();
-        if(aa) if(aa->isActive()) aa->retrieveAtoms();
-      }
-      if(p->checkNumericalDerivatives()) p->calculateNumericalDerivatives();
-      else p->calculate();
       // This retrieves components called bias
       if(av) bias+=av->getOutputQuantity("bias");
       if(av) work+=av->getOutputQuantity("work");
-      if(av)av->setGradientsIfNeeded();
-      ActionWithVirtualAtom*avv=dynamic_cast<ActionWithVirtualAtom*>(p);
-      if(avv)avv->setGradientsIfNeeded();
     }
     iaction++;
   }
 }
 
+void PlumedMain::calculateAction(Action*p) {
+  ActionWithValue*av=dynamic_cast<ActionWithValue*>(p);
+  ActionAtomistic*aa=dynamic_cast<ActionAtomistic*>(p);
+  {
+    if(av) av->clearInputForces();
+    if(av) av->clearDerivatives();
+  }
+  {
+    if(aa) aa->clearOutputForces();
+    if(aa) if(aa->isActive()) aa->retrieveAtoms();
+  }
+  if(p->checkNumericalDerivatives()) p->calculateNumericalDerivatives();
+  else p->calculate();
+  if(av)av->setGradientsIfNeeded();
+  ActionWithVirtualAtom*avv=dynamic_cast<ActionWithVirtualAtom*>(p);
+  if(avv)avv->setGradientsIfNeeded();
+}
+
+void PlumedMain::justCalculateConcurrently() {
+// Active actions are sorted in levels, such that each action only depends
+// on actions belonging to previous levels. Actions in the same level
+// are then calculated concurrently.
+// Actions that do not have values (e.g. WHOLEMOLECULES) or that can
+// modify the global arrays of positions and forces (e.g. FIT_TO_TEMPLATE)
+// act as barriers: they are alone in their level and all the following
+// actions are placed in subsequent levels.
+// Levels are only recomputed when the set of active actions changes
+  std::vector<Action*> active;
+  for(const auto & pp : actionSet) if(pp->isActive()) active.push_back(pp.get());
+  if(active!=concurrentLevelsActive) {
+    std::unordered_map<const Action*,unsigned> levelOf;
+    std::vector<std::vector<Action*>> levels;
+    unsigned minLevel=0;
+    for(const auto & p : active) {
+      const bool barrier=!dynamic_cast<ActionWithValue*>(p) ||
+                         (dynamic_cast<ActionPilot*>(p) && dynamic_cast<ActionAtomistic*>(p));
+      unsigned l=minLevel;
+      if(barrier) l=levels.size();
+      for(const auto & d : p->getDependencies()) {
+        auto f=levelOf.find(d);
+        if(f!=levelOf.end()) l=std::max(l,f->second+1);
+      }
+      if(barrier) minLevel=l+1;
+      levelOf[p]=l;
+      if(levels.size()<=l) levels.resize(l+1);
+      levels[l].push_back(p);
+    }
+    concurrentLevels=std::move(levels);
+    concurrentLevelsActive=std::move(active);
+  }
+
+  for(const auto & l : concurrentLevels) {
+    if(l.size()==1) {
+// a single action can use all the threads internally
+      calculateAction(l[0]);
+      continue;
+    }
+    std::vector<std::exception_ptr> except(l.size());
+    #pragma omp parallel for schedule(dynamic,1) num_threads(std::min<unsigned>(OpenMP::getNumThreads(),l.size()))
+    for(unsigned i=0; i<l.size(); i++) {
+      try {
+        calculateAction(l[i]);
+      } catch(...) {
+        except[i]=std::current_exception();
+      }
+    }
+    for(const auto & e : except) if(e) std::rethrow_exception(e);
+  }
+
+// bias and work are accumulated in the same order used in the sequential loop,
+// so that results are bitwise identical
+  for(const auto & pp : actionSet) {
+    ActionWithValue*av=dynamic_cast<ActionWithValue*>(pp.get());
+    if(av && av->isActive()) {
+      bias+=av->getOutputQuantity("bias");
+      work+=av->getOutputQuantity("work");
+    }
+  }
+}
+
 void PlumedMain::justApply() {
   backwardPropagate();
   update();
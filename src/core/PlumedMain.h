@@ -52,6 +52,7 @@ namespace PLMD {
 
 
 
+class Action;
 class ActionAtomistic;
 class ActionPilot;
 class Log;
@@ -199,6 +200,18 @@ private:
 /// Store information used in class \ref generic::UpdateIf
   std::stack<bool> updateFlags;
 
+/// Calculate a single action in the forward loop
+  void calculateAction(Action*);
+
+/// Forward loop where independent actions are calculated concurrently
+  void justCalculateConcurrently();
+
+/// Levels of actions that can be calculated concurrently, see justCalculateConcurrently()
+  std::vector<std::vector<Action*>> concurrentLevels;
+
+/// Active actions for which concurrentLevels were computed
+  std::vector<Action*> concurrentLevelsActive;
+
 public:
 /// Flag to switch off virial calculation (for debug and MD codes with no barostat)
   bool novirial;
@@ -206,6 +219,9 @@ public:
 /// Flag to switch on detailed timers
   bool detailedTimers;
 
+/// Flag to switch on concurrent calculation of independent actions
+  bool concurrentActions;
+
 /// Generic map string -> double
 /// intended to pass information across Actions
   std::map<std::string,double> passMap;
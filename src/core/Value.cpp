@@ -37,6 +37,7 @@ Value::Value():
   inputForce(0.0),
   hasForce(false),
   hasDeriv(true),
+  sparseDerivatives(false),
   periodicity(unset),
   min(0.0),
   max(0.0),
@@ -51,8 +52,9 @@ Value::Value(const std::string& name):
   value(0.0),
   inputForce(0.0),
   hasForce(false),
-  hasDeriv(true),
   name(name),
+  hasDeriv(true),
+  sparseDerivatives(false),
   periodicity(unset),
   min(0.0),
   max(0.0),
@@ -69,6 +71,7 @@ Value::Value(ActionWithValue* av, const std::string& name, const bool withderiv)
   hasForce(false),
   name(name),
   hasDeriv(withderiv),
+  sparseDerivatives(false),
   periodicity(unset),
   min(0.0),
   max(0.0),
@@ -97,10 +100,44 @@ bool Value::applyForce(std::vector<double>& forces ) const {
   if( !hasForce ) return false;
   plumed_dbg_massert( derivatives.size()==forces.size()," forces array has wrong size" );
   const unsigned N=derivatives.size();
-  for(unsigned i=0; i<N; ++i) forces[i]=inputForce*derivatives[i];
+  if(sparseDerivatives) {
+    std::fill(forces.begin(),forces.end(),0.0);
+    for(const auto & i : activeDerivatives) forces[i]=inputForce*derivatives[i];
+  } else {
+    for(unsigned i=0; i<N; ++i) forces[i]=inputForce*derivatives[i];
+  }
+  return true;
+}
+
+bool Value::applySparseForce(std::vector<Vector>& forces, Tensor& virial) const {
+  plumed_dbg_massert( sparseDerivatives, "this method can only be used with sparse derivatives" );
+  if( !hasForce ) return false;
+  plumed_dbg_massert( derivatives.size()==3*forces.size()+9," forces array has wrong size" );
+  const unsigned natoms3=3*forces.size();
+  for(const auto & i : activeDerivatives) {
+    const double f=inputForce*derivatives[i];
+    if(i<natoms3) forces[i/3][i%3]+=f;
+    else {
+      const unsigned j=i-natoms3;
+      virial(j/3,j%3)+=f;
+    }
+  }
   return true;
 }
 
+void Value::setSparseDerivatives(bool s) {
+  if(s==sparseDerivatives) return;
+  sparseDerivatives=s;
+  activeDerivatives.clear();
+  if(sparseDerivatives) {
+// all derivatives are initially considered as active, since they might be non zero
+    isActiveDerivative.assign(derivatives.size(),true);
+    for(unsigned i=0; i<derivatives.size(); ++i) activeDerivatives.push_back(i);
+  } else {
+    isActiveDerivative.clear();
+  }
+}
+
 void Value::setNotPeriodic() {
   min=0; max=0; periodicity=notperiodic;
 }
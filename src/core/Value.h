@@ -25,10 +25,12 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <algorithm>
 #include "tools/Exception.h"
 #include "tools/Tools.h"
 #include "tools/AtomNumber.h"
 #include "tools/Vector.h"
+#include "tools/Tensor.h"
 
 namespace PLMD {
 
@@ -73,6 +75,15 @@ private:
   std::string name;
 /// Does this quanity have derivatives
   bool hasDeriv;
+/// If true, the indexes of the derivatives that might be non zero are stored in activeDerivatives,
+/// so that only those need to be cleared and used when forces are applied
+  bool sparseDerivatives;
+/// The indexes of the derivatives that have been set since last call to clearDerivatives (only with sparse derivatives)
+  std::vector<unsigned> activeDerivatives;
+/// Flags telling which derivatives are in activeDerivatives (only with sparse derivatives)
+  std::vector<bool> isActiveDerivative;
+/// Register derivative i in activeDerivatives
+  void activateDerivative(unsigned i);
 /// Is this quantity periodic
   enum {unset,periodic,notperiodic} periodicity;
 /// Various quantities that describe the domain of this value
@@ -119,6 +130,12 @@ public:
   void resizeDerivatives(int n);
 /// Set all the derivatives to zero
   void clearDerivatives();
+/// Switch on or off the sparse storage of derivatives
+  void setSparseDerivatives(bool s);
+/// Check whether or not only the non-zero derivatives are tracked
+  bool hasSparseDerivatives() const;
+/// Get the indexes of the derivatives that might be non zero (only with sparse derivatives)
+  const std::vector<unsigned> & getActiveDerivatives() const;
 /// Add some derivative to the ith component of the derivatives array
   void addDerivative(unsigned i,double d);
 /// Set the value of the ith component of the derivatives array
@@ -135,6 +152,11 @@ public:
   double getForce() const ;
 /// Apply the forces to the derivatives using the chain rule (if there are no forces this routine returns false)
   bool applyForce( std::vector<double>& forces ) const ;
+/// Add the forces acting on the active derivatives of a value with sparse derivatives
+/// to atoms and virial. Derivatives are assumed to be stored as in a Colvar, i.e. three
+/// per atom followed by the nine derivatives with respect to the box
+/// (if there are no forces this routine returns false)
+  bool applySparseForce( std::vector<Vector>& forces, Tensor& virial ) const ;
 /// Calculate the difference between the instantaneous value of the function and some other point: other_point-inst_val
   double difference(double)const;
 /// Calculate the difference between two values of this function: d2 -d1
@@ -239,23 +261,45 @@ bool Value::hasDerivatives() const {
 inline
 void Value::resizeDerivatives(int n) {
   if(hasDeriv) derivatives.resize(n);
+  if(sparseDerivatives) {
+// entries that are not active are zero, so that the active set is still valid
+// after dropping the indexes that are out of the new range
+    const unsigned nd=derivatives.size();
+    isActiveDerivative.resize(nd,false);
+    activeDerivatives.erase(std::remove_if(activeDerivatives.begin(),activeDerivatives.end(),
+    [nd](unsigned i) {return i>=nd;}),activeDerivatives.end());
+  }
+}
+
+inline
+void Value::activateDerivative(unsigned i) {
+  if(!isActiveDerivative[i]) {
+    isActiveDerivative[i]=true;
+    activeDerivatives.push_back(i);
+  }
 }
 
 inline
 void Value::addDerivative(unsigned i,double d) {
   plumed_dbg_massert(i<derivatives.size(),"derivative is out of bounds");
+  if(sparseDerivatives) activateDerivative(i);
   derivatives[i]+=d;
 }
 
 inline
 void Value::setDerivative(unsigned i, double d) {
   plumed_dbg_massert(i<derivatives.size(),"derivative is out of bounds");
+  if(sparseDerivatives) activateDerivative(i);
   derivatives[i]=d;
 }
 
 inline
 void Value::chainRule(double df) {
-  for(unsigned i=0; i<derivatives.size(); ++i) derivatives[i]*=df;
+  if(sparseDerivatives) {
+    for(const auto & i : activeDerivatives) derivatives[i]*=df;
+  } else {
+    for(unsigned i=0; i<derivatives.size(); ++i) derivatives[i]*=df;
+  }
 }
 
 inline
@@ -267,7 +311,26 @@ void Value::clearInputForce() {
 inline
 void Value::clearDerivatives() {
   value_set=false;
-  std::fill(derivatives.begin(), derivatives.end(), 0);
+  if(sparseDerivatives) {
+    for(const auto & i : activeDerivatives) {
+      derivatives[i]=0;
+      isActiveDerivative[i]=false;
+    }
+    activeDerivatives.clear();
+  } else {
+    std::fill(derivatives.begin(), derivatives.end(), 0);
+  }
+}
+
+inline
+bool Value::hasSparseDerivatives() const {
+  return sparseDerivatives;
+}
+
+inline
+const std::vector<unsigned> & Value::getActiveDerivatives() const {
+  plumed_dbg_massert(sparseDerivatives,"active derivatives are only stored for values with sparse derivatives");
+  return activeDerivatives;
 }
 
 inline
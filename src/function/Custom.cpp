@@ -162,14 +162,15 @@ progression (S) and distance (Z) variables \cite perez2015atp.
 class Custom :
   public Function
 {
+/// Function and derivatives, computed by a single program so that common subexpressions are only computed once
   lepton::CompiledExpression expression;
-  std::vector<lepton::CompiledExpression> expression_deriv;
   std::vector<std::string> var;
   std::string func;
   std::vector<double> values;
   std::vector<char*> names;
   std::vector<double*> lepton_ref;
-  std::vector<double*> lepton_ref_deriv;
+/// Value of the function followed by the derivatives
+  std::vector<double> results;
 public:
   explicit Custom(const ActionOptions&);
   void calculate() override;
@@ -218,11 +219,10 @@ void Custom::registerKeywords(Keywords& keys) {
 Custom::Custom(const ActionOptions&ao):
   Action(ao),
   Function(ao),
-  expression_deriv(getNumberOfArguments()),
   values(getNumberOfArguments()),
   names(getNumberOfArguments()),
   lepton_ref(getNumberOfArguments(),nullptr),
-  lepton_ref_deriv(getNumberOfArguments()*getNumberOfArguments(),nullptr)
+  results(1+getNumberOfArguments())
 {
   parseVector("VAR",var);
   if(var.size()==0) {
@@ -244,20 +244,19 @@ Custom::Custom(const ActionOptions&ao):
   for(unsigned i=0; i<var.size(); i++) log.printf(" %s",var[i].c_str());
   log.printf("\n");
 
-  lepton::ParsedExpression pe=lepton::Parser::parse(func).optimize(lepton::Constants());
-  log<<"  function as parsed by lepton: "<<pe<<"\n";
-  expression=pe.createCompiledExpression();
+  std::vector<lepton::ParsedExpression> pe(1,lepton::Parser::parse(func).optimize(lepton::Constants()));
+  log<<"  function as parsed by lepton: "<<pe[0]<<"\n";
+  log<<"  derivatives as computed by lepton:\n";
+  for(unsigned i=0; i<getNumberOfArguments(); i++) {
+    pe.push_back(lepton::Parser::parse(func).differentiate(var[i]).optimize(lepton::Constants()));
+    log<<"    "<<pe.back()<<"\n";
+  }
+  expression=lepton::CompiledExpression(pe);
   for(auto &p: expression.getVariables()) {
     if(std::find(var.begin(),var.end(),p)==var.end()) {
       error("variable " + p + " is not defined");
     }
   }
-  log<<"  derivatives as computed by lepton:\n";
-  for(unsigned i=0; i<getNumberOfArguments(); i++) {
-    lepton::ParsedExpression pe=lepton::Parser::parse(func).differentiate(var[i]).optimize(lepton::Constants());
-    log<<"    "<<pe<<"\n";
-    expression_deriv[i]=pe.createCompiledExpression();
-  }
 
   for(unsigned i=0; i<getNumberOfArguments(); i++) {
     try {
@@ -267,29 +266,15 @@ Custom::Custom(const ActionOptions&ao):
 // e.g. func=0*x
     }
   }
-  for(unsigned i=0; i<getNumberOfArguments(); i++) {
-    for(unsigned j=0; j<getNumberOfArguments(); j++) {
-      try {
-        lepton_ref_deriv[i*getNumberOfArguments()+j]=&expression_deriv[i].getVariableReference(var[j]);
-      } catch(const PLMD::lepton::Exception& exc) {
-// this is necessary since in some cases lepton things a variable is not present even though it is present
-// e.g. func=0*x
-      }
-    }
-  }
 }
 
 void Custom::calculate() {
   for(unsigned i=0; i<getNumberOfArguments(); i++) {
     if(lepton_ref[i]) *lepton_ref[i]=getArgument(i);
   }
-  setValue(expression.evaluate());
-  for(unsigned i=0; i<getNumberOfArguments(); i++) {
-    for(unsigned j=0; j<getNumberOfArguments(); j++) {
-      if(lepton_ref_deriv[i*getNumberOfArguments()+j]) *lepton_ref_deriv[i*getNumberOfArguments()+j]=getArgument(j);
-    }
-    setDerivative(i,expression_deriv[i].evaluate());
-  }
+  expression.evaluate(results.data());
+  setValue(results[0]);
+  for(unsigned i=0; i<getNumberOfArguments(); i++) setDerivative(i,results[1+i]);
 }
 
 }
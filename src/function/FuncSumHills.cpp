@@ -24,6 +24,7 @@
 #include "tools/Exception.h"
 #include "tools/Communicator.h"
 #include "tools/BiasRepresentation.h"
+#include "tools/BinaryHills.h"
 #include "tools/KernelFunctions.h"
 #include "tools/File.h"
 #include "tools/Tools.h"
@@ -56,14 +57,23 @@ class FilesHandler {
   bool parallelread;
   unsigned beingread;
   bool isopen;
+/// the file being read, when it is in binary format
+  std::unique_ptr<BinaryHills> binfile;
+/// next record to be read from binfile
+  std::size_t binpos;
+/// number of hills that are read before being pushed together on the representation
+  unsigned chunksize;
+  void openFile(unsigned i, BiasRepresentation *br);
+  void closeFile();
+  bool scanOneBinaryHill(std::unique_ptr<KernelFunctions> & kk, double & kbiasf);
 public:
   FilesHandler(const std::vector<std::string> &filenames, const bool &parallelread,  Action &myaction, Log &mylog);
   bool readBunch(BiasRepresentation *br, int stride);
-  bool scanOneHill(BiasRepresentation *br, IFile *ifile );
+  bool scanOneHill(BiasRepresentation *br, IFile *ifile, std::unique_ptr<KernelFunctions> & kk, double & kbiasf );
   void getMinMaxBin(std::vector<Value*> vals, Communicator &cc, std::vector<double> &vmin, std::vector<double> &vmax, std::vector<unsigned> &vbin);
   void getMinMaxBin(std::vector<Value*> vals, Communicator &cc, std::vector<double> &vmin, std::vector<double> &vmax, std::vector<unsigned> &vbin, std::vector<double> &histosigma);
 };
-FilesHandler::FilesHandler(const std::vector<std::string> &filenames, const bool &parallelread, Action &action, Log &mylog ):filenames(filenames),log(&mylog),parallelread(parallelread),beingread(0),isopen(false) {
+FilesHandler::FilesHandler(const std::vector<std::string> &filenames, const bool &parallelread, Action &action, Log &mylog ):filenames(filenames),log(&mylog),parallelread(parallelread),beingread(0),isopen(false),binpos(0),chunksize(10000) {
   this->action=&action;
   for(unsigned i=0; i<filenames.size(); i++) {
     auto ifile=Tools::make_unique<IFile>();
@@ -89,28 +99,41 @@ bool FilesHandler::readBunch(BiasRepresentation *br, int stride = -1) {
     ff=ifiles[beingread].get();
     if(!isopen) {
       (*log)<<"  opening file "<<filenames[beingread]<<"\n";
-      ff->open(filenames[beingread]); isopen=true;
+      openFile(beingread,br); isopen=true;
     }
-    int n;
+    // hills are read in chunks, that are then deposited together
+    std::vector<std::unique_ptr<KernelFunctions>> kernels;
+    std::vector<double> kbiasf;
+    std::unique_ptr<KernelFunctions> kk;
+    double bf;
+    int n=br->getNumberOfKernels();
     while(true) {
       bool fileisover=true;
-      while(scanOneHill(br,ff)) {
+      while(scanOneHill(br,ff,kk,bf)) {
+        kernels.emplace_back(std::move(kk));
+        kbiasf.push_back(bf);
+        n++;
+        if(kernels.size()>=chunksize) {
+          br->pushKernels(kernels,kbiasf);
+          kbiasf.clear();
+        }
         // here do the dump if needed
-        n=br->getNumberOfKernels();
         if(stride>0 && n%stride==0 && n!=0  ) {
           (*log)<<"  done with this chunk: now with "<<n<<" kernels  \n";
           fileisover=false;
           break;
         }
       }
+      br->pushKernels(kernels,kbiasf);
+      kbiasf.clear();
       if(fileisover) {
         (*log)<<"  closing file "<<filenames[beingread]<<"\n";
-        ff->close();
+        closeFile();
         isopen=false;
         (*log)<<"  now total "<<br->getNumberOfKernels()<<" kernels \n";
         beingread++;
         if(beingread<ifiles.size()) {
-          ff=ifiles[beingread].get(); ff->open(filenames[beingread]);
+          ff=ifiles[beingread].get(); openFile(beingread,br);
           (*log)<<"  opening file "<<filenames[beingread]<<"\n";
           isopen=true;
         } else {
@@ -144,14 +167,52 @@ void FilesHandler::getMinMaxBin(std::vector<Value*> vals, Communicator &cc, std:
   br.getMinMaxBin(vmin,vmax,vbin);
   //for(unsigned i=0;i<vals.size();i++){cerr<<"XXX "<<vmin[i]<<" "<<vmax[i]<<" "<<vbin[i]<<"\n";}
 }
-bool FilesHandler::scanOneHill(BiasRepresentation *br, IFile *ifile ) {
+void FilesHandler::openFile(unsigned i, BiasRepresentation *br) {
+  if(!BinaryHills::isBinary(ifiles[i]->getPath())) {
+    ifiles[i]->open(filenames[i]);
+    return;
+  }
+  // binary files are loaded at once, and only their header is checked here
+  binfile=Tools::make_unique<BinaryHills>(ifiles[i]->getPath());
+  binpos=0;
+  plumed_massert(!br->hasSigmaInInput(),"binary hills files cannot be used to build histograms");
+  const BinaryHills::Header& header=binfile->getHeader();
+  plumed_massert(header.getNumberOfArguments()==br->getNumberOfDimensions(),"the number of variables in "+filenames[i]+" does not match");
+  for(unsigned j=0; j<br->getNumberOfDimensions(); j++) {
+    plumed_massert(header.names[j]==br->getName(j),"variable "+header.names[j]+" in "+filenames[i]+" does not match "+br->getName(j));
+    std::string mini,maxi;
+    if(br->getPtrToValue(j)->isPeriodic()) br->getPtrToValue(j)->getDomain(mini,maxi);
+    plumed_massert(header.min[j]==mini && header.max[j]==maxi,"the input periodicity in hills and in value definition does not match");
+  }
+}
+
+void FilesHandler::closeFile() {
+  if(binfile) binfile.reset();
+  else ifiles[beingread]->close();
+}
+
+bool FilesHandler::scanOneBinaryHill(std::unique_ptr<KernelFunctions> & kk, double & kbiasf) {
+  if(binpos>=binfile->size()) return false;
+  const BinaryHills::Header& header=binfile->getHeader();
+  const double* c=binfile->getCenter(binpos);
+  std::vector<double> center(c,c+header.getNumberOfArguments());
+  std::vector<double> sigma;
+  binfile->getSigma(binpos,sigma);
+  kk=Tools::make_unique<KernelFunctions>(center,sigma,"gaussian",(header.multivariate?"MULTIVARIATE":"DIAGONAL"),binfile->getHeight(binpos));
+  kbiasf=binfile->getBiasFactor(binpos);
+  binpos++;
+  return true;
+}
+
+bool FilesHandler::scanOneHill(BiasRepresentation *br, IFile *ifile, std::unique_ptr<KernelFunctions> & kk, double & kbiasf ) {
+  if(binfile) return scanOneBinaryHill(kk,kbiasf);
   double dummy;
   if(ifile->scanField("time",dummy)) {
     //(*log)<<"   scanning one hill: "<<dummy<<" \n";
     if(ifile->FieldExist("biasf")) ifile->scanField("biasf",dummy);
     if(ifile->FieldExist("clock")) ifile->scanField("clock",dummy);
     // keep this intermediate function in case you need to parse more data in the future
-    br->pushKernel(ifile);
+    kk=br->readKernel(ifile,kbiasf);
     //(*log)<<"  read hill\n";
     if(br->hasSigmaInInput())ifile->allowIgnoredFields();
     ifile->scanField();
@@ -521,8 +582,9 @@ FuncSumHills::FuncSumHills(const ActionOptions&ao):
         if(integratehills) {
 
           log<<"  Bias: Projecting on subgrid... \n";
-          BiasWeight Bw(beta);
           Grid biasGrid=*(biasrep->getGridPtr());
+          // the maximum is subtracted before exponentiating, so that large biases do not overflow
+          BiasWeight Bw(beta,biasGrid.getMaxValue());
           Grid smallGrid=biasGrid.project(proj,&Bw);
           OFile gridfile; gridfile.link(*this);
           std::ostringstream ostr; ostr<<nfiles;
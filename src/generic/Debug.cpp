@@ -42,6 +42,22 @@ DEBUG DETAILED_TIMERS
 DEBUG logRequestedAtoms STRIDE=2
 \endplumedfile
 
+When running with multiple OpenMP threads, independent actions (e.g. CVs that
+do not depend on each other) can be calculated concurrently by different threads.
+This is useful when the input contains many CVs, each of which is too cheap to
+take advantage of OpenMP parallelism alone. Results are identical to the ones
+obtained with the standard sequential loop.
+
+\plumedfile
+DEBUG CONCURRENT_ACTIONS
+d1: DISTANCE ATOMS=1,2
+d2: DISTANCE ATOMS=3,4
+t1: TORSION ATOMS=1,2,3,4
+\endplumedfile
+
+Concurrent calculation is only enabled when PLUMED runs on a single MPI process,
+without multiple replicas, and detailed timers are switched off.
+
 */
 //+ENDPLUMEDOC
 class Debug:
@@ -52,6 +68,7 @@ class Debug:
   bool logRequestedAtoms;
   bool novirial;
   bool detailedTimers;
+  bool concurrentActions;
 public:
   explicit Debug(const ActionOptions&ao);
 /// Register all the relevant keywords for the action
@@ -70,6 +87,7 @@ void Debug::registerKeywords( Keywords& keys ) {
   keys.addFlag("logRequestedAtoms",false,"write in the log which atoms have been requested at a given time");
   keys.addFlag("NOVIRIAL",false,"switch off the virial contribution for the entirety of the simulation");
   keys.addFlag("DETAILED_TIMERS",false,"switch on detailed timers");
+  keys.addFlag("CONCURRENT_ACTIONS",false,"calculate independent actions concurrently using OpenMP threads");
   keys.add("optional","FILE","the name of the file on which to output these quantities");
 }
 
@@ -91,6 +109,11 @@ Debug::Debug(const ActionOptions&ao):
     log.printf("  Detailed timing on\n");
     plumed.detailedTimers=true;
   }
+  parseFlag("CONCURRENT_ACTIONS",concurrentActions);
+  if(concurrentActions) {
+    log.printf("  Independent actions will be calculated concurrently\n");
+    plumed.concurrentActions=true;
+  }
   ofile.link(*this);
   std::string file;
   parse("FILE",file);
@@ -67,6 +67,8 @@
 #ifdef __PLUMED_HAS_ASMJIT
     #include "asmjit/asmjit.h"
 #endif
+#include <algorithm>
+#include <cmath>
 #include <utility>
 
 namespace PLMD {
@@ -113,11 +115,33 @@ CompiledExpression::CompiledExpression(const ParsedExpression& expression) : jit
     ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
     vector<pair<ExpressionTreeNode, int> > temps;
     compileExpression(expr.getRootNode(), temps);
+    outputs.push_back((int) workspace.size()-1);
+    completeCompilation();
+}
+
+CompiledExpression::CompiledExpression(const vector<ParsedExpression>& expressions) : jitCode(NULL) {
+    if (expressions.size() == 0)
+        throw Exception("CompiledExpression: no expressions to compile");
+    // All the expressions share the list of temporaries, so that identical subexpressions are only computed once.
+    
+    vector<pair<ExpressionTreeNode, int> > temps;
+    for (int i = 0; i < (int) expressions.size(); i++) {
+        ParsedExpression expr = expressions[i].optimize();
+        compileExpression(expr.getRootNode(), temps);
+        outputs.push_back(temps[findTempIndex(expr.getRootNode(), temps)].second);
+    }
+    completeCompilation();
+}
+
+void CompiledExpression::completeCompilation() {
+    outputValues.resize(outputs.size());
     int maxArguments = 1;
     for (int i = 0; i < (int) operation.size(); i++)
         if (operation[i]->getNumArguments() > maxArguments)
             maxArguments = operation[i]->getNumArguments();
     argValues.resize(maxArguments);
+    for (set<string>::const_iterator iter = variableNames.begin(); iter != variableNames.end(); ++iter)
+        variableSlots.push_back(variableIndices[*iter]);
 #ifdef __PLUMED_HAS_ASMJIT
     if(useAsmJit()) generateJitCode();
 #endif
@@ -138,6 +162,9 @@ CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expr
     target = expression.target;
     variableIndices = expression.variableIndices;
     variableNames = expression.variableNames;
+    variableSlots = expression.variableSlots;
+    outputs = expression.outputs;
+    outputValues.resize(expression.outputValues.size());
     workspace.resize(expression.workspace.size());
     argValues.resize(expression.argValues.size());
     operation.resize(expression.operation.size());
@@ -237,6 +264,32 @@ double CompiledExpression::evaluate() const {
 #ifdef __PLUMED_HAS_ASMJIT
     if(asmjit) return ((double (*)()) jitCode)();
 #endif
+    evaluateInterpreted();
+    return workspace[outputs[0]];
+}
+
+void CompiledExpression::evaluate(double* results) const {
+#ifdef __PLUMED_HAS_ASMJIT
+    static const bool asmjit=useAsmJit();
+    if(asmjit) {
+        // The JIT code stores all the outputs in outputValues.
+        
+        results[0] = ((double (*)()) jitCode)();
+        for (int i = 1; i < (int) outputs.size(); i++)
+            results[i] = outputValues[i];
+        return;
+    }
+#endif
+    evaluateInterpreted();
+    for (int i = 0; i < (int) outputs.size(); i++)
+        results[i] = workspace[outputs[i]];
+}
+
+int CompiledExpression::getNumOutputs() const {
+    return outputs.size();
+}
+
+void CompiledExpression::evaluateInterpreted() const {
     for (int i = 0; i < variablesToCopy.size(); i++)
         *variablesToCopy[i].first = *variablesToCopy[i].second;
 
@@ -252,7 +305,197 @@ double CompiledExpression::evaluate() const {
             workspace[target[step]] = operation[step]->evaluate(&argValues[0], dummyVariables);
         }
     }
-    return workspace[workspace.size()-1];
+}
+
+// Number of points evaluated together by the thread safe versions of evaluate().
+// With this size the workspace of typical expressions fits in the L1 cache.
+static const int evaluationBlock = 64;
+
+double CompiledExpression::evaluate(const double* values, vector<double>& ws) const {
+    const int scratchSize = (std::max)(1, (int) argValues.size());
+    if (ws.size() < workspace.size()+scratchSize)
+        ws.resize(workspace.size()+scratchSize);
+    for (int i = 0; i < (int) variableSlots.size(); i++)
+        ws[variableSlots[i]] = values[i];
+    evaluateOperations(&ws[0], 1);
+    return ws[outputs[0]];
+}
+
+void CompiledExpression::evaluate(const double* values, double* results, vector<double>& ws) const {
+    results[0] = evaluate(values, ws);
+    for (int i = 1; i < (int) outputs.size(); i++)
+        results[i] = ws[outputs[i]];
+}
+
+void CompiledExpression::evaluate(const double* const* values, double* results, int n, vector<double>& ws) const {
+    evaluatePoints(values, &results, 1, n, ws);
+}
+
+void CompiledExpression::evaluate(const double* const* values, double* const* results, int n, vector<double>& ws) const {
+    evaluatePoints(values, results, outputs.size(), n, ws);
+}
+
+void CompiledExpression::evaluatePoints(const double* const* values, double* const* results, int numResults, int n, vector<double>& ws) const {
+    const int block = (std::min)(n, evaluationBlock);
+    const int scratchSize = (std::max)(block, (int) argValues.size());
+    if (ws.size() < workspace.size()*block+scratchSize)
+        ws.resize(workspace.size()*block+scratchSize);
+    for (int first = 0; first < n; first += block) {
+        // The last block can be shorter.  The workspace is laid out with the actual length of the block.
+        
+        const int m = (std::min)(block, n-first);
+        for (int i = 0; i < (int) variableSlots.size(); i++) {
+            double* w = &ws[variableSlots[i]*m];
+            const double* v = values[i]+first;
+            for (int p = 0; p < m; p++)
+                w[p] = v[p];
+        }
+        evaluateOperations(&ws[0], m);
+        for (int i = 0; i < numResults; i++) {
+            const double* r = &ws[outputs[i]*m];
+            for (int p = 0; p < m; p++)
+                results[i][first+p] = r[p];
+        }
+    }
+}
+
+template <class F>
+static void applyUnary(double* t, const double* x, int n, F f) {
+    #pragma omp simd
+    for (int p = 0; p < n; p++)
+        t[p] = f(x[p]);
+}
+
+template <class F>
+static void applyBinary(double* t, const double* x, const double* y, int n, F f) {
+    #pragma omp simd
+    for (int p = 0; p < n; p++)
+        t[p] = f(x[p], y[p]);
+}
+
+void CompiledExpression::evaluateOperations(double* ws, int n) const {
+    // Element p of the workspace entry i is stored in ws[i*n+p].  The space after the workspace is used as
+    // scratch memory, of size at least n and at least the maximum number of arguments.  Each loop performs the same arithmetic as
+    // Operation::evaluate(), so that results are identical to the ones of evaluate().
+    
+    double* scratch = ws+workspace.size()*n;
+    for (int step = 0; step < (int) operation.size(); step++) {
+        const Operation& op = *operation[step];
+        const vector<int>& args = arguments[step];
+        double* t = ws+target[step]*n;
+        const double* x = ws+args[0]*n;
+        const double* y = (op.getNumArguments() > 1 ? ws+(args.size() == 1 ? args[0]+1 : args[1])*n : NULL);
+        switch (op.getId()) {
+            case Operation::CONSTANT: {
+                const double value = dynamic_cast<const Operation::Constant&>(op).getValue();
+                for (int p = 0; p < n; p++)
+                    t[p] = value;
+                break;
+            }
+            case Operation::ADD:
+                applyBinary(t, x, y, n, [](double a, double b) {return a+b;});
+                break;
+            case Operation::SUBTRACT:
+                applyBinary(t, x, y, n, [](double a, double b) {return a-b;});
+                break;
+            case Operation::MULTIPLY:
+                applyBinary(t, x, y, n, [](double a, double b) {return a*b;});
+                break;
+            case Operation::DIVIDE:
+                applyBinary(t, x, y, n, [](double a, double b) {return a/b;});
+                break;
+            case Operation::NEGATE:
+                applyUnary(t, x, n, [](double a) {return -a;});
+                break;
+            case Operation::SQRT:
+                applyUnary(t, x, n, [](double a) {return std::sqrt(a);});
+                break;
+            case Operation::EXP:
+                applyUnary(t, x, n, [](double a) {return std::exp(a);});
+                break;
+            case Operation::LOG:
+                applyUnary(t, x, n, [](double a) {return std::log(a);});
+                break;
+            case Operation::SIN:
+                applyUnary(t, x, n, [](double a) {return std::sin(a);});
+                break;
+            case Operation::COS:
+                applyUnary(t, x, n, [](double a) {return std::cos(a);});
+                break;
+            case Operation::TANH:
+                applyUnary(t, x, n, [](double a) {return std::tanh(a);});
+                break;
+            case Operation::STEP:
+                applyUnary(t, x, n, [](double a) {return (a >= 0.0 ? 1.0 : 0.0);});
+                break;
+            case Operation::SQUARE:
+                applyUnary(t, x, n, [](double a) {return a*a;});
+                break;
+            case Operation::CUBE:
+                applyUnary(t, x, n, [](double a) {return a*a*a;});
+                break;
+            case Operation::RECIPROCAL:
+                applyUnary(t, x, n, [](double a) {return 1.0/a;});
+                break;
+            case Operation::ADD_CONSTANT: {
+                const double value = dynamic_cast<const Operation::AddConstant&>(op).getValue();
+                applyUnary(t, x, n, [value](double a) {return a+value;});
+                break;
+            }
+            case Operation::MULTIPLY_CONSTANT: {
+                const double value = dynamic_cast<const Operation::MultiplyConstant&>(op).getValue();
+                applyUnary(t, x, n, [value](double a) {return a*value;});
+                break;
+            }
+            case Operation::POWER_CONSTANT: {
+                const double value = dynamic_cast<const Operation::PowerConstant&>(op).getValue();
+                int exponent = (int) value;
+                if (exponent != value) {
+                    applyUnary(t, x, n, [value](double a) {return std::pow(a, value);});
+                    break;
+                }
+                // Same sequence of multiplications as Operation::PowerConstant::evaluate(), applied to all points.
+                // The base is kept in the scratch space.
+                
+                double* base = scratch;
+                if (exponent < 0) {
+                    exponent = -exponent;
+                    applyUnary(base, x, n, [](double a) {return 1.0/a;});
+                }
+                else
+                    applyUnary(base, x, n, [](double a) {return a;});
+                for (int p = 0; p < n; p++)
+                    t[p] = 1.0;
+                while (exponent != 0) {
+                    if ((exponent&1) == 1)
+                        applyBinary(t, t, base, n, [](double a, double b) {return a*b;});
+                    applyUnary(base, base, n, [](double a) {return a*a;});
+                    exponent = exponent>>1;
+                }
+                break;
+            }
+            case Operation::MIN:
+                applyBinary(t, x, y, n, [](double a, double b) {return (std::min)(a, b);});
+                break;
+            case Operation::MAX:
+                applyBinary(t, x, y, n, [](double a, double b) {return (std::max)(a, b);});
+                break;
+            case Operation::ABS:
+                applyUnary(t, x, n, [](double a) {return std::abs(a);});
+                break;
+            default: {
+                // Evaluate the operation one point at a time.
+                
+                const int numArgs = op.getNumArguments();
+                double* a = scratch;
+                for (int p = 0; p < n; p++) {
+                    for (int i = 0; i < numArgs; i++)
+                        a[i] = ws[(args.size() == 1 ? args[0]+i : args[i])*n+p];
+                    t[p] = op.evaluate(a, dummyVariables);
+                }
+            }
+        }
+    }
 }
 
 #ifdef __PLUMED_HAS_ASMJIT
@@ -460,7 +703,15 @@ void CompiledExpression::generateJitCode() {
                 call->setRet(0, workspaceVar[target[step]]);
         }
     }
-    c.ret(workspaceVar[workspace.size()-1]);
+    if (outputs.size() > 1) {
+        // Additional outputs are stored in memory, the first one is returned.
+        
+        X86Gp outputsPointer = c.newIntPtr();
+        c.mov(outputsPointer, imm_ptr(&outputValues[0]));
+        for (int i = 1; i < (int) outputs.size(); i++)
+            c.movsd(x86::ptr(outputsPointer, 8*i, 0), workspaceVar[outputs[i]]);
+    }
+    c.ret(workspaceVar[outputs[0]]);
     c.endFunc();
     c.finalize();
     typedef double (*Func0)(void);
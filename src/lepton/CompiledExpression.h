@@ -115,6 +115,12 @@ class ParsedExpression;
 class LEPTON_EXPORT CompiledExpression {
 public:
     CompiledExpression();
+    /**
+     * Create a CompiledExpression that computes several expressions in a single program, typically a function
+     * and its derivatives.  Subexpressions that appear in more than one of them are computed only once.
+     * evaluate() returns the value of the first expression, evaluate(double*) returns all of them.
+     */
+    explicit CompiledExpression(const std::vector<ParsedExpression>& expressions);
     CompiledExpression(const CompiledExpression& expression);
     ~CompiledExpression();
     CompiledExpression& operator=(const CompiledExpression& expression);
@@ -137,11 +143,45 @@ public:
      * Evaluate the expression.  The values of all variables should have been set before calling this.
      */
     double evaluate() const;
+    /**
+     * Evaluate all the expressions this CompiledExpression was created from, and store their values in results.
+     */
+    void evaluate(double* results) const;
+    /**
+     * Get the number of expressions this CompiledExpression was created from.
+     */
+    int getNumOutputs() const;
+    /**
+     * Evaluate the expression without using the internal workspace, so that the same CompiledExpression can be
+     * used at the same time from several threads, each of them with its own workspace.  values contains the values
+     * of the variables, in the same order as getVariables().  The workspace is resized if needed.
+     * Variable locations set with setVariableLocations() are ignored.
+     */
+    double evaluate(const double* values, std::vector<double>& workspace) const;
+    /**
+     * Same as above, storing the values of all the expressions in results.
+     */
+    void evaluate(const double* values, double* results, std::vector<double>& workspace) const;
+    /**
+     * Evaluate the expression on n points at once.  values[i] points to the n values of the i-th variable,
+     * in the same order as getVariables(), and the n results are written in results.  Operations are applied
+     * to blocks of points with simple loops, which the compiler can vectorize.  As the function above,
+     * this is thread safe provided that each thread uses its own workspace.
+     */
+    void evaluate(const double* const* values, double* results, int n, std::vector<double>& workspace) const;
+    /**
+     * Same as above, storing the n values of the i-th expression in results[i].
+     */
+    void evaluate(const double* const* values, double* const* results, int n, std::vector<double>& workspace) const;
 private:
     friend class ParsedExpression;
     CompiledExpression(const ParsedExpression& expression);
     void compileExpression(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     int findTempIndex(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
+    void completeCompilation();
+    void evaluateInterpreted() const;
+    void evaluateOperations(double* workspace, int n) const;
+    void evaluatePoints(const double* const* values, double* const* results, int numResults, int n, std::vector<double>& workspace) const;
     std::map<std::string, double*> variablePointers;
     std::vector<std::pair<double*, double*> > variablesToCopy;
     std::vector<std::vector<int> > arguments;
@@ -149,6 +189,9 @@ private:
     std::vector<Operation*> operation;
     std::map<std::string, int> variableIndices;
     std::set<std::string> variableNames;
+    std::vector<int> variableSlots;
+    std::vector<int> outputs;
+    mutable std::vector<double> outputValues;
     mutable std::vector<double> workspace;
     mutable std::vector<double> argValues;
     std::map<std::string, double> dummyVariables;
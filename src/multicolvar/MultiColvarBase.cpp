@@ -79,7 +79,10 @@ MultiColvarBase::MultiColvarBase(const ActionOptions&ao):
   usepbc(false),
   allthirdblockintasks(false),
   uselinkforthree(false),
-  linkcells(comm),
+  linkcells(std::make_shared<SharedLinkCells>(comm)),
+  sharedcells(nullptr),
+  linkcut(0.0),
+  linkcellsShared(false),
   threecells(comm),
   setup_completed(false),
   atomsWereRetrieved(false),
@@ -496,21 +499,67 @@ void MultiColvarBase::setLinkCellCutoff( const double& lcut, double tcut ) {
   plumed_assert( usespecies || ablocks.size()<4 );
   if( tcut<0 ) tcut=lcut;
 
-  if( !linkcells.enabled() ) {
-    linkcells.setCutoff( lcut );
+  if( !linkcells->cells.enabled() ) {
+    linkcells->cells.setCutoff( lcut );
     threecells.setCutoff( tcut );
   } else {
-    if( lcut>linkcells.getCutoff() ) linkcells.setCutoff( lcut );
+    if( lcut>linkcells->cells.getCutoff() ) linkcells->cells.setCutoff( lcut );
     if( tcut>threecells.getCutoff() ) threecells.setCutoff( tcut );
   }
+  linkcut=linkcells->cells.getCutoff();
 }
 
 double MultiColvarBase::getLinkCellCutoff()  const {
-  return linkcells.getCutoff();
+  plumed_assert( linkcells->cells.enabled() ); return linkcut;
+}
+
+bool MultiColvarBase::getLinkCellsAtoms( std::vector<unsigned>& ind, std::vector<AtomNumber>& atoms ) const {
+  if( (!usespecies && nblock==0) || !linkcells->cells.enabled() ) return false;
+  if( !usespecies && ablocks.size()>=4 ) return false;
+  unsigned iblock=usespecies ? 0 : 1;
+
+  ind.resize( ablocks[iblock].size() ); atoms.resize( ablocks[iblock].size() );
+  for(unsigned i=0; i<ablocks[iblock].size(); ++i) {
+    unsigned iatom=ablocks[iblock][i];
+    // Positions that are calculated by other multicolvars are not shared
+    if( atom_lab[iatom].first>0 ) return false;
+    ind[i] = usespecies ? iatom : i;
+    atoms[i]=ActionAtomistic::getAbsoluteIndex( atom_lab[iatom].second );
+  }
+  return true;
+}
+
+void MultiColvarBase::shareLinkCells() {
+  linkcellsShared=true;
+  std::vector<unsigned> myind; std::vector<AtomNumber> myatoms;
+  if( !getLinkCellsAtoms( myind, myatoms ) ) return;
+
+  // Look for the link cells of the actions that use the same atoms.  If none of them has set them up yet
+  // ours are used for all of them, so they are made large enough for the largest cutoff
+  std::shared_ptr<SharedLinkCells> others; double maxcut=linkcut; bool found=false;
+  std::vector<unsigned> ind; std::vector<AtomNumber> atoms;
+  std::vector<MultiColvarBase*> all=plumed.getActionSet().select<MultiColvarBase*>();
+  for(unsigned i=0; i<all.size(); ++i) {
+    if( all[i]==this || !all[i]->getLinkCellsAtoms( ind, atoms ) || ind!=myind || atoms!=myatoms ) continue;
+    found=true;
+    if( all[i]->linkcellsShared && all[i]->sharedcells ) { others=all[i]->sharedcells; break; }
+    if( !all[i]->linkcellsShared && all[i]->linkcut>maxcut ) maxcut=all[i]->linkcut;
+  }
+  if( !found ) return;
+  if( others ) sharedcells=others;
+  else sharedcells=linkcells;
+  if( maxcut>sharedcells->cells.getCutoff() ) sharedcells->cells.setCutoff( maxcut );
 }
 
 void MultiColvarBase::setupLinkCells() {
-  if( (!usespecies && nblock==0) || !linkcells.enabled() ) return ;
+  if( (!usespecies && nblock==0) || !linkcells->cells.enabled() ) return ;
+  // Actions that are calculated concurrently might build the same cells at the same time, so they do not share them
+  if( plumed.concurrentActions ) {
+    if( sharedcells && linkcells==sharedcells ) {
+      linkcells=std::make_shared<SharedLinkCells>( comm ); linkcells->cells.setCutoff( linkcut );
+    }
+    sharedcells=nullptr;
+  } else if( !linkcellsShared ) shareLinkCells();
   // Retrieve any atoms that haven't already been retrieved
   for(std::vector<MultiColvarBase*>::iterator p=mybasemulticolvars.begin(); p!=mybasemulticolvars.end(); ++p) {
     (*p)->retrieveAtoms();
@@ -553,14 +602,32 @@ void MultiColvarBase::setupLinkCells() {
       }
     }
 
-    // Build the lists for the link cells
-    linkcells.buildCellLists( ltmp_pos, ltmp_ind, getPbc() );
+    // Use the link cells of the actions that use the same atoms if they have the same cells that we would build.
+    // The tasks that are done depend on which atoms are in the cells, so we cannot use larger cells
+    if( sharedcells ) {
+      if( LinkCells::findNumberOfCells( getPbc(), linkcut )==LinkCells::findNumberOfCells( getPbc(), sharedcells->cells.getCutoff() ) ) {
+        linkcells=sharedcells;
+      } else if( linkcells==sharedcells ) {
+        linkcells=std::make_shared<SharedLinkCells>( comm ); linkcells->cells.setCutoff( linkcut );
+      }
+    }
+
+    // Build the lists for the link cells, unless an action that uses the same atoms has already built them
+    if( !linkcells->cells.isBuiltFrom( ltmp_pos, ltmp_ind, getPbc() ) ) {
+      // Lists that were built on this step by another action might still be needed by it, so we stop sharing them
+      if( linkcells==sharedcells && linkcells->step==getStep() ) {
+        sharedcells=nullptr;
+        linkcells=std::make_shared<SharedLinkCells>( comm ); linkcells->cells.setCutoff( linkcut );
+      }
+      linkcells->cells.buildCellLists( ltmp_pos, ltmp_ind, getPbc() );
+      linkcells->step=getStep();
+    }
   }
 }
 
 void MultiColvarBase::setupNonUseSpeciesLinkCells( const unsigned& my_always_active ) {
   plumed_assert( !usespecies );
-  if( nblock==0 || !linkcells.enabled() ) return ;
+  if( nblock==0 || !linkcells->cells.enabled() ) return ;
   deactivateAllTasks();
   std::vector<unsigned> requiredlinkcells;
 
@@ -575,7 +642,7 @@ void MultiColvarBase::setupNonUseSpeciesLinkCells( const unsigned& my_always_act
     for(unsigned i=rank; i<ablocks[0].size(); i+=stride) {
       if( !isCurrentlyActive( ablocks[0][i] ) ) continue;
       unsigned natomsper=1; linked_atoms[0]=my_always_active;  // Note we always check atom 0 because it is simpler than changing LinkCells.cpp
-      linkcells.retrieveNeighboringAtoms( getPositionOfAtomForLinkCells( ablocks[0][i] ), requiredlinkcells, natomsper, linked_atoms );
+      linkcells->cells.retrieveNeighboringAtoms( getPositionOfAtomForLinkCells( ablocks[0][i] ), requiredlinkcells, natomsper, linked_atoms );
       for(unsigned j=0; j<natomsper; ++j) {
         for(unsigned k=bookeeping(i,linked_atoms[j]).first; k<bookeeping(i,linked_atoms[j]).second; ++k) taskFlags[k]=1;
       }
@@ -619,7 +686,7 @@ void MultiColvarBase::setupNonUseSpeciesLinkCells( const unsigned& my_always_act
     for(unsigned i=rank; i<ablocks[0].size(); i+=stride) {
       if( !isCurrentlyActive( ablocks[0][i] ) ) continue;
       unsigned natomsper=1; linked_atoms[0]=my_always_active;  // Note we always check atom 0 because it is simpler than changing LinkCells.cpp
-      linkcells.retrieveNeighboringAtoms( getPositionOfAtomForLinkCells( ablocks[0][i] ), requiredlinkcells, natomsper, linked_atoms );
+      linkcells->cells.retrieveNeighboringAtoms( getPositionOfAtomForLinkCells( ablocks[0][i] ), requiredlinkcells, natomsper, linked_atoms );
       if( allthirdblockintasks ) {
         for(unsigned j=0; j<natomsper; ++j) {
           for(unsigned k=bookeeping(i,linked_atoms[j]).first; k<bookeeping(i,linked_atoms[j]).second; ++k) taskFlags[k]=1;
@@ -654,7 +721,7 @@ bool MultiColvarBase::setupCurrentAtomList( const unsigned& taskCode, AtomValueP
     myatoms.setNumberOfAtoms( 1 ); myatoms.setAtom( 0, taskCode ); return true;
   } else if( usespecies ) {
     std::vector<unsigned> task_atoms(1); task_atoms[0]=taskCode;
-    unsigned natomsper=myatoms.setupAtomsFromLinkCells( task_atoms, getPositionOfAtomForLinkCells( taskCode ), linkcells );
+    unsigned natomsper=myatoms.setupAtomsFromLinkCells( task_atoms, getPositionOfAtomForLinkCells( taskCode ), linkcells->cells );
     return natomsper>1;
   } else if( matsums ) {
     myatoms.setNumberOfAtoms( getNumberOfAtoms() );
@@ -30,6 +30,7 @@
 #include "vesselbase/ActionWithVessel.h"
 #include "CatomPack.h"
 #include <vector>
+#include <memory>
 
 namespace PLMD {
 namespace multicolvar {
@@ -58,8 +59,24 @@ private:
   bool uselinkforthree;
 /// Number of atoms that are active on this step
   unsigned nactive_atoms;
+/// Link cells that are shared by multicolvars that use the same atoms, and the step at which they were last built
+  struct SharedLinkCells {
+    LinkCells cells;
+    long int step;
+    explicit SharedLinkCells( Communicator& cc ) : cells(cc), step(-1) {}
+  };
 /// Stuff for link cells - this is used to make coordination number like variables faster
-  LinkCells linkcells;
+  std::shared_ptr<SharedLinkCells> linkcells;
+/// The link cells of all the multicolvars that use the same atoms, these are used when they have the same size as ours
+  std::shared_ptr<SharedLinkCells> sharedcells;
+/// The cutoff that this action requested for the link cells
+  double linkcut;
+/// Have we looked for other actions that can share the link cells
+  bool linkcellsShared;
+/// Find the other actions that use the same atoms for their link cells
+  void shareLinkCells();
+/// Get the indices and atoms used to build the link cells, returns false if these are not all atoms
+  bool getLinkCellsAtoms( std::vector<unsigned>& ind, std::vector<AtomNumber>& atoms ) const ;
 /// Link cells for third block of atoms
   LinkCells threecells;
 /// Number of atoms that are being used for central atom position
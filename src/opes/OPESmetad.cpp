@@ -21,6 +21,11 @@ along with plumed.  If not, see <http://www.gnu.org/licenses/>.
 #include "tools/Communicator.h"
 #include "tools/File.h"
 #include "tools/OpenMP.h"
+#include "tools/SharedRingBuffer.h"
+#include "tools/KernelCells.h"
+#include "tools/GaussianBatch.h"
+
+#include <algorithm>
 
 namespace PLMD {
 namespace opes {
@@ -70,7 +75,11 @@ For an exact restart you must use STATE_RFILE to read a checkpoint with all the
 To save such checkpoints, define a STATE_WFILE and choose how often to print them with STATE_WSTRIDE.
 By default this file is overwritten, but you can instead append to it using the flag STORE_STATES.
 
-Multiple walkers are supported only with MPI communication, via the keyword WALKERS_MPI.
+Multiple walkers are supported with MPI communication, via the keyword WALKERS_MPI.
+Walkers running as separate processes on the same node can instead exchange their kernels through memory-mapped buffers, via the keywords WALKERS_SHM, WALKERS_N and WALKERS_ID.
+In this case the walkers are not synchronized, and each of them adds the kernels of the others at its own PACE.
+Each walker writes on its own FILE all the kernels it adds, so that it can be used to restart.
+Since these include the kernels of the other walkers, a restarted walker only reads from the buffers the kernels deposited after it has started.
 
 \par Examples
 
@@ -122,6 +131,11 @@ private:
   unsigned NumWalkers_;
   unsigned walker_rank_;
   unsigned long counter_;
+//walkers exchanging kernels through memory-mapped buffers
+  unsigned mw_n_;
+  unsigned mw_id_;
+  std::string mw_shm_;
+  std::vector<std::unique_ptr<SharedRingBuffer>> mw_buffers_;
   std::size_t ncv_;
 
   double kbt_;
@@ -162,6 +176,11 @@ private:
   double evaluateKernel(const kernel&,const std::vector<double>&) const;
   double evaluateKernel(const kernel&,const std::vector<double>&,std::vector<double>&,std::vector<double>&);
   std::vector<kernel> kernels_; //all compressed kernels
+  KernelCells kernels_cells_; //spatial index of the kernels, to avoid looping over all of them
+  std::vector<unsigned> kernels_neigh_; //kernels close to the current cv, found with kernels_cells_
+  GaussianBatch kernels_batch_; //to evaluate a kernel on many points at once
+  void evaluateKernelOnPoints(const kernel&,const double*,unsigned,double*,std::vector<double>&) const;
+  double getSumUprob(const std::vector<unsigned>&) const; //sum of the KDE over the centers of the given kernels
   OFile kernelsOfile_;
 //neighbour list stuff
   bool nlist_;
@@ -188,6 +207,7 @@ private:
   void addKernel(const double,const std::vector<double>&,const std::vector<double>&,const double); //also print to file
   unsigned getMergeableKernel(const std::vector<double>&,const unsigned);
   void updateNlist(const std::vector<double>&);
+  void readSharedKernels(std::vector<double>&);
   void dumpStateToFile();
 
 public:
@@ -278,6 +298,10 @@ void OPESmetad<mode>::registerKeywords(Keywords& keys)
 //miscellaneous
   keys.addFlag("CALC_WORK",false,"calculate the work done by the bias between each update");
   keys.addFlag("WALKERS_MPI",false,"switch on MPI version of multiple walkers");
+  keys.add("optional","WALKERS_SHM","prefix for the names of the memory-mapped buffers used to exchange kernels between walkers running on the same node, e.g. /dev/shm/opes");
+  keys.add("optional","WALKERS_SHM_SIZE","number of kernels that can be stored in the buffer of each walker. The default is 10000");
+  keys.add("optional","WALKERS_N","number of walkers exchanging kernels via WALKERS_SHM");
+  keys.add("optional","WALKERS_ID","id of this walker, between 0 and WALKERS_N-1");
   keys.addFlag("SERIAL",false,"perform calculations in serial");
   keys.use("RESTART");
   keys.use("UPDATE_FROM");
@@ -299,6 +323,8 @@ OPESmetad<mode>::OPESmetad(const ActionOptions& ao)
   , isFirstStep_(true)
   , afterCalculate_(false)
   , counter_(1)
+  , mw_n_(1)
+  , mw_id_(0)
   , ncv_(getNumberOfArguments())
   , Zed_(1)
   , work_(0)
@@ -398,6 +424,19 @@ OPESmetad<mode>::OPESmetad(const ActionOptions& ao)
   plumed_massert(cutoff>0,"you must choose a value for KERNEL_CUTOFF greater than zero");
   cutoff2_=cutoff*cutoff;
   val_at_cutoff_=std::exp(-0.5*cutoff2_);
+  kernels_cells_.resize(ncv_);
+  kernels_batch_=GaussianBatch(ncv_);
+  kernels_batch_.setCutoff(cutoff2_,val_at_cutoff_);
+  for(unsigned i=0; i<ncv_; i++)
+  {
+    if(getPntrToArgument(i)->isPeriodic())
+    {
+      double min,max;
+      getPntrToArgument(i)->getDomain(min,max);
+      kernels_cells_.setPeriodicity(i,min,max);
+      kernels_batch_.setPeriodicity(i,max-min);
+    }
+  }
 
   threshold2_=1;
   parse("COMPRESSION_THRESHOLD",threshold2_);
@@ -490,6 +529,20 @@ OPESmetad<mode>::OPESmetad(const ActionOptions& ao)
     NumWalkers_=1;
     walker_rank_=0;
   }
+  unsigned mw_shm_size=10000;
+  parse("WALKERS_SHM",mw_shm_);
+  parse("WALKERS_SHM_SIZE",mw_shm_size);
+  parse("WALKERS_N",mw_n_);
+  parse("WALKERS_ID",mw_id_);
+  if(mw_shm_.length()>0)
+  {
+    plumed_massert(!walkers_mpi,"WALKERS_SHM cannot be used together with WALKERS_MPI");
+    plumed_massert(mw_n_>1,"WALKERS_SHM requires WALKERS_N to be larger than one");
+    plumed_massert(mw_id_<mw_n_,"WALKERS_ID should be less than WALKERS_N");
+    plumed_massert(SharedRingBuffer::isAvailable(),"WALKERS_SHM requires memory-mapped files, which are not available on this system");
+  }
+  else
+    plumed_massert(mw_n_==1,"WALKERS_N can only be used together with WALKERS_SHM");
 
 //parallelization stuff
   NumOMP_=OpenMP::getNumThreads();
@@ -632,6 +685,7 @@ OPESmetad<mode>::OPESmetad(const ActionOptions& ao)
           ifile.scanField("height",height);
           ifile.scanField();
           kernels_.emplace_back(height,center,sigma);
+          kernels_cells_.add(kernels_.size()-1,center,sigma,std::sqrt(cutoff2_));
         }
         log.printf("    a total of %lu kernels where read\n",kernels_.size());
       }
@@ -663,10 +717,10 @@ OPESmetad<mode>::OPESmetad(const ActionOptions& ao)
         KDEnorm_=mode::explore?counter_:sum_weights_;
         if(!no_Zed_)
         {
-          double sum_uprob=0;
-          for(unsigned k=rank_; k<kernels_.size(); k+=NumParallel_)
-            for(unsigned kk=0; kk<kernels_.size(); kk++)
-              sum_uprob+=evaluateKernel(kernels_[kk],kernels_[k].center);
+          std::vector<unsigned> all_kernels(kernels_.size());
+          for(unsigned k=0; k<kernels_.size(); k++)
+            all_kernels[k]=k;
+          double sum_uprob=getSumUprob(all_kernels);
           if(NumParallel_>1)
             comm.Sum(sum_uprob);
           Zed_=sum_uprob/KDEnorm_/kernels_.size();
@@ -728,6 +782,15 @@ OPESmetad<mode>::OPESmetad(const ActionOptions& ao)
   kernelsOfile_.printField("kernel_cutoff",sqrt(cutoff2_));
   kernelsOfile_.printField("compression_threshold",sqrt(threshold2_));
 
+//setup buffers for exchanging kernels, each record contains weight, height, logweight, center and sigma
+  if(mw_shm_.length()>0)
+  {
+    for(unsigned w=0; w<mw_n_; w++)
+      mw_buffers_.emplace_back(Tools::make_unique<SharedRingBuffer>());
+    if(comm.Get_rank()==0)
+      mw_buffers_[mw_id_]->create(mw_shm_+"."+std::to_string(mw_id_),mw_shm_size,3+2*ncv_);
+  }
+
 //open file for storing state
   if(wStateStride_!=0)
   {
@@ -836,8 +899,14 @@ OPESmetad<mode>::OPESmetad(const ActionOptions& ao)
     log.printf("    number of walkers: %u\n",NumWalkers_);
     log.printf("    walker rank: %u\n",walker_rank_);
   }
+  if(mw_shm_.length()>0)
+  {
+    log.printf(" -- WALKERS_SHM: kernels are exchanged with other walkers on the same node through memory-mapped buffers %s.*\n",mw_shm_.c_str());
+    log.printf("    number of walkers: %u\n",mw_n_);
+    log.printf("    walker id: %u\n",mw_id_);
+  }
   int mw_warning=0;
-  if(!walkers_mpi && comm.Get_rank()==0 && multi_sim_comm.Get_size()>(int)NumWalkers_)
+  if(!walkers_mpi && mw_shm_.length()==0 && comm.Get_rank()==0 && multi_sim_comm.Get_size()>(int)NumWalkers_)
     mw_warning=1;
   comm.Bcast(mw_warning,0);
   if(mw_warning) //log.printf messes up with comm, so never use it without Bcast!
@@ -952,9 +1021,21 @@ void OPESmetad<mode>::update()
     //get new kernel height
     double height=std::exp(current_bias_/kbt_); //this assumes that calculate() always runs before update()
 
+    //get the kernels deposited by the other walkers since the last update
+    std::vector<double> shared_kernels;
+    if(mw_shm_.length()>0)
+      readSharedKernels(shared_kernels);
+    const unsigned record_size=3+2*ncv_;
+    const unsigned num_shared=shared_kernels.size()/record_size;
+
     //update sum_weights_ and neff
     double sum_heights=height;
     double sum_heights2=height*height;
+    for(unsigned k=0; k<num_shared; k++)
+    {
+      sum_heights+=shared_kernels[k*record_size];
+      sum_heights2+=shared_kernels[k*record_size]*shared_kernels[k*record_size];
+    }
     if(NumWalkers_>1)
     {
       if(comm.Get_rank()==0)
@@ -965,7 +1046,8 @@ void OPESmetad<mode>::update()
       comm.Bcast(sum_heights,0);
       comm.Bcast(sum_heights2,0);
     }
-    counter_+=NumWalkers_;
+    const bool first_update=(counter_==1);
+    counter_+=NumWalkers_+num_shared;
     sum_weights_+=sum_heights;
     sum_weights2_+=sum_heights2;
     const double neff=std::pow(1+sum_weights_,2)/(1+sum_weights2_); //adding 1 makes it more robust at the start
@@ -984,7 +1066,7 @@ void OPESmetad<mode>::update()
     if(adaptive_sigma_)
     {
       const double factor=mode::explore?1:biasfactor_;
-      if(counter_==1+NumWalkers_) //first time only
+      if(first_update) //first time only
       {
         for(unsigned i=0; i<ncv_; i++)
           av_M2_[i]*=biasfactor_; //from unbiased, thus must be adjusted
@@ -1046,7 +1128,26 @@ void OPESmetad<mode>::update()
 
     //add new kernel(s)
     if(NumWalkers_==1)
+    {
+      if(mw_buffers_.size()>0 && comm.Get_rank()==0)
+      {
+        std::vector<double> record(record_size);
+        record[0]=std::exp(current_bias_/kbt_);
+        record[1]=height;
+        record[2]=current_bias_/kbt_;
+        std::copy(center.begin(),center.end(),record.begin()+3);
+        std::copy(sigma.begin(),sigma.end(),record.begin()+3+ncv_);
+        mw_buffers_[mw_id_]->push(record);
+      }
       addKernel(height,center,sigma,current_bias_/kbt_);
+      for(unsigned k=0; k<num_shared; k++)
+      {
+        const double* record=&shared_kernels[k*record_size];
+        std::vector<double> center_k(record+3,record+3+ncv_);
+        std::vector<double> sigma_k(record+3+ncv_,record+3+2*ncv_);
+        addKernel(record[1],center_k,sigma_k,record[2]);
+      }
+    }
     else
     {
       std::vector<double> all_height(NumWalkers_,0.0);
@@ -1113,13 +1214,10 @@ void OPESmetad<mode>::update()
       const bool few_kernels=(ks*ks<(3*ks*ds+2*ds*ds*NumParallel_+100)); //this seems reasonable, but is not rigorous...
       if(few_kernels) //really needed? Probably is almost always false
       {
-        #pragma omp parallel num_threads(NumOMP_)
-        {
-          #pragma omp for reduction(+:sum_uprob) nowait
-          for(unsigned k=rank_; k<kernels_.size(); k+=NumParallel_)
-            for(unsigned kk=0; kk<kernels_.size(); kk++)
-              sum_uprob+=evaluateKernel(kernels_[kk],kernels_[k].center);
-        }
+        std::vector<unsigned> all_kernels(kernels_.size());
+        for(unsigned k=0; k<kernels_.size(); k++)
+          all_kernels[k]=k;
+        sum_uprob=getSumUprob(all_kernels);
         if(NumParallel_>1)
           comm.Sum(sum_uprob);
       }
@@ -1129,34 +1227,55 @@ void OPESmetad<mode>::update()
         // uprob = old_uprob + delta_uprob
         // and we also need to consider that in the new sum there are some novel centers and some disappeared ones
         double delta_sum_uprob=0;
+        std::vector<unsigned> close_kernels;
         if(!nlist_)
         {
-          #pragma omp parallel num_threads(NumOMP_)
+          //only the kernels close to the delta kernels can contribute
+          for(unsigned d=0; d<delta_kernels_.size(); d++)
           {
-            #pragma omp for reduction(+:delta_sum_uprob) nowait
-            for(unsigned k=rank_; k<kernels_.size(); k+=NumParallel_)
-            {
-              for(unsigned d=0; d<delta_kernels_.size(); d++)
-              {
-                const double sign=delta_kernels_[d].height<0?-1:1; //take away contribution from kernels that are gone, and add the one from new ones
-                delta_sum_uprob+=evaluateKernel(delta_kernels_[d],kernels_[k].center)+sign*evaluateKernel(kernels_[k],delta_kernels_[d].center);
-              }
-            }
+            kernels_cells_.getNeighbors(delta_kernels_[d].center,std::sqrt(cutoff2_),kernels_neigh_);
+            close_kernels.insert(close_kernels.end(),kernels_neigh_.begin(),kernels_neigh_.end());
           }
+          std::sort(close_kernels.begin(),close_kernels.end());
+          close_kernels.erase(std::unique(close_kernels.begin(),close_kernels.end()),close_kernels.end());
         }
-        else
+        const std::vector<unsigned>& update_kernels=(nlist_?nlist_index_:close_kernels);
+        //centers of the kernels handled by this rank, and of the delta kernels, stored one after the other
+        std::vector<unsigned> my_kernels;
+        std::vector<double> centers;
+        for(unsigned nk=rank_; nk<update_kernels.size(); nk+=NumParallel_)
         {
-          #pragma omp parallel num_threads(NumOMP_)
+          my_kernels.push_back(update_kernels[nk]);
+          centers.insert(centers.end(),kernels_[update_kernels[nk]].center.begin(),kernels_[update_kernels[nk]].center.end());
+        }
+        std::vector<double> delta_centers;
+        for(unsigned d=0; d<ds; d++)
+          delta_centers.insert(delta_centers.end(),delta_kernels_[d].center.begin(),delta_kernels_[d].center.end());
+        const unsigned npoints=my_kernels.size();
+        const unsigned block=256;
+        #pragma omp parallel num_threads(NumOMP_)
+        {
+          std::vector<double> uprob(block);
+          std::vector<double> delta_uprob(ds);
+          std::vector<double> invsigma(ncv_);
+          #pragma omp for reduction(+:delta_sum_uprob) nowait
+          for(unsigned first=0; first<npoints; first+=block)
           {
-            #pragma omp for reduction(+:delta_sum_uprob) nowait
-            for(unsigned nk=rank_; nk<nlist_index_.size(); nk+=NumParallel_)
+            const unsigned len=std::min(block,npoints-first);
+            //delta kernels on the centers of the kernels
+            std::fill(uprob.begin(),uprob.begin()+len,0.);
+            for(unsigned d=0; d<ds; d++)
+              evaluateKernelOnPoints(delta_kernels_[d],&centers[first*ncv_],len,uprob.data(),invsigma);
+            for(unsigned p=0; p<len; p++)
+              delta_sum_uprob+=uprob[p];
+            //kernels on the centers of the delta kernels
+            std::fill(delta_uprob.begin(),delta_uprob.end(),0.);
+            for(unsigned p=first; p<first+len; p++)
+              evaluateKernelOnPoints(kernels_[my_kernels[p]],delta_centers.data(),ds,delta_uprob.data(),invsigma);
+            for(unsigned d=0; d<ds; d++)
             {
-              const unsigned k=nlist_index_[nk];
-              for(unsigned d=0; d<delta_kernels_.size(); d++)
-              {
-                const double sign=delta_kernels_[d].height<0?-1:1; //take away contribution from kernels that are gone, and add the one from new ones
-                delta_sum_uprob+=evaluateKernel(delta_kernels_[d],kernels_[k].center)+sign*evaluateKernel(kernels_[k],delta_kernels_[d].center);
-              }
+              const double sign=delta_kernels_[d].height<0?-1:1; //take away contribution from kernels that are gone, and add the one from new ones
+              delta_sum_uprob+=sign*delta_uprob[d];
             }
           }
         }
@@ -1190,54 +1309,30 @@ template <class mode>
 double OPESmetad<mode>::getProbAndDerivatives(const std::vector<double>& cv,std::vector<double>& der_prob)
 {
   double prob=0.0;
+  //only the kernels in the neighbor list, or close enough according to the cells, can contribute
   if(!nlist_)
+    kernels_cells_.getNeighbors(cv,std::sqrt(cutoff2_),kernels_neigh_);
+  const std::vector<unsigned>& close_kernels=(nlist_?nlist_index_:kernels_neigh_);
+  if(NumOMP_==1 || (unsigned)close_kernels.size()<2*NumOMP_*NumParallel_)
   {
-    if(NumOMP_==1 || (unsigned)kernels_.size()<2*NumOMP_*NumParallel_)
-    {
-      // for performances and thread safety
-      std::vector<double> dist(ncv_);
-      for(unsigned k=rank_; k<kernels_.size(); k+=NumParallel_)
-        prob+=evaluateKernel(kernels_[k],cv,der_prob,dist);
-    }
-    else
-    {
-      #pragma omp parallel num_threads(NumOMP_)
-      {
-        std::vector<double> omp_deriv(der_prob.size(),0.);
-        // for performances and thread safety
-        std::vector<double> dist(ncv_);
-        #pragma omp for reduction(+:prob) nowait
-        for(unsigned k=rank_; k<kernels_.size(); k+=NumParallel_)
-          prob+=evaluateKernel(kernels_[k],cv,omp_deriv,dist);
-        #pragma omp critical
-        for(unsigned i=0; i<ncv_; i++)
-          der_prob[i]+=omp_deriv[i];
-      }
-    }
+    // for performances and thread safety
+    std::vector<double> dist(ncv_);
+    for(unsigned nk=rank_; nk<close_kernels.size(); nk+=NumParallel_)
+      prob+=evaluateKernel(kernels_[close_kernels[nk]],cv,der_prob,dist);
   }
   else
   {
-    if(NumOMP_==1 || (unsigned)nlist_index_.size()<2*NumOMP_*NumParallel_)
+    #pragma omp parallel num_threads(NumOMP_)
     {
+      std::vector<double> omp_deriv(der_prob.size(),0.);
       // for performances and thread safety
       std::vector<double> dist(ncv_);
-      for(unsigned nk=rank_; nk<nlist_index_.size(); nk+=NumParallel_)
-        prob+=evaluateKernel(kernels_[nlist_index_[nk]],cv,der_prob,dist);
-    }
-    else
-    {
-      #pragma omp parallel num_threads(NumOMP_)
-      {
-        std::vector<double> omp_deriv(der_prob.size(),0.);
-        // for performances and thread safety
-        std::vector<double> dist(ncv_);
-        #pragma omp for reduction(+:prob) nowait
-        for(unsigned nk=rank_; nk<nlist_index_.size(); nk+=NumParallel_)
-          prob+=evaluateKernel(kernels_[nlist_index_[nk]],cv,omp_deriv,dist);
-        #pragma omp critical
-        for(unsigned i=0; i<ncv_; i++)
-          der_prob[i]+=omp_deriv[i];
-      }
+      #pragma omp for reduction(+:prob) nowait
+      for(unsigned nk=rank_; nk<close_kernels.size(); nk+=NumParallel_)
+        prob+=evaluateKernel(kernels_[close_kernels[nk]],cv,omp_deriv,dist);
+      #pragma omp critical
+      for(unsigned i=0; i<ncv_; i++)
+        der_prob[i]+=omp_deriv[i];
     }
   }
   if(NumParallel_>1)
@@ -1264,7 +1359,9 @@ void OPESmetad<mode>::addKernel(const double height,const std::vector<double>& c
     {
       no_match=false;
       delta_kernels_.emplace_back(-1*kernels_[taker_k].height,kernels_[taker_k].center,kernels_[taker_k].sigma);
+      kernels_cells_.remove(taker_k,kernels_[taker_k].center);
       mergeKernels(kernels_[taker_k],kernel(height,center,sigma));
+      kernels_cells_.add(taker_k,kernels_[taker_k].center,kernels_[taker_k].sigma,std::sqrt(cutoff2_));
       delta_kernels_.push_back(kernels_[taker_k]);
       if(recursive_merge_) //the overhead is worth it if it keeps low the total number of kernels
       {
@@ -1276,9 +1373,12 @@ void OPESmetad<mode>::addKernel(const double height,const std::vector<double>& c
           delta_kernels_.emplace_back(-1*kernels_[taker_k].height,kernels_[taker_k].center,kernels_[taker_k].sigma);
           if(taker_k>giver_k) //saves time when erasing
             std::swap(taker_k,giver_k);
+          kernels_cells_.remove(taker_k,kernels_[taker_k].center);
           mergeKernels(kernels_[taker_k],kernels_[giver_k]);
           delta_kernels_.push_back(kernels_[taker_k]);
+          kernels_cells_.erase(giver_k,kernels_[giver_k].center);
           kernels_.erase(kernels_.begin()+giver_k);
+          kernels_cells_.add(taker_k,kernels_[taker_k].center,kernels_[taker_k].sigma,std::sqrt(cutoff2_));
           if(nlist_)
           {
             unsigned giver_nk=0;
@@ -1305,6 +1405,7 @@ void OPESmetad<mode>::addKernel(const double height,const std::vector<double>& c
   if(no_match)
   {
     kernels_.emplace_back(height,center,sigma);
+    kernels_cells_.add(kernels_.size()-1,center,sigma,std::sqrt(cutoff2_));
     delta_kernels_.emplace_back(height,center,sigma);
     if(nlist_)
       nlist_index_.push_back(kernels_.size()-1);
@@ -1331,74 +1432,40 @@ unsigned OPESmetad<mode>::getMergeableKernel(const std::vector<double>& giver_ce
 { //returns kernels_.size() if no match is found
   unsigned min_k=kernels_.size();
   double min_norm2=threshold2_;
+  std::vector<unsigned> cells_neigh;
   if(!nlist_)
+    kernels_cells_.getNeighbors(giver_center,std::sqrt(threshold2_),cells_neigh);
+  const std::vector<unsigned>& close_kernels=(nlist_?nlist_index_:cells_neigh);
+  #pragma omp parallel num_threads(NumOMP_)
   {
-    #pragma omp parallel num_threads(NumOMP_)
+    unsigned min_k_omp = min_k;
+    double min_norm2_omp = threshold2_;
+    #pragma omp for nowait
+    for(unsigned nk=rank_; nk<close_kernels.size(); nk+=NumParallel_)
     {
-      unsigned min_k_omp = min_k;
-      double min_norm2_omp = threshold2_;
-      #pragma omp for nowait
-      for(unsigned k=rank_; k<kernels_.size(); k+=NumParallel_)
+      const unsigned k=close_kernels[nk];
+      if(k==giver_k) //a kernel should not be merged with itself
+        continue;
+      double norm2=0;
+      for(unsigned i=0; i<ncv_; i++)
       {
-        if(k==giver_k) //a kernel should not be merged with itself
-          continue;
-        double norm2=0;
-        for(unsigned i=0; i<ncv_; i++)
-        {
-          const double dist_i=difference(i,giver_center[i],kernels_[k].center[i])/kernels_[k].sigma[i];
-          norm2+=dist_i*dist_i;
-          if(norm2>=min_norm2_omp)
-            break;
-        }
-        if(norm2<min_norm2_omp)
-        {
-          min_norm2_omp=norm2;
-          min_k_omp=k;
-        }
+        const double dist_i=difference(i,giver_center[i],kernels_[k].center[i])/kernels_[k].sigma[i];
+        norm2+=dist_i*dist_i;
+        if(norm2>=min_norm2_omp)
+          break;
       }
-      #pragma omp critical
+      if(norm2<min_norm2_omp)
       {
-        if(min_norm2_omp < min_norm2)
-        {
-          min_norm2 = min_norm2_omp;
-          min_k = min_k_omp;
-        }
+        min_norm2_omp=norm2;
+        min_k_omp=k;
       }
     }
-  }
-  else
-  {
-    #pragma omp parallel num_threads(NumOMP_)
+    #pragma omp critical
     {
-      unsigned min_k_omp = min_k;
-      double min_norm2_omp = threshold2_;
-      #pragma omp for nowait
-      for(unsigned nk=rank_; nk<nlist_index_.size(); nk+=NumParallel_)
+      if(min_norm2_omp < min_norm2)
       {
-        const unsigned k=nlist_index_[nk];
-        if(k==giver_k) //a kernel should not be merged with itself
-          continue;
-        double norm2=0;
-        for(unsigned i=0; i<ncv_; i++)
-        {
-          const double dist_i=difference(i,giver_center[i],kernels_[k].center[i])/kernels_[k].sigma[i];
-          norm2+=dist_i*dist_i;
-          if(norm2>=min_norm2)
-            break;
-        }
-        if(norm2<min_norm2_omp)
-        {
-          min_norm2_omp=norm2;
-          min_k_omp=k;
-        }
-      }
-      #pragma omp critical
-      {
-        if(min_norm2_omp < min_norm2)
-        {
-          min_norm2 = min_norm2_omp;
-          min_k = min_k_omp;
-        }
+        min_norm2 = min_norm2_omp;
+        min_k = min_k_omp;
       }
     }
   }
@@ -1414,6 +1481,30 @@ unsigned OPESmetad<mode>::getMergeableKernel(const std::vector<double>& giver_ce
   return min_k;
 }
 
+template <class mode>
+void OPESmetad<mode>::readSharedKernels(std::vector<double>& data)
+{
+//only the first rank accesses the buffers, the other ones could be on a different node
+  unsigned size=0;
+  if(comm.Get_rank()==0)
+  {
+    for(unsigned w=0; w<mw_n_; w++)
+    {
+      if(w==mw_id_)
+        continue;
+      if(!mw_buffers_[w]->isOpen()) //when restarting, the kernels already written are in the restart file
+        mw_buffers_[w]->attach(mw_shm_+"."+std::to_string(w),getRestart()?SharedRingBuffer::allWritten:0);
+      if(mw_buffers_[w]->isOpen())
+        mw_buffers_[w]->read(data);
+    }
+    size=data.size();
+  }
+  comm.Bcast(size,0);
+  data.resize(size);
+  if(size>0)
+    comm.Bcast(data,0);
+}
+
 template <class mode>
 void OPESmetad<mode>::updateNlist(const std::vector<double>& new_center)
 {
@@ -1422,11 +1513,14 @@ void OPESmetad<mode>::updateNlist(const std::vector<double>& new_center)
 
   nlist_center_=new_center;
   nlist_index_.clear();
+  //only the kernels that are close according to the cells need to be checked
+  kernels_cells_.getNeighbors(nlist_center_,std::sqrt(nlist_param_[0]*cutoff2_),kernels_neigh_);
   //first we gather all the nlist_index
-  if(NumOMP_==1 || (unsigned)kernels_.size()<2*NumOMP_*NumParallel_)
+  if(NumOMP_==1 || (unsigned)kernels_neigh_.size()<2*NumOMP_*NumParallel_)
   {
-    for(unsigned k=rank_; k<kernels_.size(); k+=NumParallel_)
+    for(unsigned nk=rank_; nk<kernels_neigh_.size(); nk+=NumParallel_)
     {
+      const unsigned k=kernels_neigh_[nk];
       double norm2_k=0;
       for(unsigned i=0; i<ncv_; i++)
       {
@@ -1443,8 +1537,9 @@ void OPESmetad<mode>::updateNlist(const std::vector<double>& new_center)
     {
       std::vector<unsigned> private_nlist_index;
       #pragma omp for nowait
-      for(unsigned k=rank_; k<kernels_.size(); k+=NumParallel_)
+      for(unsigned nk=rank_; nk<kernels_neigh_.size(); nk+=NumParallel_)
       {
+        const unsigned k=kernels_neigh_[nk];
         double norm2_k=0;
         for(unsigned i=0; i<ncv_; i++)
         {
@@ -1620,6 +1715,42 @@ void OPESmetad<mode>::dumpStateToFile()
     stateOfile_.flush();
 }
 
+template <class mode>
+void OPESmetad<mode>::evaluateKernelOnPoints(const kernel& G,const double* points,unsigned npoints,double* uprob,std::vector<double>& invsigma) const
+{ //invsigma is only used as a buffer, to avoid allocating memory for each kernel
+  for(unsigned i=0; i<ncv_; i++)
+    invsigma[i]=1./G.sigma[i];
+  kernels_batch_.evaluate(G.center.data(),invsigma.data(),G.height,points,npoints,uprob);
+}
+
+template <class mode>
+double OPESmetad<mode>::getSumUprob(const std::vector<unsigned>& points_kernels) const
+{ //each rank takes some of the centers, and the sum over ranks should be done by the caller
+  std::vector<double> centers;
+  for(unsigned nk=rank_; nk<points_kernels.size(); nk+=NumParallel_)
+    centers.insert(centers.end(),kernels_[points_kernels[nk]].center.begin(),kernels_[points_kernels[nk]].center.end());
+  const unsigned npoints=centers.size()/ncv_;
+  //centers are taken in blocks, so that they stay in cache while looping over all the kernels
+  const unsigned block=256;
+  double sum_uprob=0;
+  #pragma omp parallel num_threads(NumOMP_)
+  {
+    std::vector<double> uprob(block);
+    std::vector<double> invsigma(ncv_);
+    #pragma omp for reduction(+:sum_uprob) nowait
+    for(unsigned first=0; first<npoints; first+=block)
+    {
+      const unsigned len=std::min(block,npoints-first);
+      std::fill(uprob.begin(),uprob.begin()+len,0.);
+      for(unsigned kk=0; kk<kernels_.size(); kk++)
+        evaluateKernelOnPoints(kernels_[kk],&centers[first*ncv_],len,uprob.data(),invsigma);
+      for(unsigned p=0; p<len; p++)
+        sum_uprob+=uprob[p];
+    }
+  }
+  return sum_uprob;
+}
+
 template <class mode>
 inline double OPESmetad<mode>::evaluateKernel(const kernel& G,const std::vector<double>& x) const
 { //NB: cannot be a method of kernel class, because uses external variables (for cutoff)
@@ -26,11 +26,12 @@
 #include "KernelFunctions.h"
 #include "File.h"
 #include "Grid.h"
+#include "OpenMP.h"
 
 namespace PLMD {
 
 /// the constructor here
-BiasRepresentation::BiasRepresentation(const std::vector<Value*> & tmpvalues, Communicator &cc ):hasgrid(false),rescaledToBias(false),mycomm(cc) {
+BiasRepresentation::BiasRepresentation(const std::vector<Value*> & tmpvalues, Communicator &cc ):hasgrid(false),rescaledToBias(false),nkernels(0),mycomm(cc) {
   lowI_=0.0;
   uppI_=0.0;
   doInt_=false;
@@ -43,7 +44,7 @@ BiasRepresentation::BiasRepresentation(const std::vector<Value*> & tmpvalues, Co
 
 /// overload the constructor: add the sigma  at constructor time
 BiasRepresentation::BiasRepresentation(const std::vector<Value*> & tmpvalues, Communicator &cc, const std::vector<double> & sigma ):
-  hasgrid(false), rescaledToBias(false), histosigma(sigma),mycomm(cc)
+  hasgrid(false), rescaledToBias(false), nkernels(0), histosigma(sigma),mycomm(cc)
 {
   lowI_=0.0;
   uppI_=0.0;
@@ -58,7 +59,7 @@ BiasRepresentation::BiasRepresentation(const std::vector<Value*> & tmpvalues, Co
 /// overload the constructor: add the grid at constructor time
 BiasRepresentation::BiasRepresentation(const std::vector<Value*> & tmpvalues, Communicator &cc, const std::vector<std::string> & gmin, const std::vector<std::string> & gmax,
                                        const std::vector<unsigned> & nbin, bool doInt, double lowI, double uppI):
-  hasgrid(false), rescaledToBias(false), mycomm(cc)
+  hasgrid(false), rescaledToBias(false), nkernels(0), mycomm(cc)
 {
   ndim=tmpvalues.size();
   for(int i=0; i<ndim; i++) {
@@ -75,7 +76,7 @@ BiasRepresentation::BiasRepresentation(const std::vector<Value*> & tmpvalues, Co
 /// overload the constructor with some external sigmas: needed for histogram
 BiasRepresentation::BiasRepresentation(const std::vector<Value*> & tmpvalues, Communicator &cc, const std::vector<std::string> & gmin, const std::vector<std::string> & gmax,
                                        const std::vector<unsigned> & nbin, const std::vector<double> & sigma):
-  hasgrid(false), rescaledToBias(false),histosigma(sigma),mycomm(cc)
+  hasgrid(false), rescaledToBias(false), nkernels(0), histosigma(sigma),mycomm(cc)
 {
   lowI_=0.0;
   uppI_=0.0;
@@ -90,7 +91,7 @@ BiasRepresentation::BiasRepresentation(const std::vector<Value*> & tmpvalues, Co
 }
 
 void BiasRepresentation::addGrid(const std::vector<std::string> & gmin, const std::vector<std::string> & gmax, const std::vector<unsigned> & nbin ) {
-  plumed_massert(hills.size()==0,"you can set the grid before loading the hills");
+  plumed_massert(nkernels==0,"you can set the grid before loading the hills");
   plumed_massert(hasgrid==false,"to build the grid you should not having the grid in this bias representation");
   std::string ss; ss="file.free";
   std::vector<Value*> vv; for(unsigned i=0; i<values.size(); i++) vv.push_back(values[i]);
@@ -103,7 +104,7 @@ bool BiasRepresentation::hasSigmaInInput() {
 }
 
 void BiasRepresentation::setRescaledToBias(bool rescaled) {
-  plumed_massert(hills.size()==0,"you can set the rescaling function only before loading hills");
+  plumed_massert(nkernels==0,"you can set the rescaling function only before loading hills");
   rescaledToBias=rescaled;
 }
 
@@ -141,6 +142,12 @@ std::unique_ptr<KernelFunctions> BiasRepresentation::readFromPoint(IFile *ifile)
 }
 
 void BiasRepresentation::pushKernel( IFile *ifile ) {
+  double kbiasf;
+  std::unique_ptr<KernelFunctions> kk=readKernel(ifile,kbiasf);
+  pushKernel(std::move(kk),kbiasf);
+}
+
+std::unique_ptr<KernelFunctions> BiasRepresentation::readKernel( IFile *ifile, double & kbiasf ) {
   std::unique_ptr<KernelFunctions> kk;
   // here below the reading of the kernel is completely hidden
   if(histosigma.size()==0) {
@@ -158,7 +165,6 @@ void BiasRepresentation::pushKernel( IFile *ifile ) {
     ifile->scanField("biasf",dummy);
     Tools::convert(dummy,dummyd);
   } else {dummyd=1.0;}
-  biasf.push_back(dummyd);
   // the domain does not pertain to the kernel but to the values here defined
   std::string mins,maxs,minv,maxv,mini,maxi; mins="min_"; maxs="max_";
   for(int i=0 ; i<ndim; i++) {
@@ -171,6 +177,12 @@ void BiasRepresentation::pushKernel( IFile *ifile ) {
       plumed_massert(maxi==maxv,"the input periodicity in hills and in value definition does not match"  );
     }
   }
+  kbiasf=dummyd;
+  return kk;
+}
+
+void BiasRepresentation::pushKernel( std::unique_ptr<KernelFunctions> kk, double kbiasf ) {
+  biasf.push_back(kbiasf);
   // if grid is defined then it should be added on the grid
   //cerr<<"now with "<<hills.size()<<endl;
   if(hasgrid) {
@@ -178,10 +190,13 @@ void BiasRepresentation::pushKernel( IFile *ifile ) {
     if(doInt_&&(kk->getCenter()[0]+kk->getContinuousSupport()[0] > uppI_ || kk->getCenter()[0]-kk->getContinuousSupport()[0] < lowI_ )) {
       nneighb=BiasGrid_->getNbin();
     } else nneighb=kk->getSupport(BiasGrid_->getDx());
-    std::vector<Grid::index_t> neighbors=BiasGrid_->getNeighbors(kk->getCenter(),nneighb);
-    std::vector<double> der(ndim);
-    std::vector<double> xx(ndim);
-    if(mycomm.Get_size()==1) {
+    double f=1.0;
+    if(rescaledToBias) f=(biasf.back()-1.)/(biasf.back());
+    if(kk->isVonMises()) {
+      // von Mises kernels need the actual positions
+      std::vector<Grid::index_t> neighbors=BiasGrid_->getNeighbors(kk->getCenter(),nneighb);
+      std::vector<double> der(ndim);
+      std::vector<double> xx(ndim);
       for(unsigned i=0; i<neighbors.size(); ++i) {
         Grid::index_t ineigh=neighbors[i];
         for(int j=0; j<ndim; ++j) {der[j]=0.0;}
@@ -192,47 +207,195 @@ void BiasRepresentation::pushKernel( IFile *ifile ) {
         if(doInt_) bias=kk->evaluate(values,der,true,doInt_,lowI_,uppI_);
         else bias=kk->evaluate(values,der,true);
         if(rescaledToBias) {
-          double f=(biasf.back()-1.)/(biasf.back());
           bias*=f;
           for(int j=0; j<ndim; ++j) {der[j]*=f;}
         }
         BiasGrid_->addValueAndDerivatives(ineigh,bias,der);
       }
     } else {
+      // differences from the center only depend on one coordinate, so they are
+      // computed once per grid line and the kernel is evaluated in parallel
+      std::vector<std::vector<unsigned> > axes;
+      std::vector<std::vector<double> > points;
+      std::vector<double> center(kk->getCenter());
+      BiasGrid_->getNeighborAxes(center,nneighb,axes,points);
+      std::vector<std::vector<double> > dist(ndim);
+      for(int j=0; j<ndim; ++j) {
+        dist[j].resize(points[j].size());
+        for(unsigned k=0; k<points[j].size(); ++k) {
+          double x=points[j][k];
+          if(doInt_) {
+            if(x<lowI_) x=lowI_;
+            if(x>uppI_) x=uppI_;
+          }
+          dist[j][k]=values[j]->difference(x,center[j]);
+        }
+      }
+      std::vector<bool> noder;
+      if(doInt_) {
+        noder.resize(points[0].size());
+        for(unsigned k=0; k<points[0].size(); ++k) noder[k]=(points[0][k]<=lowI_ || points[0][k]>=uppI_);
+      }
+
+      Grid::index_t nneigh=1;
+      for(int j=0; j<ndim; ++j) nneigh*=axes[j].size();
+      std::vector<Grid::index_t> neighbors(nneigh);
+      std::vector<double> allbias(nneigh,0.0);
+      std::vector<double> allder(ndim*nneigh,0.0);
       unsigned stride=mycomm.Get_size();
       unsigned rank=mycomm.Get_rank();
-      std::vector<double> allder(ndim*neighbors.size(),0.0);
-      std::vector<double> allbias(neighbors.size(),0.0);
-      std::vector<double> tmpder(ndim);
-      for(unsigned i=rank; i<neighbors.size(); i+=stride) {
-        Grid::index_t ineigh=neighbors[i];
-        BiasGrid_->getPoint(ineigh,xx);
-        for(int j=0; j<ndim; ++j) {values[j]->set(xx[j]);}
-        if(doInt_) allbias[i]=kk->evaluate(values,der,true,doInt_,lowI_,uppI_);
-        else allbias[i]=kk->evaluate(values,der,true);
-        if(rescaledToBias) {
-          double f=(biasf.back()-1.)/(biasf.back());
-          allbias[i]*=f;
-          for(int j=0; j<ndim; ++j) {tmpder[j]*=f;}
+      unsigned nt=OpenMP::getNumThreads();
+      if(nt*stride*10>nneigh) nt=nneigh/stride/10;
+      if(nt==0) nt=1;
+      #pragma omp parallel num_threads(nt)
+      {
+        std::vector<unsigned> pos(ndim);
+        std::vector<double> dp(ndim);
+        std::vector<double> der(ndim);
+        #pragma omp for
+        for(Grid::index_t i=0; i<nneigh; ++i) {
+          neighbors[i]=BiasGrid_->getAxesNeighbor(i,axes,pos);
+          if(i%stride!=rank) continue;
+          for(int j=0; j<ndim; ++j) dp[j]=dist[j][pos[j]];
+          double bias=kk->evaluate(dp,der);
+          if(doInt_ && noder[pos[0]]) for(int j=0; j<ndim; ++j) der[j]=0.0;
+          if(rescaledToBias) {
+            bias*=f;
+            for(int j=0; j<ndim; ++j) {der[j]*=f;}
+          }
+          allbias[i]=bias;
+          for(int j=0; j<ndim; ++j) allder[ndim*i+j]=der[j];
         }
-        // this solution with the temporary vector is rather bad, probably better to take
-        // a pointer of double as it was in old gaussian
-        for(int j=0; j<ndim; ++j) { allder[ndim*i+j]=tmpder[j]; tmpder[j]=0.;}
       }
-      mycomm.Sum(allbias);
-      mycomm.Sum(allder);
-      for(unsigned i=0; i<neighbors.size(); ++i) {
-        Grid::index_t ineigh=neighbors[i];
+      if(stride>1) {
+        mycomm.Sum(allbias);
+        mycomm.Sum(allder);
+      }
+      // neighbors can be repeated when the support is larger than a periodic grid,
+      // so they are accumulated serially
+      std::vector<double> der(ndim);
+      for(Grid::index_t i=0; i<nneigh; ++i) {
         for(int j=0; j<ndim; ++j) {der[j]=allder[ndim*i+j];}
-        BiasGrid_->addValueAndDerivatives(ineigh,allbias[i],der);
+        BiasGrid_->addValueAndDerivatives(neighbors[i],allbias[i],der);
       }
     }
   }
-  hills.emplace_back(std::move(kk));
+  // once on the grid, the kernel is not needed anymore
+  if(!hasgrid) hills.emplace_back(std::move(kk));
+  nkernels++;
+}
+
+void BiasRepresentation::pushKernels( std::vector<std::unique_ptr<KernelFunctions>> & kk, const std::vector<double> & kbiasf ) {
+  plumed_assert(kk.size()==kbiasf.size());
+  bool isVonMises=false;
+  for(unsigned k=0; k<kk.size(); ++k) if(kk[k]->isVonMises()) isVonMises=true;
+  if(!hasgrid || isVonMises || kk.size()<2) {
+    for(unsigned k=0; k<kk.size(); ++k) pushKernel(std::move(kk[k]),kbiasf[k]);
+    kk.clear();
+    return;
+  }
+  const unsigned nk=kk.size();
+  const unsigned last=ndim-1;
+  unsigned stride=mycomm.Get_size();
+  unsigned rank=mycomm.Get_rank();
+  unsigned nt=OpenMP::getNumThreads();
+
+  // support of each kernel, as in pushKernel()
+  std::vector<std::vector<std::vector<unsigned> > > axes(nk);
+  std::vector<std::vector<std::vector<double> > > dist(nk);
+  std::vector<std::vector<bool> > noder(nk);
+  std::vector<double> scale(nk,1.0);
+  #pragma omp parallel num_threads(nt)
+  {
+    std::vector<std::vector<double> > points;
+    #pragma omp for
+    for(unsigned k=0; k<nk; ++k) {
+      std::vector<double> center(kk[k]->getCenter());
+      std::vector<unsigned> nneighb;
+      if(doInt_&&(center[0]+kk[k]->getContinuousSupport()[0] > uppI_ || center[0]-kk[k]->getContinuousSupport()[0] < lowI_ )) {
+        nneighb=BiasGrid_->getNbin();
+      } else nneighb=kk[k]->getSupport(BiasGrid_->getDx());
+      BiasGrid_->getNeighborAxes(center,nneighb,axes[k],points);
+      dist[k].resize(ndim);
+      for(int j=0; j<ndim; ++j) {
+        dist[k][j].resize(points[j].size());
+        for(unsigned l=0; l<points[j].size(); ++l) {
+          double x=points[j][l];
+          if(doInt_) {
+            if(x<lowI_) x=lowI_;
+            if(x>uppI_) x=uppI_;
+          }
+          dist[k][j][l]=values[j]->difference(x,center[j]);
+        }
+      }
+      if(doInt_) {
+        noder[k].resize(points[0].size());
+        for(unsigned l=0; l<points[0].size(); ++l) noder[k][l]=(points[0][l]<=lowI_ || points[0][l]>=uppI_);
+      }
+      if(rescaledToBias) scale[k]=(kbiasf[k]-1.)/(kbiasf[k]);
+    }
+  }
+
+  // the grid is split in slabs along the last variable, that is the slowest index,
+  // so that each slab is a contiguous block of grid points written by a single thread
+  // and contributions are accumulated in the same order as with pushKernel()
+  const std::vector<unsigned> nbin(BiasGrid_->getNbin());
+  const unsigned nslab=nbin[last];
+  unsigned ntiles=4*nt*stride;
+  if(ntiles>nslab) ntiles=nslab;
+  std::vector<unsigned> tile(nslab);
+  for(unsigned b=0; b<nslab; ++b) tile[b]=(static_cast<unsigned long>(b)*ntiles)/nslab;
+  // with more processes, each of them fills its own slabs and they are summed at the end
+  std::vector<double> delta;
+  if(stride>1) delta.assign(BiasGrid_->getSize()*(ndim+1),0.0);
+
+  #pragma omp parallel num_threads(nt)
+  {
+    std::vector<unsigned> pos(ndim);
+    std::vector<double> dp(ndim);
+    std::vector<double> der(ndim);
+    #pragma omp for schedule(dynamic)
+    for(unsigned t=rank; t<ntiles; t+=stride) {
+      for(unsigned k=0; k<nk; ++k) {
+        const std::vector<std::vector<unsigned> > & ax=axes[k];
+        Grid::index_t ninner=1;
+        for(unsigned j=0; j<last; ++j) ninner*=ax[j].size();
+        for(unsigned l=0; l<ax[last].size(); ++l) {
+          if(tile[ax[last][l]]!=t) continue;
+          for(Grid::index_t i=0; i<ninner; ++i) {
+            Grid::index_t index=BiasGrid_->getAxesNeighbor(i+ninner*l,ax,pos);
+            for(int j=0; j<ndim; ++j) dp[j]=dist[k][j][pos[j]];
+            double bias=kk[k]->evaluate(dp,der);
+            if(doInt_ && noder[k][pos[0]]) for(int j=0; j<ndim; ++j) der[j]=0.0;
+            if(rescaledToBias) {
+              bias*=scale[k];
+              for(int j=0; j<ndim; ++j) der[j]*=scale[k];
+            }
+            if(stride>1) {
+              double* node=&delta[index*(ndim+1)];
+              node[0]+=bias;
+              for(int j=0; j<ndim; ++j) node[1+j]+=der[j];
+            } else BiasGrid_->addValueAndDerivatives(index,bias,der);
+          }
+        }
+      }
+    }
+  }
+  if(stride>1) {
+    mycomm.Sum(delta);
+    std::vector<double> der(ndim);
+    for(Grid::index_t i=0; i<BiasGrid_->getSize(); ++i) {
+      for(int j=0; j<ndim; ++j) der[j]=delta[i*(ndim+1)+1+j];
+      BiasGrid_->addValueAndDerivatives(i,delta[i*(ndim+1)],der);
+    }
+  }
+  for(unsigned k=0; k<nk; ++k) biasf.push_back(kbiasf[k]);
+  nkernels+=nk;
+  kk.clear();
 }
 
 int BiasRepresentation::getNumberOfKernels() {
-  return hills.size();
+  return nkernels;
 }
 
 Grid* BiasRepresentation::getGridPtr() {
@@ -277,6 +440,7 @@ void BiasRepresentation::getMinMaxBin(std::vector<double> &vmin, std::vector<dou
 
 void BiasRepresentation::clear() {
   hills.clear();
+  nkernels=0;
   // clear the grid
   if(hasgrid) {
     BiasGrid_->clear();
@@ -61,6 +61,13 @@ public:
   void 		addGrid(const std::vector<std::string> & gmin, const std::vector<std::string> & gmax, const std::vector<unsigned> & nbin );
   /// push a kernel on the representation (includes widths and height)
   void 		pushKernel( IFile * ff);
+  /// push a kernel that has already been read, together with its bias factor
+  void 		pushKernel( std::unique_ptr<KernelFunctions> kk, double kbiasf );
+  /// push a block of kernels at once: the grid is split in slabs that are filled in parallel,
+  /// each of them only visiting the kernels whose support overlaps it. The vector of kernels is emptied
+  void 		pushKernels( std::vector<std::unique_ptr<KernelFunctions>> & kk, const std::vector<double> & kbiasf );
+  /// read a kernel and its bias factor from a file, without pushing it
+  std::unique_ptr<KernelFunctions> readKernel( IFile * ff, double & kbiasf );
   /// set the flag that rescales the free energy to the bias
   void 		setRescaledToBias(bool rescaled);
   /// check if the representation is rescaled to the bias
@@ -94,7 +101,9 @@ private:
   double uppI_;
   std::vector<Value*> values;
   std::vector<std::string> names;
+/// kernels are only stored when there is no grid
   std::vector<std::unique_ptr<KernelFunctions>> hills;
+  unsigned nkernels;
   std::vector<double> biasf;
   std::vector<double> histosigma;
   Communicator& mycomm;
@@ -0,0 +1,242 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2021 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "BinaryHills.h"
+#include "Exception.h"
+#include "Matrix.h"
+#include "OFile.h"
+#include "Tools.h"
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __PLUMED_HAS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace PLMD {
+
+namespace {
+/// First bytes of a binary hills file, the last character is the version of the format
+const char binaryHillsMagic[8]= {'P','L','M','D','H','L','S','1'};
+/// The magic string is followed by the offset of the first record, stored as a 64 bit integer
+const std::size_t binaryHillsPrefix=sizeof(binaryHillsMagic)+sizeof(std::uint64_t);
+}
+
+unsigned BinaryHills::Header::getNumberOfSigmas() const {
+  unsigned ncv=names.size();
+  return (multivariate?(ncv*(ncv+1))/2:ncv);
+}
+
+unsigned BinaryHills::Header::getRecordSize() const {
+// time, center, sigma, height and biasf
+  return 1+names.size()+getNumberOfSigmas()+2;
+}
+
+void BinaryHills::Header::addArgument(const std::string& name,const std::string& min,const std::string& max) {
+  plumed_massert(name.find_first_of(" \t\n")==std::string::npos,"variable names cannot contain spaces");
+  names.push_back(name);
+  this->min.push_back(min);
+  this->max.push_back(max);
+}
+
+std::string BinaryHills::Header::difference(const Header& other) const {
+  if(names.size()!=other.names.size()) return "different number of variables";
+  for(unsigned i=0; i<names.size(); i++) {
+    if(names[i]!=other.names[i]) return "variable "+other.names[i]+" instead of "+names[i];
+    if(min[i]!=other.min[i] || max[i]!=other.max[i]) return "different periodicity for variable "+names[i];
+  }
+  if(multivariate!=other.multivariate) return "different multivariate flag";
+  if(lower_int!=other.lower_int || upper_int!=other.upper_int) return "different interval";
+  return "";
+}
+
+bool BinaryHills::isBinary(const std::string& path) {
+  char magic[sizeof(binaryHillsMagic)];
+  FILE* fp=std::fopen(path.c_str(),"rb");
+  if(!fp) return false;
+  std::size_t n=std::fread(magic,1,sizeof(magic),fp);
+  std::fclose(fp);
+  return n==sizeof(magic) && std::memcmp(magic,binaryHillsMagic,sizeof(magic))==0;
+}
+
+void BinaryHills::writeHeader(OFile& ofile,const Header& header) {
+  std::string text;
+  text+="multivariate "+std::string(header.multivariate?"true":"false")+"\n";
+  for(unsigned i=0; i<header.names.size(); i++) {
+    text+="cv "+header.names[i];
+    if(header.isPeriodic(i)) text+=" "+header.min[i]+" "+header.max[i];
+    text+="\n";
+  }
+  if(header.lower_int.length()>0) text+="interval "+header.lower_int+" "+header.upper_int+"\n";
+// records are aligned to double
+  while((binaryHillsPrefix+text.length())%sizeof(double)!=0) text+="\n";
+  std::uint64_t offset=binaryHillsPrefix+text.length();
+  ofile.write(binaryHillsMagic,sizeof(binaryHillsMagic));
+  ofile.write(&offset,sizeof(offset));
+  ofile.write(text.c_str(),text.length());
+}
+
+void BinaryHills::writeRecord(OFile& ofile,const std::vector<double>& record) {
+  ofile.write(record.data(),sizeof(double)*record.size());
+}
+
+void BinaryHills::truncate(const std::string& path) {
+  std::size_t size;
+  std::size_t filesize;
+  {
+    BinaryHills hills(path);
+    size=hills.offset+sizeof(double)*hills.nrecords*hills.header.getRecordSize();
+    filesize=hills.filesize;
+  }
+  if(filesize==size) return;
+#ifdef __PLUMED_HAS_MMAP
+  int r=::truncate(path.c_str(),size);
+  plumed_massert(r==0,"cannot truncate file "+path);
+#else
+// rewrite the complete records
+  std::vector<char> content(size);
+  FILE* fp=std::fopen(path.c_str(),"rb");
+  plumed_massert(fp,"cannot open file "+path);
+  std::size_t nread=std::fread(content.data(),1,size,fp);
+  std::fclose(fp);
+  plumed_massert(nread==size,"cannot read file "+path);
+  fp=std::fopen(path.c_str(),"wb");
+  plumed_massert(fp,"cannot open file "+path);
+  std::size_t nwritten=std::fwrite(content.data(),1,size,fp);
+  std::fclose(fp);
+  plumed_massert(nwritten==size,"cannot write file "+path);
+#endif
+}
+
+BinaryHills::BinaryHills(const std::string& path):
+  path(path),
+  map(nullptr),
+  mapsize(0),
+  data(nullptr),
+  offset(0),
+  nrecords(0),
+  filesize(0)
+{
+  const char* ptr=nullptr;
+  std::size_t size=0;
+#ifdef __PLUMED_HAS_MMAP
+  int fd=::open(path.c_str(),O_RDONLY);
+  plumed_massert(fd>=0,"cannot open file "+path);
+  struct stat st;
+  if(::fstat(fd,&st)!=0) {
+    ::close(fd);
+    plumed_merror("cannot stat file "+path);
+  }
+  size=st.st_size;
+  if(size>0) {
+    void* p=::mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    plumed_massert(p!=MAP_FAILED,"cannot map file "+path);
+    map=p;
+    mapsize=size;
+// records are read once and in order
+    ::madvise(map,mapsize,MADV_SEQUENTIAL);
+  } else ::close(fd);
+  ptr=static_cast<const char*>(map);
+#else
+  FILE* fp=std::fopen(path.c_str(),"rb");
+  plumed_massert(fp,"cannot open file "+path);
+  std::fseek(fp,0,SEEK_END);
+  size=std::ftell(fp);
+  std::fseek(fp,0,SEEK_SET);
+  buffer.resize((size+sizeof(double)-1)/sizeof(double));
+  std::size_t nread=std::fread(buffer.data(),1,size,fp);
+  std::fclose(fp);
+  plumed_massert(nread==size,"cannot read file "+path);
+  ptr=reinterpret_cast<const char*>(buffer.data());
+#endif
+  filesize=size;
+  readHeader(ptr,size);
+}
+
+BinaryHills::~BinaryHills() {
+#ifdef __PLUMED_HAS_MMAP
+  if(map) ::munmap(map,mapsize);
+#endif
+}
+
+void BinaryHills::readHeader(const char* ptr,std::size_t size) {
+  plumed_massert(size>=binaryHillsPrefix && std::memcmp(ptr,binaryHillsMagic,sizeof(binaryHillsMagic))==0,"file "+path+" is not a binary hills file");
+  std::uint64_t offset;
+  std::memcpy(&offset,ptr+sizeof(binaryHillsMagic),sizeof(offset));
+  this->offset=offset;
+  plumed_massert(offset>=binaryHillsPrefix && offset<=size && offset%sizeof(double)==0,"corrupted header in file "+path);
+  std::string text(ptr+binaryHillsPrefix,offset-binaryHillsPrefix);
+  std::size_t start=0;
+  while(start<text.length()) {
+    std::size_t end=text.find('\n',start);
+    if(end==std::string::npos) end=text.length();
+    const std::string line=text.substr(start,end-start);
+    std::vector<std::string> words=Tools::getWords(line);
+    start=end+1;
+    if(words.size()==0) continue;
+    if(words[0]=="multivariate" && words.size()==2) header.multivariate=(words[1]=="true");
+    else if(words[0]=="cv" && words.size()==2) header.addArgument(words[1]);
+    else if(words[0]=="cv" && words.size()==4) header.addArgument(words[1],words[2],words[3]);
+    else if(words[0]=="interval" && words.size()==3) {
+      header.lower_int=words[1];
+      header.upper_int=words[2];
+    } else plumed_merror("cannot parse header line '"+line+"' in file "+path);
+  }
+  plumed_massert(header.names.size()>0,"no variables in the header of file "+path);
+  data=reinterpret_cast<const double*>(ptr+offset);
+  nrecords=(size-offset)/(sizeof(double)*header.getRecordSize());
+}
+
+void BinaryHills::getSigma(std::size_t i,std::vector<double>& sigma) const {
+  const unsigned ncv=header.getNumberOfArguments();
+  const double* filesigma=getFileSigma(i);
+  sigma.resize(header.getNumberOfSigmas());
+  if(!header.multivariate) {
+    for(unsigned j=0; j<ncv; j++) sigma[j]=filesigma[j];
+    return;
+  }
+// same as for text files, see MetaD::scanOneHill() and KernelFunctions::read()
+  Matrix<double> upper(ncv,ncv), lower(ncv,ncv), mymult(ncv,ncv), invmatrix(ncv,ncv);
+  unsigned k=0;
+  for(unsigned l=0; l<ncv; l++) {
+    for(unsigned j=0; j<ncv-l; j++) {
+      lower(j+l,j)=filesigma[k];
+      upper(j,j+l)=filesigma[k];
+      k++;
+    }
+  }
+  mult(lower,upper,mymult);
+  Invert(mymult,invmatrix);
+  k=0;
+  for(unsigned l=0; l<ncv; l++) {
+    for(unsigned j=l; j<ncv; j++) {
+      sigma[k]=invmatrix(l,j);
+      k++;
+    }
+  }
+}
+
+}
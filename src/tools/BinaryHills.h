@@ -0,0 +1,121 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2021 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_tools_BinaryHills_h
+#define __PLUMED_tools_BinaryHills_h
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace PLMD {
+
+class OFile;
+
+/// \ingroup TOOLBOX
+/// Binary version of the hills files written by METAD.
+///
+/// The file starts with a short header, which describes the variables, their periodicity
+/// and whether the hills are multivariate. It is followed by fixed size records, each of them
+/// containing the same numbers as a line of a text hills file, in the same order:
+/// time, center, sigma, height and bias factor.
+/// For multivariate hills, sigma is the lower triangular Cholesky factor in band form,
+/// exactly as in text files, so that files can be converted back and forth without loss.
+///
+/// Files are written through an OFile, so that the usual backup and restart rules apply,
+/// and read in a single shot, using a memory map when available.
+/// Binary files cannot be compressed, since they are read directly and not through an IFile.
+/// A truncated record at the end of the file (e.g. after a crash) is ignored, and is removed
+/// with truncate() before appending new records.
+class BinaryHills {
+public:
+/// Description of the hills, stored at the beginning of the file
+  class Header {
+  public:
+    std::vector<std::string> names;
+/// Domain of each variable, empty strings for non periodic ones
+    std::vector<std::string> min;
+    std::vector<std::string> max;
+    bool multivariate;
+/// Interval for hills in one dimension, empty if not used
+    std::string lower_int;
+    std::string upper_int;
+    Header(): multivariate(false) {}
+    unsigned getNumberOfArguments() const { return names.size(); }
+    bool isPeriodic(unsigned i) const { return min[i].length()>0; }
+/// Number of sigma elements in a record
+    unsigned getNumberOfSigmas() const;
+/// Number of doubles in a record
+    unsigned getRecordSize() const;
+/// Add a variable
+    void addArgument(const std::string& name,const std::string& min="",const std::string& max="");
+/// Describe the first difference with another header, empty if records written with the two headers are the same
+    std::string difference(const Header& other) const;
+  };
+private:
+  Header header;
+  std::string path;
+  void* map;
+  std::size_t mapsize;
+/// Used when memory maps are not available
+  std::vector<double> buffer;
+/// Pointer to the first record
+  const double* data;
+/// Position of the first record in the file
+  std::size_t offset;
+  std::size_t nrecords;
+/// Size of the file, including an incomplete record at the end
+  std::size_t filesize;
+  void readHeader(const char* ptr,std::size_t size);
+public:
+/// Check if a file is in binary format.
+/// The file is read directly, so that a compressed file is never recognized as binary
+  static bool isBinary(const std::string& path);
+/// Remove an incomplete record at the end of a file, so that new records can be appended to it
+  static void truncate(const std::string& path);
+/// Write the header at the beginning of an empty file
+  static void writeHeader(OFile& ofile,const Header& header);
+/// Write a record, which should have header.getRecordSize() elements
+  static void writeRecord(OFile& ofile,const std::vector<double>& record);
+/// Load a file
+  explicit BinaryHills(const std::string& path);
+  ~BinaryHills();
+  BinaryHills(const BinaryHills&) = delete;
+  BinaryHills& operator=(const BinaryHills&) = delete;
+  const Header& getHeader() const { return header; }
+/// Number of hills in the file
+  std::size_t size() const { return nrecords; }
+/// Pointer to a full record
+  const double* getRecord(std::size_t i) const { return data+i*header.getRecordSize(); }
+  double getTime(std::size_t i) const { return getRecord(i)[0]; }
+  const double* getCenter(std::size_t i) const { return getRecord(i)+1; }
+/// Sigma as stored in the file
+  const double* getFileSigma(std::size_t i) const { return getRecord(i)+1+header.getNumberOfArguments(); }
+/// Sigma as used by METAD and KernelFunctions, that is the upper triangle of the
+/// inverse covariance matrix for multivariate hills
+  void getSigma(std::size_t i,std::vector<double>& sigma) const;
+  double getHeight(std::size_t i) const { return getRecord(i)[header.getRecordSize()-2]; }
+  double getBiasFactor(std::size_t i) const { return getRecord(i)[header.getRecordSize()-1]; }
+};
+
+}
+
+#endif
@@ -170,6 +170,20 @@ Communicator::Request Communicator::Isend(ConstData data,int source,int tag) {
   return req;
 }
 
+Communicator::Request Communicator::Irecv(Data data,int source,int tag) {
+  Request req;
+#ifdef __PLUMED_HAS_MPI
+  plumed_massert(initialized(),"you are trying to use an MPI function, but MPI is not initialized");
+  MPI_Irecv(data.pointer,data.size,data.type,source,tag,communicator,&req.r);
+#else
+  (void) data;
+  (void) source;
+  (void) tag;
+  plumed_merror("you are trying to use an MPI function, but PLUMED has been compiled without MPI support");
+#endif
+  return req;
+}
+
 void Communicator::Allgatherv(ConstData in,Data out,const int*recvcounts,const int*displs) {
   void*s=const_cast<void*>((const void*)in.pointer);
   void*r=const_cast<void*>((const void*)out.pointer);
@@ -261,6 +275,25 @@ void Communicator::Request::wait(Status&s) {
 #endif
 }
 
+int Communicator::Waitany(std::vector<Request>&reqs,Status&s) {
+#ifdef __PLUMED_HAS_MPI
+  plumed_massert(initialized(),"you are trying to use an MPI function, but MPI is not initialized");
+  std::vector<MPI_Request> r(reqs.size());
+  for(unsigned i=0; i<reqs.size(); i++) r[i]=reqs[i].r;
+  int index=MPI_UNDEFINED;
+  if(&s==&StatusIgnore) MPI_Waitany(r.size(),r.data(),&index,MPI_STATUS_IGNORE);
+  else MPI_Waitany(r.size(),r.data(),&index,&s.s);
+// completed requests are set to MPI_REQUEST_NULL
+  for(unsigned i=0; i<reqs.size(); i++) reqs[i].r=r[i];
+  if(index==MPI_UNDEFINED) return -1;
+  return index;
+#else
+  (void) reqs;
+  (void) s;
+  plumed_merror("you are trying to use an MPI function, but PLUMED has been compiled without MPI support");
+#endif
+}
+
 #ifdef __PLUMED_HAS_MPI
 template<> MPI_Datatype Communicator::getMPIType<float>() { return MPI_FLOAT;}
 template<> MPI_Datatype Communicator::getMPIType<double>() { return MPI_DOUBLE;}
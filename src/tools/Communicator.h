@@ -139,6 +139,9 @@ public:
     MPI_Request r;
     void wait(Status&s=StatusIgnore);
   };
+/// Wrapper for MPI_Waitany. Waits for one of the requests to complete and returns its index,
+/// or -1 if all of them have already been completed
+  static int Waitany(std::vector<Request>&reqs,Status&s=StatusIgnore);
 /// Default constructor
   Communicator();
 /// Copy constructor.
@@ -210,6 +213,13 @@ public:
 /// Wrapper for MPI_Isend (reference)
   template <class T> Request Isend(const T&buf,int source,int tag) {return Isend(ConstData(buf),source,tag);}
 
+/// Wrapper for MPI_Irecv (data struct)
+  Request Irecv(Data,int,int);
+/// Wrapper for MPI_Irecv (pointer)
+  template <class T> Request Irecv(T*buf,int count,int source,int tag) {return Irecv(Data(buf,count),source,tag);}
+/// Wrapper for MPI_Irecv (reference)
+  template <class T> Request Irecv(T&buf,int source,int tag) {return Irecv(Data(buf),source,tag);}
+
 /// Wrapper for MPI_Allgatherv (data struct)
   void Allgatherv(ConstData in,Data out,const int*,const int*);
 /// Wrapper for MPI_Allgatherv (pointer)
@@ -0,0 +1,75 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2021 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "GaussianBatch.h"
+#include "Exception.h"
+
+#include <cmath>
+#include <limits>
+
+namespace PLMD {
+
+GaussianBatch::GaussianBatch(unsigned ncv):
+  ncv_(ncv),
+  period_(ncv,0.0),
+  invperiod_(ncv,0.0),
+  cutoff2_(std::numeric_limits<double>::max()),
+  shift_(0.0)
+{
+}
+
+void GaussianBatch::setPeriodicity(unsigned i,double period) {
+  plumed_assert(i<ncv_ && period>0);
+  period_[i]=period;
+  invperiod_[i]=1.0/period;
+}
+
+void GaussianBatch::setCutoff(double cutoff2,double shift) {
+  cutoff2_=cutoff2;
+  shift_=shift;
+}
+
+void GaussianBatch::evaluate(const double* center,const double* invsigma,double height,
+                             const double* points,std::size_t npoints,double* out) const {
+  const unsigned ncv=ncv_;
+  const double* period=period_.data();
+  const double* invperiod=invperiod_.data();
+  const double cutoff2=cutoff2_;
+  const double shift=shift_;
+  #pragma omp simd
+  for(std::size_t p=0; p<npoints; p++) {
+    const double* x=points+p*ncv;
+    double norm2=0.0;
+    for(unsigned i=0; i<ncv; i++) {
+      double d=x[i]-center[i];
+      if(period[i]>0) {
+        // same as Tools::pbc(), written without branches
+        const double s=d*invperiod[i]+100.0;
+        d=(s-std::floor(s+0.5))*period[i];
+      }
+      d*=invsigma[i];
+      norm2+=d*d;
+    }
+    if(norm2<cutoff2) out[p]+=height*(std::exp(-0.5*norm2)-shift);
+  }
+}
+
+}
@@ -0,0 +1,59 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2021 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_tools_GaussianBatch_h
+#define __PLUMED_tools_GaussianBatch_h
+
+#include <cstddef>
+#include <vector>
+
+namespace PLMD {
+
+/// \ingroup TOOLBOX
+/// Evaluation of diagonal Gaussian kernels on many points at once.
+///
+/// Points are stored one after the other in a single array, so that the loop over points
+/// is a plain loop over memory that the compiler can vectorize. This is much faster than
+/// evaluating the kernels one point at a time when the same kernel has to be computed
+/// on a whole set of points, e.g. on all the centers of the other kernels.
+/// Differences along periodic variables are computed as in Value::difference().
+class GaussianBatch {
+  unsigned ncv_;
+/// period of each variable, zero if not periodic
+  std::vector<double> period_;
+  std::vector<double> invperiod_;
+  double cutoff2_;
+  double shift_;
+public:
+  explicit GaussianBatch(unsigned ncv=0);
+  unsigned getDimension() const { return ncv_; }
+  void setPeriodicity(unsigned i,double period);
+/// Kernels vanish where the squared distance from the center, in units of sigma, is equal or larger than cutoff2.
+/// Inside the cutoff, shift times the height is subtracted from the Gaussian
+  void setCutoff(double cutoff2,double shift=0.0);
+/// Add height*(exp(-0.5*d^2)-shift) to out for each of the npoints points
+  void evaluate(const double* center,const double* invsigma,double height,
+                const double* points,std::size_t npoints,double* out) const;
+};
+
+}
+
+#endif
@@ -28,6 +28,7 @@
 #include "KernelFunctions.h"
 #include "RootFindingBase.h"
 #include "Communicator.h"
+#include "OpenMP.h"
 
 #include <vector>
 #include <cmath>
@@ -36,6 +37,9 @@
 #include <cstdio>
 #include <cfloat>
 #include <array>
+#include <algorithm>
+#include <type_traits>
+#include <limits>
 
 namespace PLMD {
 
@@ -177,7 +181,18 @@ GridBase::index_t GridBase::getIndex(const std::vector<unsigned> & indices) cons
 
 GridBase::index_t GridBase::getIndex(const std::vector<double> & x) const {
   plumed_dbg_assert(x.size()==dimension_);
-  return getIndex(getIndices(x));
+// this is called at every step by biases using grids, so indices are kept on the stack
+  std::array<unsigned,maxdim> indices;
+  for(unsigned int i=0; i<dimension_; ++i) {
+    indices[i] = unsigned(std::floor((x[i]-min_[i])/dx_[i]));
+// let the other implementation report the error
+    if(indices[i]>=nbin_[i]) return getIndex(getIndices(x));
+  }
+  index_t index=indices[dimension_-1];
+  for(unsigned int i=dimension_-1; i>0; --i) {
+    index=index*nbin_[i-1]+indices[i-1];
+  }
+  return index;
 }
 
 // we are flattening arrays using a column-major order
@@ -303,6 +318,43 @@ std::vector<GridBase::index_t> GridBase::getNeighbors(const std::vector<unsigned
   return neighbors;
 }
 
+void GridBase::getNeighborAxes(const std::vector<double> & x,const std::vector<unsigned> & nneigh,
+                               std::vector<std::vector<unsigned> > & axes,std::vector<std::vector<double> > & points)const {
+  plumed_dbg_assert(x.size()==dimension_ && nneigh.size()==dimension_);
+  std::vector<unsigned> indices(getIndices(x));
+  axes.resize(dimension_);
+  points.resize(dimension_);
+// same images as in getNeighbors(), including repetitions for periodic
+// dimensions when the support is larger than the grid
+  for(unsigned i=0; i<dimension_; ++i) {
+    axes[i].clear();
+    points[i].clear();
+    for(unsigned k=0; k<2*nneigh[i]+1; ++k) {
+      int i0=k-nneigh[i]+indices[i];
+      if(!pbc_[i] && i0<0)         continue;
+      if(!pbc_[i] && i0>=static_cast<int>(nbin_[i])) continue;
+      if( pbc_[i] && i0<0)         i0=(nbin_[i]-(-i0)%nbin_[i])%nbin_[i];
+      if( pbc_[i] && i0>=static_cast<int>(nbin_[i])) i0%=nbin_[i];
+      axes[i].push_back(static_cast<unsigned>(i0));
+      points[i].push_back(min_[i]+(double)(i0)*dx_[i]);
+    }
+  }
+}
+
+GridBase::index_t GridBase::getAxesNeighbor(index_t k,const std::vector<std::vector<unsigned> > & axes,std::vector<unsigned> & pos)const {
+  plumed_dbg_assert(axes.size()==dimension_ && pos.size()==dimension_);
+  index_t kk=k;
+  for(unsigned i=0; i<dimension_; ++i) {
+    pos[i]=kk%axes[i].size();
+    kk/=axes[i].size();
+  }
+  index_t index=axes[dimension_-1][pos[dimension_-1]];
+  for(unsigned int i=dimension_-1; i>0; --i) {
+    index=index*nbin_[i-1]+axes[i-1][pos[i-1]];
+  }
+  return index;
+}
+
 std::vector<GridBase::index_t> GridBase::getNeighbors(const std::vector<double> & x,const std::vector<unsigned> & nneigh)const {
   plumed_dbg_assert(x.size()==dimension_ && nneigh.size()==dimension_);
   return getNeighbors(getIndices(x),nneigh);
@@ -484,8 +536,7 @@ void GridBase::writeHeader(OFile& ofile) {
 }
 
 void Grid::clear() {
-  grid_.assign(maxsize_,0.0);
-  if(usederiv_) der_.assign(maxsize_*dimension_,0.0);
+  grid_.assign(maxsize_*nodesize_,0.0);
 }
 
 void Grid::writeToFile(OFile& ofile) {
@@ -536,8 +587,8 @@ void GridBase::writeCubeFile(OFile& ofile, const double& lunit) {
 
 std::unique_ptr<GridBase> GridBase::create(const std::string& funcl, const std::vector<Value*> & args, IFile& ifile,
     const std::vector<std::string> & gmin,const std::vector<std::string> & gmax,
-    const std::vector<unsigned> & nbin,bool dosparse, bool dospline, bool doder) {
-  std::unique_ptr<GridBase> grid=GridBase::create(funcl,args,ifile,dosparse,dospline,doder);
+    const std::vector<unsigned> & nbin,bool dosparse, bool dospline, bool doder, bool dofloat, bool storederiv) {
+  std::unique_ptr<GridBase> grid=GridBase::create(funcl,args,ifile,dosparse,dospline,doder,dofloat,storederiv);
   std::vector<unsigned> cbin( grid->getNbin() );
   std::vector<std::string> cmin( grid->getMin() ), cmax( grid->getMax() );
   for(unsigned i=0; i<args.size(); ++i) {
@@ -552,7 +603,8 @@ std::unique_ptr<GridBase> GridBase::create(const std::string& funcl, const std::
   return grid;
 }
 
-std::unique_ptr<GridBase> GridBase::create(const std::string& funcl, const std::vector<Value*> & args, IFile& ifile, bool dosparse, bool dospline, bool doder)
+std::unique_ptr<GridBase> GridBase::create(const std::string& funcl, const std::vector<Value*> & args, IFile& ifile, bool dosparse, bool dospline, bool doder,
+    bool dofloat, bool storederiv)
 {
   std::unique_ptr<GridBase> grid;
   unsigned nvar=args.size(); bool hasder=false; std::string pstring;
@@ -588,8 +640,10 @@ std::unique_ptr<GridBase> GridBase::create(const std::string& funcl, const std::
     }
   }
 
-  if(!dosparse) {grid=Tools::make_unique<Grid>(funcl,args,gmin,gmax,gbin,dospline,doder);}
-  else {grid=Tools::make_unique<SparseGrid>(funcl,args,gmin,gmax,gbin,dospline,doder);}
+  if(dosparse) {grid=Tools::make_unique<SparseGrid>(funcl,args,gmin,gmax,gbin,dospline,doder);}
+  else if(dofloat) {grid=Tools::make_unique<CompactGrid<float>>(funcl,args,gmin,gmax,gbin,dospline,doder,storederiv);}
+  else if(!storederiv) {grid=Tools::make_unique<CompactGrid<double>>(funcl,args,gmin,gmax,gbin,dospline,doder,storederiv);}
+  else {grid=Tools::make_unique<Grid>(funcl,args,gmin,gmax,gbin,dospline,doder);}
 
   std::vector<double> xx(nvar),dder(nvar);
   std::vector<double> dx=grid->getDx();
@@ -614,8 +668,8 @@ std::unique_ptr<GridBase> GridBase::create(const std::string& funcl, const std::
 double Grid::getMinValue() const {
   double minval;
   minval=DBL_MAX;
-  for(index_t i=0; i<grid_.size(); ++i) {
-    if(grid_[i]<minval)minval=grid_[i];
+  for(index_t i=0; i<maxsize_; ++i) {
+    if(grid_[i*nodesize_]<minval)minval=grid_[i*nodesize_];
   }
   return minval;
 }
@@ -623,48 +677,35 @@ double Grid::getMinValue() const {
 double Grid::getMaxValue() const {
   double maxval;
   maxval=DBL_MIN;
-  for(index_t i=0; i<grid_.size(); ++i) {
-    if(grid_[i]>maxval)maxval=grid_[i];
+  for(index_t i=0; i<maxsize_; ++i) {
+    if(grid_[i*nodesize_]>maxval)maxval=grid_[i*nodesize_];
   }
   return maxval;
 }
 
 void Grid::scaleAllValuesAndDerivatives( const double& scalef ) {
-  if(usederiv_) {
-    for(index_t i=0; i<grid_.size(); ++i) {
-      grid_[i]*=scalef;
-      for(unsigned j=0; j<dimension_; ++j) der_[i*dimension_+j]*=scalef;
-    }
-  } else {
-    for(index_t i=0; i<grid_.size(); ++i) grid_[i]*=scalef;
-  }
+  for(index_t i=0; i<grid_.size(); ++i) grid_[i]*=scalef;
 }
 
 void Grid::logAllValuesAndDerivatives( const double& scalef ) {
-  if(usederiv_) {
-    for(index_t i=0; i<grid_.size(); ++i) {
-      grid_[i] = scalef*std::log(grid_[i]);
-      for(unsigned j=0; j<dimension_; ++j) der_[i*dimension_+j] = scalef/der_[i*dimension_+j];
-    }
-  } else {
-    for(index_t i=0; i<grid_.size(); ++i) grid_[i] = scalef*std::log(grid_[i]);
+  for(index_t i=0; i<maxsize_; ++i) {
+    double* node=&grid_[i*nodesize_];
+    node[0] = scalef*std::log(node[0]);
+    for(unsigned j=1; j<nodesize_; ++j) node[j] = scalef/node[j];
   }
 }
 
 void Grid::setMinToZero() {
   double min=grid_[0];
-  for(index_t i=1; i<grid_.size(); ++i) if(grid_[i]<min) min=grid_[i];
-  for(index_t i=0; i<grid_.size(); ++i) grid_[i] -= min;
+  for(index_t i=1; i<maxsize_; ++i) if(grid_[i*nodesize_]<min) min=grid_[i*nodesize_];
+  for(index_t i=0; i<maxsize_; ++i) grid_[i*nodesize_] -= min;
 }
 
 void Grid::applyFunctionAllValuesAndDerivatives( double (*func)(double val), double (*funcder)(double valder) ) {
-  if(usederiv_) {
-    for(index_t i=0; i<grid_.size(); ++i) {
-      grid_[i]=func(grid_[i]);
-      for(unsigned j=0; j<dimension_; ++j) der_[i*dimension_+j]=funcder(der_[i*dimension_+j]);
-    }
-  } else {
-    for(index_t i=0; i<grid_.size(); ++i) grid_[i]=func(grid_[i]);
+  for(index_t i=0; i<maxsize_; ++i) {
+    double* node=&grid_[i*nodesize_];
+    node[0]=func(node[0]);
+    for(unsigned j=1; j<nodesize_; ++j) node[j]=funcder(node[j]);
   }
 }
 
@@ -723,14 +764,87 @@ Grid::index_t Grid::getSize() const {
 
 double Grid::getValue(index_t index) const {
   plumed_dbg_assert(index<maxsize_);
-  return grid_[index];
+  return grid_[index*nodesize_];
 }
 
 double Grid::getValueAndDerivatives(index_t index, std::vector<double>& der) const {
   plumed_dbg_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
   der.resize(dimension_);
-  for(unsigned i=0; i<dimension_; i++) der[i]=der_[dimension_*index+i];
-  return grid_[index];
+  const double* node=&grid_[index*nodesize_];
+  for(unsigned i=0; i<dimension_; i++) der[i]=node[1+i];
+  return node[0];
+}
+
+double Grid::getValueAndDerivatives(const std::vector<double> & x, std::vector<double>& der) const {
+  if(dospline_) {
+    switch(dimension_) {
+    case 1: return getSplineValueAndDerivatives<1>(x,der);
+    case 2: return getSplineValueAndDerivatives<2>(x,der);
+    case 3: return getSplineValueAndDerivatives<3>(x,der);
+    }
+  }
+  return GridBase::getValueAndDerivatives(x,der);
+}
+
+// Same algorithm as GridBase::getValueAndDerivatives(), with the loops
+// unrolled at compile time and direct access to the interleaved storage.
+// Operations are done in the same order, so that results are identical.
+template<unsigned dim>
+double Grid::getSplineValueAndDerivatives(const std::vector<double> & x, std::vector<double>& der) const {
+  plumed_dbg_assert(x.size()==dim && der.size()==dim && usederiv_);
+  std::array<unsigned,dim> indices;
+  std::array<double,dim> xfloor;
+  for(unsigned j=0; j<dim; ++j) {
+    indices[j]=unsigned(std::floor((x[j]-min_[j])/dx_[j]));
+// points outside the grid are reported by the generic implementation
+    if(indices[j]>=nbin_[j]) return GridBase::getValueAndDerivatives(x,der);
+    xfloor[j]=min_[j]+(double)(indices[j])*dx_[j];
+  }
+
+  double value=0.0;
+  for(unsigned j=0; j<dim; ++j) der[j]=0.0;
+
+  std::array<double,dim> fd, C, D;
+  std::array<unsigned,dim> nindices;
+  for(unsigned ipoint=0; ipoint<(1u<<dim); ++ipoint) {
+    bool inside=true;
+    for(unsigned j=0; j<dim; ++j) {
+      unsigned i0=((ipoint>>j)&1u)+indices[j];
+      if(i0==nbin_[j]) {
+        if(!pbc_[j]) { inside=false; break; }
+        i0=0;
+      }
+      nindices[j]=i0;
+    }
+    if(!inside) continue;
+    index_t index=nindices[dim-1];
+    for(unsigned i=dim-1; i>0; --i) index=index*nbin_[i-1]+nindices[i-1];
+    const double* node=&grid_[index*nodesize_];
+    const double grid=node[0];
+    double ff=1.0;
+    for(unsigned j=0; j<dim; ++j) {
+      int x0=1;
+      if(nindices[j]==indices[j]) x0=0;
+      double dx=dx_[j];
+      double X=std::abs((x[j]-xfloor[j])/dx-(double)x0);
+      double X2=X*X;
+      double X3=X2*X;
+      double yy;
+      if(std::abs(grid)<0.0000001) yy=0.0;
+      else yy=-node[1+j]/grid;
+      C[j]=(1.0-3.0*X2+2.0*X3) - (x0?-1.0:1.0)*yy*(X-2.0*X2+X3)*dx;
+      D[j]=( -6.0*X +6.0*X2) - (x0?-1.0:1.0)*yy*(1.0-4.0*X +3.0*X2)*dx;
+      D[j]*=(x0?-1.0:1.0)/dx;
+      ff*=C[j];
+    }
+    for(unsigned j=0; j<dim; ++j) {
+      fd[j]=D[j];
+      for(unsigned i=0; i<dim; ++i) if(i!=j) fd[j]*=C[i];
+    }
+    value+=grid*ff;
+    for(unsigned j=0; j<dim; ++j) der[j]+=grid*fd[j];
+  }
+  return value;
 }
 
 void Grid::setValue(index_t index, double value) {
@@ -740,8 +854,9 @@ void Grid::setValue(index_t index, double value) {
 
 void Grid::setValueAndDerivatives(index_t index, double value, std::vector<double>& der) {
   plumed_dbg_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  grid_[index]=value;
-  for(unsigned i=0; i<dimension_; i++) der_[dimension_*index+i]=der[i];
+  double* node=&grid_[index*nodesize_];
+  node[0]=value;
+  for(unsigned i=0; i<dimension_; i++) node[1+i]=der[i];
 }
 
 void Grid::addValue(index_t index, double value) {
@@ -751,58 +866,103 @@ void Grid::addValue(index_t index, double value) {
 
 void Grid::addValueAndDerivatives(index_t index, double value, std::vector<double>& der) {
   plumed_dbg_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  grid_[index]+=value;
-  for(unsigned int i=0; i<dimension_; ++i) der_[index*dimension_+i]+=der[i];
+  double* node=&grid_[index*nodesize_];
+  node[0]+=value;
+  for(unsigned int i=0; i<dimension_; ++i) node[1+i]+=der[i];
 }
 
 Grid::index_t SparseGrid::getSize() const {
-  return map_.size();
+  return npoints_;
 }
 
 Grid::index_t SparseGrid::getMaxSize() const {
   return maxsize_;
 }
 
+std::size_t SparseGrid::findSlot(index_t block) const {
+  const std::size_t mask=table_.size()-1;
+// Fibonacci hashing, so that consecutive blocks are spread over the table
+  std::size_t slot=static_cast<std::size_t>((static_cast<std::uint64_t>(block)*UINT64_C(11400714819323198485))>>32)&mask;
+  while(table_[slot]!=0 && keys_[table_[slot]-1]!=block) slot=(slot+1)&mask;
+  return slot;
+}
+
+void SparseGrid::rehash(std::size_t size) {
+  table_.assign(size,0);
+  for(unsigned k=0; k<keys_.size(); ++k) table_[findSlot(keys_[k])]=k+1;
+}
+
+const double* SparseGrid::findNode(index_t index) const {
+  const std::size_t slot=findSlot(index>>blockbits_);
+  if(table_[slot]==0) return nullptr;
+  const index_t k=table_[slot]-1;
+  const index_t i=index&(blocksize_-1);
+  if(!(occupied_[k]&(1u<<i))) return nullptr;
+  return &data_[(k*blocksize_+i)*nodesize_];
+}
+
+double* SparseGrid::getNode(index_t index) {
+  const index_t block=index>>blockbits_;
+  std::size_t slot=findSlot(block);
+  if(table_[slot]==0) {
+// keep the load factor below one half
+    if(2*(keys_.size()+1)>table_.size()) {
+      rehash(2*table_.size());
+      slot=findSlot(block);
+    }
+    keys_.push_back(block);
+    occupied_.push_back(0);
+    data_.resize(data_.size()+blocksize_*nodesize_,0.0);
+    table_[slot]=keys_.size();
+  }
+  const index_t k=table_[slot]-1;
+  const index_t i=index&(blocksize_-1);
+  if(!(occupied_[k]&(1u<<i))) {
+    occupied_[k]|=(1u<<i);
+    npoints_++;
+  }
+  return &data_[(k*blocksize_+i)*nodesize_];
+}
+
 double SparseGrid::getValue(index_t index)const {
   plumed_assert(index<maxsize_);
-  double value=0.0;
-  const auto it=map_.find(index);
-  if(it!=map_.end()) value=it->second;
-  return value;
+  const double* node=findNode(index);
+  return (node?node[0]:0.0);
 }
 
 double SparseGrid::getValueAndDerivatives(index_t index, std::vector<double>& der)const {
   plumed_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  double value=0.0;
-  for(unsigned int i=0; i<dimension_; ++i) der[i]=0.0;
-  const auto it=map_.find(index);
-  if(it!=map_.end()) value=it->second;
-  const auto itder=der_.find(index);
-  if(itder!=der_.end()) der=itder->second;
-  return value;
+  const double* node=findNode(index);
+  if(!node) {
+    for(unsigned int i=0; i<dimension_; ++i) der[i]=0.0;
+    return 0.0;
+  }
+  for(unsigned int i=0; i<dimension_; ++i) der[i]=node[1+i];
+  return node[0];
 }
 
 void SparseGrid::setValue(index_t index, double value) {
   plumed_assert(index<maxsize_ && !usederiv_);
-  map_[index]=value;
+  getNode(index)[0]=value;
 }
 
 void SparseGrid::setValueAndDerivatives(index_t index, double value, std::vector<double>& der) {
   plumed_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  map_[index]=value;
-  der_[index]=der;
+  double* node=getNode(index);
+  node[0]=value;
+  for(unsigned int i=0; i<dimension_; ++i) node[1+i]=der[i];
 }
 
 void SparseGrid::addValue(index_t index, double value) {
   plumed_assert(index<maxsize_ && !usederiv_);
-  map_[index]+=value;
+  getNode(index)[0]+=value;
 }
 
 void SparseGrid::addValueAndDerivatives(index_t index, double value, std::vector<double>& der) {
   plumed_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  map_[index]+=value;
-  der_[index].resize(dimension_);
-  for(unsigned int i=0; i<dimension_; ++i) der_[index][i]+=der[i];
+  double* node=getNode(index);
+  node[0]+=value;
+  for(unsigned int i=0; i<dimension_; ++i) node[1+i]+=der[i];
 }
 
 void SparseGrid::writeToFile(OFile& ofile) {
@@ -811,31 +971,38 @@ void SparseGrid::writeToFile(OFile& ofile) {
   double f;
   writeHeader(ofile);
   ofile.fmtField(" "+fmt_);
-  for(const auto & it : map_) {
-    index_t i=it.first;
-    xx=getPoint(i);
-    if(usederiv_) {f=getValueAndDerivatives(i,der);}
-    else {f=getValue(i);}
-    if(i>0 && dimension_>1 && getIndices(i)[dimension_-2]==0) ofile.printf("\n");
-    for(unsigned j=0; j<dimension_; ++j) {
-      ofile.printField("min_" + argnames[j], str_min_[j] );
-      ofile.printField("max_" + argnames[j], str_max_[j] );
-      ofile.printField("nbins_" + argnames[j], static_cast<int>(nbin_[j]) );
-      if( pbc_[j] ) ofile.printField("periodic_" + argnames[j], "true" );
-      else          ofile.printField("periodic_" + argnames[j], "false" );
+// points are written in order of increasing index
+  std::vector<std::pair<index_t,index_t> > blocks(keys_.size());
+  for(index_t k=0; k<keys_.size(); ++k) blocks[k]=std::make_pair(keys_[k],k);
+  std::sort(blocks.begin(),blocks.end());
+  for(const auto & b : blocks) for(index_t l=0; l<blocksize_; ++l) {
+      if(!(occupied_[b.second]&(1u<<l))) continue;
+      index_t i=b.first*blocksize_+l;
+      xx=getPoint(i);
+      if(usederiv_) {f=getValueAndDerivatives(i,der);}
+      else {f=getValue(i);}
+      if(i>0 && dimension_>1 && getIndices(i)[dimension_-2]==0) ofile.printf("\n");
+      for(unsigned j=0; j<dimension_; ++j) {
+        ofile.printField("min_" + argnames[j], str_min_[j] );
+        ofile.printField("max_" + argnames[j], str_max_[j] );
+        ofile.printField("nbins_" + argnames[j], static_cast<int>(nbin_[j]) );
+        if( pbc_[j] ) ofile.printField("periodic_" + argnames[j], "true" );
+        else          ofile.printField("periodic_" + argnames[j], "false" );
+      }
+      for(unsigned j=0; j<dimension_; ++j) ofile.printField(argnames[j],xx[j]);
+      ofile.printField(funcname, f);
+      if(usederiv_) { for(unsigned j=0; j<dimension_; ++j) ofile.printField("der_" + argnames[j],der[j]); }
+      ofile.printField();
     }
-    for(unsigned j=0; j<dimension_; ++j) ofile.printField(argnames[j],xx[j]);
-    ofile.printField(funcname, f);
-    if(usederiv_) { for(unsigned j=0; j<dimension_; ++j) ofile.printField("der_" + argnames[j],der[j]); }
-    ofile.printField();
-  }
 }
 
+// points that were never set are zero in the stored blocks, as they are for the whole grid
+
 double SparseGrid::getMinValue() const {
   double minval;
   minval=0.0;
-  for(auto const & i : map_) {
-    if(i.second<minval) minval=i.second;
+  for(std::size_t i=0; i<data_.size(); i+=nodesize_) {
+    if(data_[i]<minval) minval=data_[i];
   }
   return minval;
 }
@@ -843,12 +1010,249 @@ double SparseGrid::getMinValue() const {
 double SparseGrid::getMaxValue() const {
   double maxval;
   maxval=0.0;
-  for(auto const & i : map_) {
-    if(i.second>maxval) maxval=i.second;
+  for(std::size_t i=0; i<data_.size(); i+=nodesize_) {
+    if(data_[i]>maxval) maxval=data_[i];
   }
   return maxval;
 }
 
+template<class T>
+CompactGrid<T>::CompactGrid(const std::string& funcl, const std::vector<Value*> & args, const std::vector<std::string> & gmin,
+                            const std::vector<std::string> & gmax,
+                            const std::vector<unsigned> & nbin, bool dospline, bool usederiv, bool storederiv):
+  GridBase(funcl,args,gmin,gmax,nbin,dospline,usederiv),
+  storederiv_(usederiv && storederiv),
+  nodesize_(storederiv_?1+dimension_:1),
+  stride_(dimension_),
+  npending_(0),
+  contributions_(nodesize_)
+{
+  for(unsigned j=0; j<dimension_; ++j) stride_[j]=(j==0?1:stride_[j-1]*nbin_[j-1]);
+  grid_.assign(maxsize_*nodesize_,T(0));
+  if(std::is_same<T,float>::value) rehashPending(64);
+}
+
+template<class T>
+Grid::index_t CompactGrid<T>::getSize() const {
+  return maxsize_;
+}
+
+namespace {
+/// Pending contributions of a CompactGrid<float> are stored when they are at least this
+/// fraction of the stored value, so that their relative rounding error is below 1e-4
+const double compactGridFlushThreshold=1.0/1024.0;
+/// Key of the empty slots of the table of pending contributions
+const Grid::index_t compactGridEmptyKey=std::numeric_limits<Grid::index_t>::max();
+}
+
+template<class T>
+std::size_t CompactGrid<T>::findPendingSlot(index_t index) const {
+  const std::size_t mask=pendingKeys_.size()-1;
+// Fibonacci hashing, so that consecutive nodes are spread over the table
+  std::size_t slot=static_cast<std::size_t>((static_cast<std::uint64_t>(index)*UINT64_C(11400714819323198485))>>32)&mask;
+  while(pendingKeys_[slot]!=compactGridEmptyKey && pendingKeys_[slot]!=index) slot=(slot+1)&mask;
+  return slot;
+}
+
+template<class T>
+const double* CompactGrid<T>::findPending(index_t index) const {
+  if(npending_==0) return nullptr;
+  const std::size_t slot=findPendingSlot(index);
+  if(pendingKeys_[slot]!=index) return nullptr;
+  return &pendingData_[slot*nodesize_];
+}
+
+template<class T>
+void CompactGrid<T>::rehashPending(std::size_t size) {
+  std::vector<index_t> keys(size,compactGridEmptyKey);
+  std::vector<double> data(size*nodesize_,0.0);
+  keys.swap(pendingKeys_);
+  data.swap(pendingData_);
+  for(std::size_t i=0; i<keys.size(); ++i) if(keys[i]!=compactGridEmptyKey) {
+      const std::size_t slot=findPendingSlot(keys[i]);
+      pendingKeys_[slot]=keys[i];
+      for(unsigned k=0; k<nodesize_; ++k) pendingData_[slot*nodesize_+k]=data[i*nodesize_+k];
+    }
+}
+
+template<class T>
+std::size_t CompactGrid<T>::insertPending(index_t index, std::size_t slot) {
+// keep the load factor below one half
+  if(2*(npending_+1)>pendingKeys_.size()) {
+    const std::size_t size=2*pendingKeys_.size();
+// the table should take at most half the memory of the grid, otherwise the pending contributions are stored
+    if(size*(sizeof(index_t)+nodesize_*sizeof(double))>grid_.size()*sizeof(T)/2) flushPending();
+    else rehashPending(size);
+    slot=findPendingSlot(index);
+  }
+  pendingKeys_[slot]=index;
+  npending_++;
+  return slot;
+}
+
+template<class T>
+void CompactGrid<T>::accumulate(index_t index, const double* contributions) {
+  T* node=&grid_[index*nodesize_];
+  if(!std::is_same<T,float>::value) {
+    for(unsigned k=0; k<nodesize_; ++k) node[k]=T(double(node[k])+contributions[k]);
+    return;
+  }
+  std::size_t slot=findPendingSlot(index);
+  if(pendingKeys_[slot]!=index) {
+// a node is only inserted if some contribution is too small to be stored
+    bool small=false;
+    for(unsigned k=0; k<nodesize_; ++k) if(std::fabs(contributions[k])<compactGridFlushThreshold*std::fabs(double(node[k]))) small=true;
+    if(!small) {
+      for(unsigned k=0; k<nodesize_; ++k) node[k]=T(double(node[k])+contributions[k]);
+      return;
+    }
+    slot=insertPending(index,slot);
+  }
+  double* p=&pendingData_[slot*nodesize_];
+  for(unsigned k=0; k<nodesize_; ++k) {
+    p[k]+=contributions[k];
+    if(std::fabs(p[k])>=compactGridFlushThreshold*std::fabs(double(node[k]))) {
+      node[k]=T(double(node[k])+p[k]);
+      p[k]=0.0;
+    }
+  }
+}
+
+template<class T>
+void CompactGrid<T>::flushPending() {
+  for(std::size_t i=0; i<pendingKeys_.size(); ++i) if(pendingKeys_[i]!=compactGridEmptyKey) {
+      T* node=&grid_[pendingKeys_[i]*nodesize_];
+      for(unsigned k=0; k<nodesize_; ++k) node[k]=T(double(node[k])+pendingData_[i*nodesize_+k]);
+      pendingKeys_[i]=compactGridEmptyKey;
+    }
+  std::fill(pendingData_.begin(),pendingData_.end(),0.0);
+  npending_=0;
+}
+
+template<class T>
+void CompactGrid<T>::clearPending(index_t index) {
+  if(npending_==0) return;
+  const std::size_t slot=findPendingSlot(index);
+  if(pendingKeys_[slot]==index) for(unsigned k=0; k<nodesize_; ++k) pendingData_[slot*nodesize_+k]=0.0;
+}
+
+template<class T>
+double CompactGrid<T>::getValue(index_t index) const {
+  plumed_dbg_assert(index<maxsize_);
+  const double* p=findPending(index);
+  return double(grid_[index*nodesize_])+(p?p[0]:0.0);
+}
+
+template<class T>
+void CompactGrid<T>::getFiniteDifferences(index_t index, std::vector<double>& der) const {
+  for(unsigned j=0; j<dimension_; ++j) {
+    const unsigned i=(index/stride_[j])%nbin_[j];
+    if(nbin_[j]<2) {der[j]=0.0; continue;}
+    index_t next=index+stride_[j];
+    index_t prev=index-stride_[j];
+    double h=2.0*dx_[j];
+    if(i+1==nbin_[j]) {
+      if(pbc_[j]) next=index-(nbin_[j]-1)*stride_[j];
+      else {next=index; h=dx_[j];}
+    }
+    if(i==0) {
+      if(pbc_[j]) prev=index+(nbin_[j]-1)*stride_[j];
+      else {prev=index; h=dx_[j];}
+    }
+    der[j]=(getValue(next)-getValue(prev))/h;
+  }
+}
+
+template<class T>
+double CompactGrid<T>::getValueAndDerivatives(index_t index, std::vector<double>& der) const {
+  plumed_dbg_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
+  const T* node=&grid_[index*nodesize_];
+  const double* p=findPending(index);
+  if(storederiv_) for(unsigned i=0; i<dimension_; i++) der[i]=double(node[1+i])+(p?p[1+i]:0.0);
+  else getFiniteDifferences(index,der);
+  return double(node[0])+(p?p[0]:0.0);
+}
+
+template<class T>
+void CompactGrid<T>::setValue(index_t index, double value) {
+  plumed_dbg_assert(index<maxsize_ && !usederiv_);
+  grid_[index*nodesize_]=T(value);
+  clearPending(index);
+}
+
+template<class T>
+void CompactGrid<T>::setValueAndDerivatives(index_t index, double value, std::vector<double>& der) {
+  plumed_dbg_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
+  T* node=&grid_[index*nodesize_];
+  node[0]=T(value);
+  if(storederiv_) for(unsigned i=0; i<dimension_; i++) node[1+i]=T(der[i]);
+  clearPending(index);
+}
+
+template<class T>
+void CompactGrid<T>::addValue(index_t index, double value) {
+  plumed_dbg_assert(index<maxsize_ && !usederiv_);
+  accumulate(index,&value);
+}
+
+template<class T>
+void CompactGrid<T>::addValueAndDerivatives(index_t index, double value, std::vector<double>& der) {
+  plumed_dbg_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
+  if(!storederiv_) {
+    accumulate(index,&value);
+    return;
+  }
+  contributions_[0]=value;
+  for(unsigned i=0; i<dimension_; ++i) contributions_[1+i]=der[i];
+  accumulate(index,contributions_.data());
+}
+
+template<class T>
+double CompactGrid<T>::getMinValue() const {
+  double minval=DBL_MAX;
+  for(index_t i=0; i<maxsize_; ++i) {
+    if(getValue(i)<minval) minval=getValue(i);
+  }
+  return minval;
+}
+
+template<class T>
+double CompactGrid<T>::getMaxValue() const {
+  double maxval=DBL_MIN;
+  for(index_t i=0; i<maxsize_; ++i) {
+    if(getValue(i)>maxval) maxval=getValue(i);
+  }
+  return maxval;
+}
+
+template<class T>
+void CompactGrid<T>::writeToFile(OFile& ofile) {
+  std::vector<double> xx(dimension_);
+  std::vector<double> der(dimension_);
+  double f;
+  writeHeader(ofile);
+  for(index_t i=0; i<getSize(); ++i) {
+    xx=getPoint(i);
+    if(usederiv_) {f=getValueAndDerivatives(i,der);}
+    else {f=getValue(i);}
+    if(i>0 && dimension_>1 && getIndices(i)[dimension_-2]==0) ofile.printf("\n");
+    for(unsigned j=0; j<dimension_; ++j) {
+      ofile.printField("min_" + argnames[j], str_min_[j] );
+      ofile.printField("max_" + argnames[j], str_max_[j] );
+      ofile.printField("nbins_" + argnames[j], static_cast<int>(nbin_[j]) );
+      if( pbc_[j] ) ofile.printField("periodic_" + argnames[j], "true" );
+      else          ofile.printField("periodic_" + argnames[j], "false" );
+    }
+    for(unsigned j=0; j<dimension_; ++j) { ofile.fmtField(" "+fmt_); ofile.printField(argnames[j],xx[j]); }
+    ofile.fmtField(" "+fmt_); ofile.printField(funcname,f);
+    if(usederiv_) for(unsigned j=0; j<dimension_; ++j) { ofile.fmtField(" "+fmt_); ofile.printField("der_" + argnames[j],der[j]); }
+    ofile.printField();
+  }
+}
+
+template class CompactGrid<float>;
+template class CompactGrid<double>;
+
 void Grid::projectOnLowDimension(double &val, std::vector<int> &vHigh, WeightBase * ptr2obj ) {
   unsigned i=0;
   for(i=0; i<vHigh.size(); i++) {
@@ -928,7 +1332,10 @@ Grid Grid::project(const std::vector<std::string> & proj, WeightBase *ptr2obj )
   }
 
   // loop over all the points in the Grid, find the corresponding fixed index, rotate over all the other ones
-  for(unsigned i=0; i<smallgrid.getSize(); i++) {
+  // points of the small grid are independent, so they are done in parallel
+  const index_t smallsize=smallgrid.getSize();
+  #pragma omp parallel for num_threads(OpenMP::getNumThreads()) schedule(dynamic)
+  for(index_t i=0; i<smallsize; i++) {
     std::vector<unsigned> v;
     v=smallgrid.getIndices(i);
     std::vector<int> vHigh((getArgNames()).size(),-1);
@@ -936,13 +1343,7 @@ Grid Grid::project(const std::vector<std::string> & proj, WeightBase *ptr2obj )
     // the vector vhigh now contains at the beginning the index of the low dimension and -1 for the values that need to be integrated
     double initval=0.;
     projectOnLowDimension(initval,vHigh, ptr2obj);
-    smallgrid.setValue(i,initval);
-  }
-  // reset to zero just for biasing (this option can be evtl enabled in a future...)
-  //double vmin;vmin=-smallgrid.getMinValue()+1;
-  for(unsigned i=0; i<smallgrid.getSize(); i++) {
-    double vv=smallgrid.getValue(i);
-    smallgrid.setValue(i,ptr2obj->projectOuterLoop(vv));
+    smallgrid.setValue(i,ptr2obj->projectOuterLoop(initval));
   }
 
   return smallgrid;
@@ -980,7 +1381,7 @@ double Grid::integrate( std::vector<unsigned>& npoints ) {
 }
 
 void Grid::mpiSumValuesAndDerivatives( Communicator& comm ) {
-  comm.Sum( grid_ ); for(unsigned i=0; i<der_.size(); ++i) comm.Sum( der_[i] );
+  comm.Sum( grid_ );
 }
 
 
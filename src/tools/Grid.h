@@ -28,12 +28,15 @@
 #include <cmath>
 #include <memory>
 #include <cstddef>
+#include <cstdint>
 
 namespace PLMD {
 
 
 // simple function to enable various weighting
 
+// the projection is done in parallel, so these functions should not modify the object
+
 class WeightBase {
 public:
   virtual double projectInnerLoop(double &input, double &v)=0;
@@ -41,12 +44,13 @@ public:
   virtual ~WeightBase() {}
 };
 
+// shift should be the maximum of the bias, so that exponentials cannot overflow (log-sum-exp)
 class BiasWeight:public WeightBase {
 public:
-  double beta,invbeta;
-  explicit BiasWeight(double v) {beta=v; invbeta=1./beta;}
-  double projectInnerLoop(double &input, double &v) override {return  input+exp(beta*v);}
-  double projectOuterLoop(double &v) override {return -invbeta*std::log(v);}
+  double beta,invbeta,shift;
+  explicit BiasWeight(double v,double s=0.0) {beta=v; invbeta=1./beta; shift=s;}
+  double projectInnerLoop(double &input, double &v) override {return  input+exp(beta*(v-shift));}
+  double projectOuterLoop(double &v) override {return -invbeta*std::log(v)-shift;}
 };
 
 class ProbWeight:public WeightBase {
@@ -150,6 +154,14 @@ public:
   std::vector<index_t> getNeighbors(index_t index,const std::vector<unsigned> & neigh) const;
   std::vector<index_t> getNeighbors(const std::vector<unsigned> & indices,const std::vector<unsigned> & neigh) const;
   std::vector<index_t> getNeighbors(const std::vector<double> & x,const std::vector<unsigned> & neigh) const;
+/// get the same neighbors as getNeighbors(), split as the outer product of one dimensional lists.
+/// axes[j] contains the indices along dimension j, and points[j] the corresponding coordinates.
+/// This allows quantities that only depend on one coordinate to be computed once per axis
+  void getNeighborAxes(const std::vector<double> & x,const std::vector<unsigned> & neigh,
+                       std::vector<std::vector<unsigned> > & axes,std::vector<std::vector<double> > & points) const;
+/// get the k-th neighbor from the lists built by getNeighborAxes(), with the first dimension running fastest.
+/// The position along each axis is returned in pos and the grid index as a return value
+  index_t getAxesNeighbor(index_t k,const std::vector<std::vector<unsigned> > & axes,std::vector<unsigned> & pos) const;
 /// get nearest neighbors (those separated by exactly one lattice unit)
   std::vector<index_t> getNearestNeighbors(const index_t index) const;
   std::vector<index_t> getNearestNeighbors(const std::vector<unsigned> &indices) const;
@@ -158,11 +170,14 @@ public:
   void writeHeader(OFile& file);
 
 /// read grid from file
-  static std::unique_ptr<GridBase> create(const std::string&,const std::vector<Value*>&,IFile&,bool,bool,bool);
+/// the last two arguments select a CompactGrid, in single precision and/or without stored derivatives
+  static std::unique_ptr<GridBase> create(const std::string&,const std::vector<Value*>&,IFile&,bool,bool,bool,
+                                          bool dofloat=false,bool storederiv=true);
 /// read grid from file and check boundaries are what is expected from input
   static std::unique_ptr<GridBase> create(const std::string&,const std::vector<Value*>&, IFile&,
                                           const std::vector<std::string>&,const std::vector<std::string>&,
-                                          const std::vector<unsigned>&,bool,bool,bool);
+                                          const std::vector<unsigned>&,bool,bool,bool,
+                                          bool dofloat=false,bool storederiv=true);
 /// get grid size
   virtual index_t getSize() const=0;
 /// get grid value
@@ -172,7 +187,7 @@ public:
 /// get grid value and derivatives
   virtual double getValueAndDerivatives(index_t index, std::vector<double>& der) const=0;
   double getValueAndDerivatives(const std::vector<unsigned> & indices, std::vector<double>& der) const;
-  double getValueAndDerivatives(const std::vector<double> & x, std::vector<double>& der) const;
+  virtual double getValueAndDerivatives(const std::vector<double> & x, std::vector<double>& der) const;
 
 /// set grid value
   virtual void setValue(index_t index, double value)=0;
@@ -213,17 +228,23 @@ public:
 
 class Grid : public GridBase
 {
+/// Values and derivatives, interleaved: node i stores its value at i*nodesize_
+/// followed by its dimension_ derivatives (if usederiv_)
   std::vector<double> grid_;
-  std::vector<double> der_;
+/// Number of doubles stored for each node
+  unsigned nodesize_;
   double contour_location=0.0;
+/// Spline interpolation specialized for a given dimension, without heap allocations
+  template<unsigned dim>
+  double getSplineValueAndDerivatives(const std::vector<double> & x, std::vector<double>& der) const;
 public:
   Grid(const std::string& funcl, const std::vector<Value*> & args, const std::vector<std::string> & gmin,
        const std::vector<std::string> & gmax,
        const std::vector<unsigned> & nbin, bool dospline, bool usederiv):
     GridBase(funcl,args,gmin,gmax,nbin,dospline,usederiv)
   {
-    grid_.assign(maxsize_,0.0);
-    if(usederiv_) der_.assign(maxsize_*dimension_,0.0);
+    nodesize_=(usederiv_?1+dimension_:1);
+    grid_.assign(maxsize_*nodesize_,0.0);
   }
 /// this constructor here is not Value-aware
   Grid(const std::string& funcl, const std::vector<std::string> &names, const std::vector<std::string> & gmin,
@@ -232,8 +253,8 @@ public:
        const std::vector<std::string> &pmax ):
     GridBase(funcl,names,gmin,gmax,nbin,dospline,usederiv,isperiodic,pmin,pmax)
   {
-    grid_.assign(maxsize_,0.0);
-    if(usederiv_) der_.assign(maxsize_*dimension_,0.0);
+    nodesize_=(usederiv_?1+dimension_:1);
+    grid_.assign(maxsize_*nodesize_,0.0);
   }
   index_t getSize() const override;
 /// this is to access to Grid:: version of these methods (allowing overloading of virtual methods)
@@ -247,6 +268,8 @@ public:
   double getValue(index_t index) const override;
 /// get grid value and derivatives
   double getValueAndDerivatives(index_t index, std::vector<double>& der) const override;
+/// get grid value and derivatives at a point, with specialized code for 1, 2 and 3 dimensional splines
+  double getValueAndDerivatives(const std::vector<double> & x, std::vector<double>& der) const override;
 
 /// set grid value
   void setValue(index_t index, double value) override;
@@ -290,15 +313,40 @@ public:
 
 class SparseGrid : public GridBase
 {
-
-  std::map<index_t,double> map_;
-  std::map< index_t,std::vector<double> > der_;
+/// Points are stored in blocks of blocksize_ consecutive indices, that is along the first variable,
+/// so that the points covered by a kernel are mostly contiguous in memory.
+/// Blocks are found through an open addressing hash table with linear probing.
+  static const unsigned blockbits_=4;
+  static const index_t blocksize_=index_t(1)<<blockbits_;
+/// Values and derivatives of the stored blocks, interleaved as in Grid
+  std::vector<double> data_;
+/// For each stored block, a bit for each point that has been set
+  std::vector<std::uint16_t> occupied_;
+/// For each stored block, its number (index/blocksize_)
+  std::vector<index_t> keys_;
+/// Hash table, containing the position of the block in keys_ plus one, or zero for empty slots
+  std::vector<unsigned> table_;
+/// Number of doubles stored for each node
+  unsigned nodesize_;
+/// Number of points that have been set
+  index_t npoints_;
+/// Position of the hash table where a block is, or should be inserted
+  std::size_t findSlot(index_t block) const;
+/// Pointer to the node of a point, or nullptr if it was never set
+  const double* findNode(index_t index) const;
+/// Pointer to the node of a point, creating it if needed
+  double* getNode(index_t index);
+  void rehash(std::size_t size);
 
 public:
   SparseGrid(const std::string& funcl, const std::vector<Value*> & args, const std::vector<std::string> & gmin,
              const std::vector<std::string> & gmax,
              const std::vector<unsigned> & nbin, bool dospline, bool usederiv):
-    GridBase(funcl,args,gmin,gmax,nbin,dospline,usederiv) {}
+    GridBase(funcl,args,gmin,gmax,nbin,dospline,usederiv),
+    table_(64,0),
+    nodesize_(usederiv_?1+dimension_:1),
+    npoints_(0)
+  {}
 
   index_t getSize() const override;
   index_t getMaxSize() const;
@@ -334,6 +382,94 @@ public:
 
   virtual ~SparseGrid() {}
 };
+
+/// Dense grid using less memory than Grid, for large grids.
+/// With T=float values and derivatives are stored in single precision. Contributions
+/// are still computed in double precision by the caller, and only rounded when stored.
+/// Contributions that are too small with respect to the stored values (e.g. the tails of
+/// hills added to a large bias) would be lost when rounded, so they are accumulated in double
+/// precision in a sparse buffer until they are large enough.
+/// Derivatives can also be left out of the storage: in this case they are computed when needed
+/// from the values of the nearest neighbors, by central finite differences.
+/// Both options reduce the memory (and the bandwidth when interpolating) by a factor 2 or more,
+/// at the price of a less accurate interpolation.
+template<class T>
+class CompactGrid : public GridBase
+{
+/// Values and stored derivatives, interleaved as in Grid
+  std::vector<T> grid_;
+  bool storederiv_;
+/// Number of numbers stored for each node
+  unsigned nodesize_;
+/// Distance between the indexes of consecutive points along each dimension
+  std::vector<index_t> stride_;
+/// Contributions not yet added to grid_, in double precision (only with T=float).
+/// They are found through an open addressing hash table with linear probing, as in SparseGrid.
+/// pendingKeys_ contains the index of the node in each slot, and pendingData_ its nodesize_ contributions.
+/// Entries are only removed all together, by flushPending()
+  std::vector<index_t> pendingKeys_;
+  std::vector<double> pendingData_;
+/// Number of nodes in the table
+  std::size_t npending_;
+/// Contributions of a node, used by addValueAndDerivatives
+  std::vector<double> contributions_;
+/// Position of the table where a node is, or should be inserted
+  std::size_t findPendingSlot(index_t index) const;
+/// Pending contributions of a node, or nullptr if there are none
+  const double* findPending(index_t index) const;
+/// Insert a node in the table, in the slot returned by findPendingSlot(), and return its new slot
+  std::size_t insertPending(index_t index, std::size_t slot);
+  void rehashPending(std::size_t size);
+/// Derivatives at a node, computed from the values of its neighbors
+  void getFiniteDifferences(index_t index, std::vector<double>& der) const;
+/// Add contributions to the nodesize_ elements of a node
+  void accumulate(index_t index, const double* contributions);
+/// Add all the pending contributions to grid_
+  void flushPending();
+/// Drop the pending contributions of a node
+  void clearPending(index_t index);
+public:
+  CompactGrid(const std::string& funcl, const std::vector<Value*> & args, const std::vector<std::string> & gmin,
+              const std::vector<std::string> & gmax,
+              const std::vector<unsigned> & nbin, bool dospline, bool usederiv, bool storederiv);
+
+  index_t getSize() const override;
+/// check if derivatives are stored or computed by finite differences
+  bool storesDerivatives() const {return storederiv_;}
+
+/// this is to access to Grid:: version of these methods (allowing overloading of virtual methods)
+  using GridBase::getValue;
+  using GridBase::getValueAndDerivatives;
+  using GridBase::setValue;
+  using GridBase::setValueAndDerivatives;
+  using GridBase::addValue;
+  using GridBase::addValueAndDerivatives;
+
+/// get grid value
+  double getValue(index_t index) const override;
+/// get grid value and derivatives
+  double getValueAndDerivatives(index_t index, std::vector<double>& der) const override;
+
+/// set grid value
+  void setValue(index_t index, double value) override;
+/// set grid value and derivatives, that are ignored if not stored
+  void setValueAndDerivatives(index_t index, double value, std::vector<double>& der) override;
+/// add to grid value
+  void addValue(index_t index, double value) override;
+/// add to grid value and derivatives, that are ignored if not stored
+  void addValueAndDerivatives(index_t index, double value, std::vector<double>& der) override;
+
+/// get minimum value
+  double getMinValue() const override;
+/// get maximum value
+  double getMaxValue() const override;
+/// dump grid on file
+  void writeToFile(OFile&) override;
+};
+
+extern template class CompactGrid<float>;
+extern template class CompactGrid<double>;
+
 }
 
 #endif
@@ -0,0 +1,162 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2021 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "KernelCells.h"
+#include "Exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+
+namespace PLMD {
+
+std::size_t KernelCells::cellHash::operator()(const std::vector<int>& cell) const {
+  std::size_t h=0;
+  for(unsigned i=0; i<cell.size(); i++) h=h*1000003+std::hash<int>()(cell[i]);
+  return h;
+}
+
+void KernelCells::resize(std::size_t ncv) {
+  ncv_=ncv;
+  width_.assign(ncv_,0);
+  periodic_.assign(ncv_,false);
+  min_.assign(ncv_,0);
+  nperiodic_.assign(ncv_,0);
+  max_sigma_.assign(ncv_,0);
+  clear();
+}
+
+void KernelCells::setPeriodicity(unsigned i,const double min,const double max) {
+  periodic_[i]=true;
+  min_[i]=min;
+  width_[i]=max-min; //temporarily store the period
+}
+
+void KernelCells::clear() {
+  cells_.clear();
+}
+
+std::vector<int> KernelCells::getCell(const std::vector<double>& x) const {
+  std::vector<int> cell(ncv_);
+  for(unsigned i=0; i<ncv_; i++) {
+    cell[i]=std::floor((x[i]-min_[i])/width_[i]);
+    if(periodic_[i]) {
+      cell[i]%=nperiodic_[i];
+      if(cell[i]<0) cell[i]+=nperiodic_[i];
+    }
+  }
+  return cell;
+}
+
+void KernelCells::add(unsigned k,const std::vector<double>& center,const std::vector<double>& sigma,const double nsigma) {
+  if(!is_setup_) {
+    for(unsigned i=0; i<ncv_; i++) {
+      const double w=nsigma*sigma[i];
+      if(periodic_[i]) {
+        //an integer number of cells must fit in the period
+        const double period=width_[i];
+        nperiodic_[i]=std::max(1,(int)std::floor(period/w));
+        width_[i]=period/nperiodic_[i];
+      } else width_[i]=w;
+    }
+    is_setup_=true;
+  }
+  for(unsigned i=0; i<ncv_; i++) max_sigma_[i]=std::max(max_sigma_[i],sigma[i]);
+  cells_[getCell(center)].push_back(k);
+}
+
+void KernelCells::remove(unsigned k,const std::vector<double>& center) {
+  auto cell=cells_.find(getCell(center));
+  plumed_massert(cell!=cells_.end(),"kernel not found in the cells");
+  auto & content=cell->second;
+  auto found=std::find(content.begin(),content.end(),k);
+  plumed_massert(found!=content.end(),"kernel not found in the cells");
+  content.erase(found);
+  if(content.empty()) cells_.erase(cell);
+}
+
+void KernelCells::erase(unsigned k,const std::vector<double>& center) {
+  remove(k,center);
+  for(auto & cell : cells_)
+    for(auto & kk : cell.second)
+      if(kk>k) kk--;
+}
+
+void KernelCells::addCellContent(const std::vector<int>& cell,std::vector<unsigned>& neighbors) const {
+  const auto found=cells_.find(cell);
+  if(found!=cells_.end()) neighbors.insert(neighbors.end(),found->second.begin(),found->second.end());
+}
+
+void KernelCells::getNeighbors(const std::vector<double>& x,const double nsigma,std::vector<unsigned>& neighbors) const {
+  neighbors.clear();
+  if(cells_.empty()) return;
+  const std::vector<int> center=getCell(x);
+  //number of cells to look at in each direction
+  std::vector<int> reach(ncv_);
+  double ntot=1;
+  for(unsigned i=0; i<ncv_; i++) {
+    reach[i]=std::ceil(nsigma*max_sigma_[i]/width_[i]);
+    if(periodic_[i] && 2*reach[i]+1>=nperiodic_[i]) reach[i]=-1; //all cells along this CV
+    ntot*=(reach[i]<0?nperiodic_[i]:2*reach[i]+1);
+  }
+  if(ntot>cells_.size()) {
+    //it is cheaper to go through the non-empty cells
+    for(const auto & cell : cells_) {
+      bool close=true;
+      for(unsigned i=0; i<ncv_ && close; i++) {
+        if(reach[i]<0) continue;
+        int diff=std::abs(cell.first[i]-center[i]);
+        if(periodic_[i]) diff=std::min(diff,nperiodic_[i]-diff);
+        close=(diff<=reach[i]);
+      }
+      if(close) neighbors.insert(neighbors.end(),cell.second.begin(),cell.second.end());
+    }
+  } else {
+    //loop over all the cells within reach
+    std::vector<int> first(ncv_),last(ncv_);
+    for(unsigned i=0; i<ncv_; i++) {
+      first[i]=(reach[i]<0?0:center[i]-reach[i]);
+      last[i]=(reach[i]<0?nperiodic_[i]-1:center[i]+reach[i]);
+    }
+    std::vector<int> shifted=first;
+    std::vector<int> cell(ncv_);
+    while(true) {
+      for(unsigned i=0; i<ncv_; i++) {
+        cell[i]=shifted[i];
+        if(periodic_[i]) cell[i]=((cell[i]%nperiodic_[i])+nperiodic_[i])%nperiodic_[i];
+      }
+      addCellContent(cell,neighbors);
+      unsigned i=0;
+      for(; i<ncv_; i++) {
+        if(shifted[i]<last[i]) {
+          shifted[i]++;
+          break;
+        }
+        shifted[i]=first[i];
+      }
+      if(i==ncv_) break;
+    }
+  }
+  std::sort(neighbors.begin(),neighbors.end());
+}
+
+}
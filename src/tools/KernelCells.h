@@ -0,0 +1,70 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2021 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_tools_KernelCells_h
+#define __PLUMED_tools_KernelCells_h
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace PLMD {
+
+/// \ingroup TOOLBOX
+/// Uniform grid of cells over the CV space, storing the indexes of the kernels whose center is inside each cell.
+/// It is used to find the kernels that can be close to a given point without looping over all of them.
+/// Kernels are identified by their index in a vector owned by the caller, and the cells should be kept
+/// up to date when kernels are added, moved or erased.
+class KernelCells {
+  struct cellHash {
+    std::size_t operator()(const std::vector<int>& cell) const;
+  };
+  std::size_t ncv_;
+  bool is_setup_;
+/// size of the cells
+  std::vector<double> width_;
+  std::vector<bool> periodic_;
+  std::vector<double> min_;
+/// number of cells along periodic CVs
+  std::vector<int> nperiodic_;
+/// largest sigma ever added, to know how far to look for kernels
+  std::vector<double> max_sigma_;
+  std::unordered_map<std::vector<int>,std::vector<unsigned>,cellHash> cells_;
+  std::vector<int> getCell(const std::vector<double>&) const;
+  void addCellContent(const std::vector<int>&,std::vector<unsigned>&) const;
+public:
+  KernelCells(): ncv_(0), is_setup_(false) {}
+  void setPeriodicity(unsigned,const double,const double);
+  void resize(std::size_t);
+/// cells are created with the sigma of the first kernel, and are large enough to contain its cutoff
+  void add(unsigned,const std::vector<double>&,const std::vector<double>&,const double);
+  void remove(unsigned,const std::vector<double>&);
+/// also shifts down all the indexes larger than the erased one
+  void erase(unsigned,const std::vector<double>&);
+  void clear();
+/// get the sorted indexes of all the kernels with center closer than nsigma times their sigma
+/// to the given point (and possibly some more)
+  void getNeighbors(const std::vector<double>&,const double,std::vector<unsigned>&) const;
+};
+
+}
+
+#endif
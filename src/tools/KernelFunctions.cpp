@@ -355,6 +355,41 @@ double KernelFunctions::evaluate( const std::vector<Value*>& pos, std::vector<do
     }
     for(unsigned i=0; i<sinout.size(); ++i) r2+=sintmp[i]*sinout[i];
   }
+  double kval=evaluateFromSquaredDistance( r2, derivatives );
+  if(doInt) {
+    if((pos[0]->get() <= lowI_ || pos[0]->get() >= uppI_) && usederiv ) for(unsigned i=0; i<ndim(); ++i)derivatives[i]=0;
+  }
+  return kval;
+}
+
+double KernelFunctions::evaluate( const std::vector<double>& dist, std::vector<double>& derivatives ) const {
+  plumed_dbg_assert( dist.size()==ndim() && derivatives.size()==ndim() );
+  plumed_massert( dtype!=vonmises, "von Mises kernels should be evaluated from the positions" );
+  double r2=0;
+  if(dtype==diagonal) {
+    for(unsigned i=0; i<ndim(); ++i) {
+      derivatives[i]=-dist[i] / width[i];
+      r2+=derivatives[i]*derivatives[i];
+      derivatives[i] /= width[i];
+    }
+  } else {
+    Matrix<double> mymatrix( getMatrix() );
+    for(unsigned i=0; i<mymatrix.nrows(); ++i) {
+      double dp_i, dp_j; derivatives[i]=0;
+      dp_i=-dist[i];
+      for(unsigned j=0; j<mymatrix.ncols(); ++j) {
+        if(i==j) dp_j=dp_i;
+        else dp_j=-dist[j];
+
+        derivatives[i]+=mymatrix(i,j)*dp_j;
+        r2+=dp_i*dp_j*mymatrix(i,j);
+      }
+    }
+  }
+  return evaluateFromSquaredDistance( r2, derivatives );
+}
+
+double KernelFunctions::evaluateFromSquaredDistance( const double& r2, std::vector<double>& derivatives ) const {
   double kderiv, kval;
   if(ktype==gaussian || ktype==truncatedgaussian) {
     kval=height*std::exp(-0.5*r2); kderiv=-kval;
@@ -377,9 +412,6 @@ double KernelFunctions::evaluate( const std::vector<Value*>& pos, std::vector<do
     kderiv*=height / r ;
   }
   for(unsigned i=0; i<ndim(); ++i) derivatives[i]*=kderiv;
-  if(doInt) {
-    if((pos[0]->get() <= lowI_ || pos[0]->get() >= uppI_) && usederiv ) for(unsigned i=0; i<ndim(); ++i)derivatives[i]=0;
-  }
   return kval;
 }
 
@@ -45,6 +45,8 @@ private:
   void setData( const std::vector<double>& at, const std::vector<double>& sig, const std::string& type, const std::string& mtype, const double& w );
 /// Convert the width into matrix form
   Matrix<double> getMatrix() const;
+/// Compute the value of the kernel from the squared distance, and scale the derivatives of r2 accordingly
+  double evaluateFromSquaredDistance( const double& r2, std::vector<double>& derivatives ) const;
 public:
   explicit KernelFunctions( const std::string& input );
   KernelFunctions( const std::vector<double>& at, const std::vector<double>& sig, const std::string& type, const std::string& mtype, const double& w );
@@ -63,6 +65,12 @@ public:
   std::vector<double> getContinuousSupport( ) const;
 /// Evaluate the kernel function with constant intervals
   double evaluate( const std::vector<Value*>& pos, std::vector<double>& derivatives, bool usederiv=true, bool doInt=false, double lowI_=-1, double uppI_=-1 ) const;
+/// Evaluate the kernel function given the differences from the center, as computed by Value::difference(pos,center).
+/// As they do not depend on other positions, these differences can be precomputed for all the points of a grid line.
+/// This is not available for von Mises kernels, which need the positions themselves
+  double evaluate( const std::vector<double>& dist, std::vector<double>& derivatives ) const;
+/// Check if this is a von Mises kernel
+  bool isVonMises() const { return dtype==vonmises; }
 /// Read a kernel function from a file
   static std::unique_ptr<KernelFunctions> read( IFile* ifile, const bool& cholesky, const std::vector<std::string>& valnames );
 };
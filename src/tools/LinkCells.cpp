@@ -22,6 +22,8 @@
 #include "LinkCells.h"
 #include "Communicator.h"
 #include "Tools.h"
+#include <algorithm>
+#include <cmath>
 
 namespace PLMD {
 
@@ -30,18 +32,51 @@ LinkCells::LinkCells( Communicator& cc ) :
   cutoffwasset(false),
   link_cutoff(0.0),
   ncells(3),
-  nstride(3)
+  nstride(3),
+  lists_are_built(false)
 {
 }
 
 void LinkCells::setCutoff( const double& lcut ) {
-  cutoffwasset=true; link_cutoff=lcut;
+  cutoffwasset=true; link_cutoff=lcut; lists_are_built=false;
 }
 
 double LinkCells::getCutoff() const {
   plumed_assert( cutoffwasset ); return link_cutoff;
 }
 
+std::array<unsigned,3> LinkCells::findNumberOfCells( const Pbc& pbc, const double& lcut ) {
+// This is the reciprocal lattice
+// notice that reciprocal.getRow(0) is a vector that is orthogonal to b and c
+// This allows to use linked cells in non orthorhomic boxes
+  Tensor reciprocal(transpose(pbc.getInvBox()));
+  std::array<unsigned,3> nn;
+  for(unsigned i=0; i<3; ++i) {
+    nn[i] = std::floor( 1.0/ reciprocal.getRow(i).modulo() / lcut );
+    if( nn[i]==0 ) nn[i]=1;
+  }
+  return nn;
+}
+
+Vector LinkCells::setEnclosingBox( const std::vector<Vector>& pos, const double& lcut, Pbc& pbc ) {
+  plumed_assert( pos.size()>0 );
+  Vector minpos=pos[0], maxpos=pos[0];
+  for(const auto & p : pos) for(unsigned k=0; k<3; ++k) {
+      if( p[k]<minpos[k] ) minpos[k]=p[k];
+      if( p[k]>maxpos[k] ) maxpos[k]=p[k];
+    }
+  Tensor box;
+  for(unsigned k=0; k<3; ++k) box(k,k)=maxpos[k]-minpos[k]+2.0*lcut;
+  pbc.setBox(box);
+  return -0.5*(minpos+maxpos);
+}
+
+double LinkCells::findCellSize( const Pbc& pbc, const double& lcut, const unsigned& natoms ) {
+  plumed_assert( natoms>0 );
+  const double size_per_atom=std::cbrt( std::fabs(pbc.getBox().determinant())/natoms );
+  return std::max( lcut, size_per_atom );
+}
+
 void LinkCells::buildCellLists( const std::vector<Vector>& pos, const std::vector<unsigned>& indices, const Pbc& pbc ) {
   plumed_assert( cutoffwasset && pos.size()==indices.size() );
 
@@ -55,18 +90,8 @@ void LinkCells::buildCellLists( const std::vector<Vector>& pos, const std::vecto
     allcells.resize( pos.size() ); lcell_lists.resize( pos.size() );
   }
 
-  {
-// This is the reciprocal lattice
-// notice that reciprocal.getRow(0) is a vector that is orthogonal to b and c
-// This allows to use linked cells in non orthorhomic boxes
-    Tensor reciprocal(transpose(mypbc.getInvBox()));
-    ncells[0] = std::floor( 1.0/ reciprocal.getRow(0).modulo() / link_cutoff );
-    if( ncells[0]==0 ) ncells[0]=1;
-    ncells[1] = std::floor( 1.0/ reciprocal.getRow(1).modulo() / link_cutoff );
-    if( ncells[1]==0 ) ncells[1]=1;
-    ncells[2] = std::floor( 1.0/ reciprocal.getRow(2).modulo() / link_cutoff );
-    if( ncells[2]==0 ) ncells[2]=1;
-  }
+  std::array<unsigned,3> nn( findNumberOfCells( mypbc, link_cutoff ) );
+  for(unsigned i=0; i<3; ++i) ncells[i]=nn[i];
   // Setup the strides
   nstride[0]=1; nstride[1]=ncells[0]; nstride[2]=ncells[0]*ncells[1];
 
@@ -100,6 +125,21 @@ void LinkCells::buildCellLists( const std::vector<Vector>& pos, const std::vecto
     lcell_lists[ myind ] = indices[j];
     lcell_tots[allcells[j]]++;
   }
+
+  // Store what was used to build the lists so that they can be reused
+  built_pos=pos; built_ind=indices; lists_are_built=true;
+}
+
+bool LinkCells::isBuiltFrom( const std::vector<Vector>& pos, const std::vector<unsigned>& indices, const Pbc& pbc ) const {
+  if( !lists_are_built || pos.size()!=built_pos.size() || indices!=built_ind ) return false;
+  const Tensor & box(pbc.getBox()), & oldbox(mypbc.getBox());
+  for(unsigned i=0; i<3; ++i) for(unsigned j=0; j<3; ++j) {
+      if( box(i,j)!=oldbox(i,j) ) return false;
+    }
+  for(unsigned i=0; i<pos.size(); ++i) {
+    if( pos[i][0]!=built_pos[i][0] || pos[i][1]!=built_pos[i][1] || pos[i][2]!=built_pos[i][2] ) return false;
+  }
+  return true;
 }
 
 #define LINKC_MIN(n) ((n<2)? 0 : -1)
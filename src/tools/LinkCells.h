@@ -23,6 +23,7 @@
 #define __PLUMED_tools_LinkCells_h
 
 #include <vector>
+#include <array>
 #include "Vector.h"
 #include "Pbc.h"
 
@@ -54,6 +55,11 @@ private:
   std::vector<unsigned> lcell_tots;
 /// The atoms ordered by link cells
   std::vector<unsigned> lcell_lists;
+/// Have the lists been built with the current cutoff
+  bool lists_are_built;
+/// The positions and indices that were used to build the lists
+  std::vector<Vector> built_pos;
+  std::vector<unsigned> built_ind;
 public:
 ///
   explicit LinkCells( Communicator& comm );
@@ -65,8 +71,18 @@ public:
   double getCutoff() const ;
 /// Get the total number of link cells
   unsigned getNumberOfCells() const ;
+/// Get the number of cells in each direction that are used with this box and cutoff
+  static std::array<unsigned,3> findNumberOfCells( const Pbc& pbc, const double& lcut );
+/// Set up an orthorhombic box for positions that are not periodic. The box encloses all the positions with a margin
+/// of lcut on each side, so that cells never wrap on close atoms. Returns the shift that centers the positions in the box
+  static Vector setEnclosingBox( const std::vector<Vector>& pos, const double& lcut, Pbc& pbc );
+/// Get the size of the cells for natoms atoms in this box: never smaller than lcut, and larger if needed
+/// so that there are not many more cells than atoms
+  static double findCellSize( const Pbc& pbc, const double& lcut, const unsigned& natoms );
 /// Build the link cell lists
   void buildCellLists( const std::vector<Vector>& pos, const std::vector<unsigned>& indices, const Pbc& pbc );
+/// Check if the lists have been built from exactly these positions, indices and box, so they can be reused
+  bool isBuiltFrom( const std::vector<Vector>& pos, const std::vector<unsigned>& indices, const Pbc& pbc ) const ;
 /// Take three indices and return the index of the corresponding cell
   unsigned convertIndicesToIndex( const unsigned& nx, const unsigned& ny, const unsigned& nz ) const ;
 /// Find the cell index in which this position is contained
@@ -20,4 +20,52 @@
    along with plumed.  If not, see <http://www.gnu.org/licenses/>.
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 #include "Log.h"
+#include "Exception.h"
+#include "OpenMP.h"
+#include <cstdarg>
+#include <cstdio>
+#include <vector>
 
+namespace PLMD {
+
+void Log::write(const std::string&s) {
+  #pragma omp critical(plumed_log)
+  {
+    if(OpenMP::inParallel()) {
+      std::string& line(partialLines[std::this_thread::get_id()]);
+      line+=s;
+      const auto n=line.rfind('\n');
+      if(n!=std::string::npos) {
+        OFile::printf("%s",line.substr(0,n+1).c_str());
+        line.erase(0,n+1);
+      }
+    } else {
+// incomplete lines left by threads are written before new text
+      for(const auto & p : partialLines) OFile::printf("%s",p.second.c_str());
+      partialLines.clear();
+      OFile::printf("%s",s.c_str());
+    }
+  }
+}
+
+int Log::printf(const char*fmt,...) {
+// the string is formatted here, and only written to the file in the critical section
+  va_list arg;
+  va_start(arg, fmt);
+  char small[1024];
+  int r=std::vsnprintf(small,sizeof(small),fmt,arg);
+  va_end(arg);
+  plumed_massert(r>-1,"error using fmt string " + std::string(fmt));
+  if(r<int(sizeof(small))) {
+    write(small);
+    return r;
+  }
+  std::vector<char> large(r+1);
+  va_start(arg, fmt);
+  std::vsnprintf(large.data(),large.size(),fmt,arg);
+  va_end(arg);
+  write(large.data());
+  return r;
+}
+
+}
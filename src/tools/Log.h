@@ -23,6 +23,10 @@
 #define __PLUMED_tools_Log_h
 
 #include "OFile.h"
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
 
 namespace PLMD {
 
@@ -35,8 +39,29 @@ namespace PLMD {
 class Log :
   public OFile
 {
+/// Incomplete lines written by each thread inside a parallel region
+  std::map<std::thread::id,std::string> partialLines;
+/// Write a formatted string. Inside a parallel region, only complete lines are written
+  void write(const std::string&);
+public:
+/// Formatted output a la printf. Lines written by actions that
+/// are calculated concurrently are not mixed, since each thread keeps
+/// its text until the line is complete. This does not apply to text
+/// written through a reference to the underlying OFile
+  int printf(const char*fmt,...);
+/// Formatted output with << operator, serialised as printf
+  template <class T>
+  friend Log& operator<<(Log&,const T &);
 };
 
+template <class T>
+Log& operator<<(Log&log,const T &t) {
+  std::ostringstream oss;
+  oss<<t;
+  log.write(oss.str());
+  return log;
+}
+
 }
 
 #endif
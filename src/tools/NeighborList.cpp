@@ -26,17 +26,19 @@
 #include "Communicator.h"
 #include "OpenMP.h"
 #include "Tools.h"
+#include "LinkCells.h"
 #include <vector>
 #include <algorithm>
 #include <numeric>
+#include <limits>
 
 namespace PLMD {
 
 NeighborList::NeighborList(const std::vector<AtomNumber>& list0, const std::vector<AtomNumber>& list1,
                            const bool& serial, const bool& do_pair, const bool& do_pbc, const Pbc& pbc, Communicator& cm,
-                           const double& distance, const unsigned& stride): reduced(false),
+                           const double& distance, const unsigned& stride, const double& skin): reduced(false),
   serial_(serial), do_pair_(do_pair), do_pbc_(do_pbc), pbc_(&pbc), comm(cm),
-  distance_(distance), stride_(stride)
+  distance_(distance), skin_(skin), stride_(stride)
 {
 // store full list of atoms needed
   fullatomlist_=list0;
@@ -57,9 +59,9 @@ NeighborList::NeighborList(const std::vector<AtomNumber>& list0, const std::vect
 
 NeighborList::NeighborList(const std::vector<AtomNumber>& list0, const bool& serial, const bool& do_pbc,
                            const Pbc& pbc, Communicator& cm, const double& distance,
-                           const unsigned& stride): reduced(false),
-  serial_(serial), do_pbc_(do_pbc), pbc_(&pbc), comm(cm),
-  distance_(distance), stride_(stride) {
+                           const unsigned& stride, const double& skin): reduced(false),
+  serial_(serial), do_pair_(false), do_pbc_(do_pbc), pbc_(&pbc), comm(cm),
+  distance_(distance), skin_(skin), stride_(stride) {
   fullatomlist_=list0;
   nlist0_=list0.size();
   twolists_=false;
@@ -68,6 +70,10 @@ NeighborList::NeighborList(const std::vector<AtomNumber>& list0, const bool& ser
   lastupdate_=0;
 }
 
+NeighborList::~NeighborList() {
+// here because LinkCells and Communicator are incomplete types in the header
+}
+
 void NeighborList::initialize() {
   neighbors_.clear();
   for(unsigned int i=0; i<nallpairs_; ++i) {
@@ -94,22 +100,28 @@ std::pair<unsigned,unsigned> NeighborList::getIndexPair(unsigned ipair) {
   return index;
 }
 
-void NeighborList::update(const std::vector<Vector>& positions) {
-  neighbors_.clear();
-  const double d2=distance_*distance_;
-  // check if positions array has the correct length
-  plumed_assert(positions.size()==fullatomlist_.size());
+Vector NeighborList::getDistance(const Vector& v1, const Vector& v2) const {
+  if(do_pbc_) return pbc_->distance(v1,v2);
+  return delta(v1,v2);
+}
 
-  unsigned stride=comm.Get_size();
-  unsigned rank=comm.Get_rank();
-  unsigned nt=OpenMP::getNumThreads();
-  if(serial_) {
-    stride=1;
-    rank=0;
-    nt=1;
+double NeighborList::getSkin() const {
+  return skin_;
+}
+
+double NeighborList::getMaxDisplacement(const std::vector<Vector>& positions) const {
+  if(skin_<=0.0 || reference_.size()!=positions.size()) return std::numeric_limits<double>::max();
+  double maxd2=0.0;
+  for(unsigned i=0; i<positions.size(); ++i) {
+    double d2=modulo2(getDistance(reference_[i],positions[i]));
+    if(d2>maxd2) maxd2=d2;
   }
-  std::vector<unsigned> local_flat_nl;
+  return std::sqrt(maxd2);
+}
 
+void NeighborList::searchAllPairs(const std::vector<Vector>& positions, const double& cutoff,
+                                  unsigned stride, unsigned rank, unsigned nt, std::vector<unsigned>& local_flat_nl) {
+  const double d2=cutoff*cutoff;
   #pragma omp parallel num_threads(nt)
   {
     std::vector<unsigned> private_flat_nl;
@@ -118,13 +130,7 @@ void NeighborList::update(const std::vector<Vector>& positions) {
       std::pair<unsigned,unsigned> index=getIndexPair(i);
       unsigned index0=index.first;
       unsigned index1=index.second;
-      Vector distance;
-      if(do_pbc_) {
-        distance=pbc_->distance(positions[index0],positions[index1]);
-      } else {
-        distance=delta(positions[index0],positions[index1]);
-      }
-      double value=modulo2(distance);
+      double value=modulo2(getDistance(positions[index0],positions[index1]));
       if(value<=d2) {
         private_flat_nl.push_back(index0);
         private_flat_nl.push_back(index1);
@@ -133,13 +139,100 @@ void NeighborList::update(const std::vector<Vector>& positions) {
     #pragma omp critical
     local_flat_nl.insert(local_flat_nl.end(), private_flat_nl.begin(), private_flat_nl.end());
   }
+}
+
+bool NeighborList::searchWithLinkCells(const std::vector<Vector>& positions, const double& cutoff,
+                                       unsigned stride, unsigned rank, unsigned nt, std::vector<unsigned>& local_flat_nl) {
+// pairs are an explicit list with PAIR, and without a cutoff all of them are close
+  if(do_pair_ || cutoff>=0.5e+30) return false;
+// atoms that are put in the link cells: the second list, or the only list
+  const unsigned first=(twolists_ ? nlist0_ : 0);
+  const unsigned ncell_atoms=positions.size()-first;
+  if(ncell_atoms==0) return true;
+
+// with pbc the cells span the simulation box, otherwise an orthorhombic box that
+// encloses all the atoms (and is centered on them) is used, with a margin so that
+// cells never wrap on close atoms
+  Pbc cellpbc;
+  Vector shift;
+  if(do_pbc_ && pbc_->isSet()) cellpbc.setBox(pbc_->getBox());
+  else shift=LinkCells::setEnclosingBox(positions,cutoff,cellpbc);
+  const double cellsize=LinkCells::findCellSize(cellpbc,cutoff,ncell_atoms);
+
+// cell lists are built serially on each process: building them is linear in the number of atoms
+// and the search below is what gets split
+  if(!linkcells_) {
+    serialcomm_=Tools::make_unique<Communicator>();
+    linkcells_=Tools::make_unique<LinkCells>(*serialcomm_);
+  }
+  linkcells_->setCutoff(cellsize);
+  std::vector<Vector> cellpos(ncell_atoms);
+  std::vector<unsigned> cellind(ncell_atoms);
+  for(unsigned i=0; i<ncell_atoms; ++i) {
+    cellpos[i]=positions[first+i]+shift;
+    cellind[i]=first+i;
+  }
+  linkcells_->buildCellLists(cellpos,cellind,cellpbc);
+
+  const double d2=cutoff*cutoff;
+  const unsigned nsearch=(twolists_ ? nlist0_ : positions.size());
+  #pragma omp parallel num_threads(nt)
+  {
+    std::vector<unsigned> private_flat_nl;
+    std::vector<unsigned> cells_required(linkcells_->getNumberOfCells());
+    std::vector<unsigned> atoms(1+ncell_atoms);
+    #pragma omp for nowait
+    for(unsigned i=rank; i<nsearch; i+=stride) {
+      unsigned natomsper=1; atoms[0]=i;
+      linkcells_->retrieveNeighboringAtoms(positions[i]+shift,cells_required,natomsper,atoms);
+      for(unsigned j=1; j<natomsper; ++j) {
+        const unsigned index1=atoms[j];
+// with a single list each pair is found twice
+        if(!twolists_ && index1<i) continue;
+        if(modulo2(getDistance(positions[i],positions[index1]))<=d2) {
+          private_flat_nl.push_back(i);
+          private_flat_nl.push_back(index1);
+        }
+      }
+    }
+    #pragma omp critical
+    local_flat_nl.insert(local_flat_nl.end(), private_flat_nl.begin(), private_flat_nl.end());
+  }
+  return true;
+}
+
+bool NeighborList::update(const std::vector<Vector>& positions) {
+  // check if positions array has the correct length
+  plumed_assert(positions.size()==fullatomlist_.size());
+
+  // with a skin the pairs are only searched again when some atom might have entered the cutoff
+  if(getMaxDisplacement(positions)<=0.5*skin_) {
+    neighbors_=builtneighbors_;
+    setRequestList();
+    return false;
+  }
+  neighbors_.clear();
+  const double cutoff=distance_+skin_;
+
+  unsigned stride=comm.Get_size();
+  unsigned rank=comm.Get_rank();
+  unsigned nt=OpenMP::getNumThreads();
+  if(serial_) {
+    stride=1;
+    rank=0;
+    nt=1;
+  }
+  std::vector<unsigned> local_flat_nl;
+  if(!searchWithLinkCells(positions,cutoff,stride,rank,nt,local_flat_nl))
+    searchAllPairs(positions,cutoff,stride,rank,nt,local_flat_nl);
 
   // find total dimension of neighborlist
   std::vector <int> local_nl_size(stride, 0);
   local_nl_size[rank] = local_flat_nl.size();
   if(!serial_) comm.Sum(&local_nl_size[0], stride);
   int tot_size = std::accumulate(local_nl_size.begin(), local_nl_size.end(), 0);
-  if(tot_size==0) {setRequestList(); return;}
+  if(skin_>0.0) reference_=positions;
+  if(tot_size==0) {builtneighbors_.clear(); setRequestList(); return true;}
   // merge
   std::vector<unsigned> merge_nl(tot_size, 0);
   // calculate vector of displacement
@@ -159,8 +252,12 @@ void NeighborList::update(const std::vector<Vector>& positions) {
     unsigned j=2*i;
     neighbors_[i] = std::make_pair(merge_nl[j],merge_nl[j+1]);
   }
+  // the order of the pairs does not depend on the number of processes and threads
+  std::sort(neighbors_.begin(),neighbors_.end());
+  if(skin_>0.0) builtneighbors_=neighbors_;
 
   setRequestList();
+  return true;
 }
 
 void NeighborList::setRequestList() {
@@ -26,11 +26,13 @@
 #include "AtomNumber.h"
 
 #include <vector>
+#include <memory>
 
 namespace PLMD {
 
 class Pbc;
 class Communicator;
+class LinkCells;
 
 /// \ingroup TOOLBOX
 /// A class that implements neighbor lists from two lists or a single list of atoms
@@ -44,9 +46,27 @@ class NeighborList
   std::vector<PLMD::AtomNumber> fullatomlist_,requestlist_;
   std::vector<std::pair<unsigned,unsigned> > neighbors_;
   double distance_;
+/// The Verlet skin. Pairs are searched within distance_+skin_ and the search
+/// is only repeated when some atom has moved by more than skin_/2
+  double skin_;
   unsigned stride_,nlist0_,nlist1_,nallpairs_,lastupdate_;
+/// Positions of the atoms in the full list when the pairs were last searched (only with a skin)
+  std::vector<Vector> reference_;
+/// Pairs found at the last search, indexed on the full list (only with a skin)
+  std::vector<std::pair<unsigned,unsigned> > builtneighbors_;
+/// Link cells used to search for pairs, and the (serial) communicator they use
+  std::unique_ptr<Communicator> serialcomm_;
+  std::unique_ptr<LinkCells> linkcells_;
 /// Initialize the neighbor list with all possible pairs
   void initialize();
+/// Find the close pairs looping over all the possible pairs
+  void searchAllPairs(const std::vector<Vector>& positions, const double& cutoff,
+                      unsigned stride, unsigned rank, unsigned nt, std::vector<unsigned>& flat_nl);
+/// Find the close pairs using link cells. Returns false if link cells cannot be used
+  bool searchWithLinkCells(const std::vector<Vector>& positions, const double& cutoff,
+                           unsigned stride, unsigned rank, unsigned nt, std::vector<unsigned>& flat_nl);
+/// Distance between two atoms, taking pbc into account if needed
+  Vector getDistance(const Vector& v1, const Vector& v2) const;
 /// Return the pair of indexes in the positions array
 /// of the two atoms forming the i-th pair among all possible pairs
   std::pair<unsigned,unsigned> getIndexPair(unsigned i);
@@ -57,12 +77,12 @@ public:
                const std::vector<PLMD::AtomNumber>& list1,
                const bool& serial,
                const bool& do_pair, const bool& do_pbc, const PLMD::Pbc& pbc, Communicator &cm,
-               const double& distance=1.0e+30, const unsigned& stride=0);
+               const double& distance=1.0e+30, const unsigned& stride=0, const double& skin=0.0);
   NeighborList(const std::vector<PLMD::AtomNumber>& list0,
                const bool& serial,
                const bool& do_pbc,
                const PLMD::Pbc& pbc, Communicator &cm, const double& distance=1.0e+30,
-               const unsigned& stride=0);
+               const unsigned& stride=0, const double& skin=0.0);
 /// Return the list of all atoms. These are needed to rebuild the neighbor list.
   std::vector<PLMD::AtomNumber>& getFullAtomList();
 /// Update the indexes in the neighbor list to match the
@@ -70,8 +90,16 @@ public:
 /// and return the new list of atoms that must be requested to the main code
   std::vector<PLMD::AtomNumber>& getReducedAtomList();
 /// Update the neighbor list and prepare the new
-/// list of atoms that will be requested to the main code
-  void update(const std::vector<PLMD::Vector>& positions);
+/// list of atoms that will be requested to the main code.
+/// When a skin is used, the pairs are searched again only if some atom
+/// has moved by more than half the skin since the last search.
+/// Returns true if the pairs have been searched
+  bool update(const std::vector<PLMD::Vector>& positions);
+/// Get the Verlet skin
+  double getSkin() const;
+/// Get the largest displacement of the atoms in the full list since the last search of pairs.
+/// Returns a very large number if the pairs have never been searched or no skin is used
+  double getMaxDisplacement(const std::vector<PLMD::Vector>& positions) const;
 /// Get the update stride of the neighbor list
   unsigned getStride() const;
 /// Get the last step in which the neighbor list was updated
@@ -84,7 +112,7 @@ public:
   std::pair<unsigned,unsigned> getClosePair(unsigned i) const;
 /// Get the list of neighbors of the i-th atom
   std::vector<unsigned> getNeighbors(unsigned i);
-  ~NeighborList() {}
+  ~NeighborList();
 /// Get the i-th pair of AtomNumbers from the neighbor list
   std::pair<AtomNumber,AtomNumber> getClosePairAtomNumber(unsigned i) const;
 };
@@ -101,6 +101,12 @@ OFile& OFile::setLinePrefix(const std::string&l) {
   return *this;
 }
 
+OFile& OFile::write(const void*ptr,std::size_t n) {
+  plumed_massert(actual_buffer_length==0,"cannot write binary data after an incomplete line");
+  llwrite(static_cast<const char*>(ptr),n);
+  return *this;
+}
+
 int OFile::printf(const char*fmt,...) {
   va_list arg;
   va_start(arg, fmt);
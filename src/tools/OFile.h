@@ -255,6 +255,9 @@ public:
   OFile& clearFields();
 /// Formatted output with explicit format - a la printf
   int printf(const char*fmt,...);
+/// Unformatted output of n bytes, used for binary files.
+/// Line prefix and fields are ignored
+  OFile& write(const void*ptr,std::size_t n);
 /// Formatted output with << operator
   template <class T>
   friend OFile& operator<<(OFile&,const T &);
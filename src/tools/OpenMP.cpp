@@ -70,6 +70,14 @@ unsigned OpenMP::getThreadNum() {
 #endif
 }
 
+bool OpenMP::inParallel() {
+#if defined(_OPENMP)
+  return omp_in_parallel();
+#else
+  return false;
+#endif
+}
+
 
 
 }
@@ -39,6 +39,9 @@ public:
 /// Returns a unique thread identification number within the current team
   static unsigned getThreadNum();
 
+/// Returns true when called inside an active parallel region
+  static bool inParallel();
+
 /// get cacheline size
   static unsigned getCachelineSize();
 
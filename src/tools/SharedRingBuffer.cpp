@@ -0,0 +1,254 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2021 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "SharedRingBuffer.h"
+#include "Exception.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#ifdef __PLUMED_HAS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace PLMD {
+
+struct SharedRingBuffer::Header {
+/// Set when the header has been initialized
+  std::atomic<std::uint64_t> magic;
+/// Capacity of the buffer
+  std::uint64_t nrecords;
+/// Number of doubles in each record
+  std::uint64_t recordsize;
+/// Incremented every time the writer (re)creates the buffer
+  std::atomic<std::uint64_t> generation;
+/// Total number of records written in this generation
+  std::atomic<std::uint64_t> written;
+/// Index of the first record of this generation
+  std::uint64_t first;
+/// Set while the writer is running
+  std::atomic<std::uint64_t> open;
+};
+
+namespace {
+const std::uint64_t ringMagic=0x706c756d65647262ULL;
+/// Records start at this offset, so that they are aligned to a cache line
+const std::size_t headerSize=64;
+static_assert(sizeof(std::atomic<std::uint64_t>)==sizeof(std::uint64_t),"atomic counters should not need extra storage");
+}
+
+constexpr std::uint64_t SharedRingBuffer::allWritten;
+
+bool SharedRingBuffer::isAvailable() {
+#ifdef __PLUMED_HAS_MMAP
+  return true;
+#else
+  return false;
+#endif
+}
+
+SharedRingBuffer::SharedRingBuffer():
+  fd(-1),
+  map(nullptr),
+  mapsize(0),
+  writer(false),
+  generation(0),
+  nread(0),
+  nrecords(0),
+  recordsize(0)
+{
+  static_assert(sizeof(Header)<=headerSize,"header does not fit");
+}
+
+SharedRingBuffer::~SharedRingBuffer() {
+// readers that attach later should not read the records of this run
+  if(map && writer) header()->open.store(0,std::memory_order_release);
+  unmapFile();
+#ifdef __PLUMED_HAS_MMAP
+  if(fd>=0) ::close(fd);
+#endif
+}
+
+SharedRingBuffer::Header* SharedRingBuffer::header() const {
+  return static_cast<Header*>(map);
+}
+
+double* SharedRingBuffer::records() const {
+  return reinterpret_cast<double*>(static_cast<char*>(map)+headerSize);
+}
+
+void SharedRingBuffer::mapFile(std::size_t size) {
+#ifdef __PLUMED_HAS_MMAP
+  unmapFile();
+  void* p=::mmap(nullptr,size,(writer?PROT_READ|PROT_WRITE:PROT_READ),MAP_SHARED,fd,0);
+  plumed_massert(p!=MAP_FAILED,"cannot map file "+path);
+  map=p;
+  mapsize=size;
+#else
+  plumed_merror("memory-mapped files are not available, recompile with __PLUMED_HAS_MMAP");
+#endif
+}
+
+void SharedRingBuffer::unmapFile() {
+#ifdef __PLUMED_HAS_MMAP
+  if(map) ::munmap(map,mapsize);
+#endif
+  map=nullptr;
+  mapsize=0;
+}
+
+void SharedRingBuffer::create(const std::string& path,unsigned nrecords,unsigned recordsize,std::uint64_t first) {
+#ifdef __PLUMED_HAS_MMAP
+  plumed_massert(!isOpen(),"buffer is already open");
+  plumed_massert(nrecords>0 && recordsize>0,"buffer should not be empty");
+  this->path=path;
+  writer=true;
+  fd=::open(path.c_str(),O_RDWR|O_CREAT,0644);
+  plumed_massert(fd>=0,"cannot create file "+path);
+  std::size_t size=headerSize+sizeof(double)*std::size_t(nrecords)*recordsize;
+  struct stat st;
+  int r=::fstat(fd,&st);
+  plumed_massert(r==0,"cannot stat file "+path);
+// the file is never shrunk, since readers could have mapped a larger region
+  if(std::size_t(st.st_size)<size) {
+    r=::ftruncate(fd,size);
+    plumed_massert(r==0,"cannot resize file "+path);
+  }
+  mapFile(size);
+  this->nrecords=nrecords;
+  this->recordsize=recordsize;
+  Header* h=header();
+  bool existing=(h->magic.load(std::memory_order_acquire)==ringMagic);
+  h->nrecords=nrecords;
+  h->recordsize=recordsize;
+  h->first=first;
+  h->written.store(0,std::memory_order_release);
+// readers attached to an existing buffer will notice the change of generation and start again
+  if(existing) h->generation.fetch_add(1,std::memory_order_acq_rel);
+  else h->generation.store(1,std::memory_order_release);
+  h->open.store(1,std::memory_order_release);
+  h->magic.store(ringMagic,std::memory_order_release);
+  generation=h->generation.load(std::memory_order_acquire);
+#else
+  plumed_merror("memory-mapped files are not available, recompile with __PLUMED_HAS_MMAP");
+#endif
+}
+
+bool SharedRingBuffer::mapForReading() {
+#ifdef __PLUMED_HAS_MMAP
+  if(fd<0) fd=::open(path.c_str(),O_RDONLY);
+  if(fd<0) return false;
+  struct stat st;
+  if(::fstat(fd,&st)!=0 || std::size_t(st.st_size)<headerSize) return false;
+  mapFile(headerSize);
+  Header* h=header();
+  if(h->magic.load(std::memory_order_acquire)!=ringMagic || h->open.load(std::memory_order_acquire)==0) {
+    unmapFile();
+    return false;
+  }
+  std::uint64_t g=h->generation.load(std::memory_order_acquire);
+  std::uint64_t n=h->nrecords;
+  std::uint64_t rs=h->recordsize;
+  std::size_t size=headerSize+sizeof(double)*n*rs;
+  if(std::size_t(st.st_size)<size) {
+    unmapFile();
+    return false;
+  }
+  mapFile(size);
+// the header could have been changed by the writer in the meantime
+  if(header()->generation.load(std::memory_order_acquire)!=g) {
+    unmapFile();
+    return false;
+  }
+  generation=g;
+  nrecords=n;
+  recordsize=rs;
+  nread=0;
+  return true;
+#else
+  plumed_merror("memory-mapped files are not available, recompile with __PLUMED_HAS_MMAP");
+#endif
+}
+
+bool SharedRingBuffer::attach(const std::string& path,std::uint64_t start) {
+  plumed_massert(!isOpen(),"buffer is already open");
+  this->path=path;
+  writer=false;
+  if(!mapForReading()) return false;
+  Header* h=header();
+  std::uint64_t first=h->first;
+  std::uint64_t w=h->written.load(std::memory_order_acquire);
+  if(start>first) nread=std::min(start-first,w);
+  return true;
+}
+
+unsigned SharedRingBuffer::getRecordSize() const {
+  plumed_dbg_assert(isOpen());
+  return recordsize;
+}
+
+void SharedRingBuffer::push(const std::vector<double>& record) {
+  plumed_dbg_assert(isOpen() && writer);
+  Header* h=header();
+  plumed_dbg_assert(record.size()==recordsize);
+  std::uint64_t w=h->written.load(std::memory_order_relaxed);
+  std::memcpy(records()+(w%nrecords)*recordsize,record.data(),sizeof(double)*recordsize);
+// the record becomes visible to readers only here
+  h->written.store(w+1,std::memory_order_release);
+}
+
+unsigned SharedRingBuffer::read(std::vector<double>& data) {
+  plumed_dbg_assert(isOpen() && !writer);
+  Header* h=header();
+  if(h->generation.load(std::memory_order_acquire)!=generation) {
+// the writer has recreated the buffer, possibly with a different size,
+// and all the records of the new generation should be read
+    unmapFile();
+    if(!mapForReading()) return 0;
+    h=header();
+  }
+  std::uint64_t w=h->written.load(std::memory_order_acquire);
+  if(w<=nread) return 0;
+// when w-nread==nrecords the writer could be storing record w in the slot of record nread
+  plumed_massert(w-nread<nrecords,"records have been overwritten before being read from "+path+", the buffer should be larger");
+  std::size_t start=data.size();
+  data.resize(start+(w-nread)*recordsize);
+  for(std::uint64_t i=nread; i<w; i++)
+    std::memcpy(&data[start+(i-nread)*recordsize],records()+(i%nrecords)*recordsize,sizeof(double)*recordsize);
+// check that nothing has changed while copying, as in a seqlock:
+// the fence makes sure that the copy is complete before the counters are loaded again
+  std::atomic_thread_fence(std::memory_order_acquire);
+  std::uint64_t w2=h->written.load(std::memory_order_relaxed);
+// a counter smaller than before means that the writer is recreating the buffer
+  if(h->generation.load(std::memory_order_relaxed)!=generation || w2<w) {
+    data.resize(start);
+    return 0;
+  }
+  plumed_massert(w2-nread<nrecords,"records have been overwritten while being read from "+path+", the buffer should be larger");
+  unsigned n=w-nread;
+  nread=w;
+  return n;
+}
+
+}
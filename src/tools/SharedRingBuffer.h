@@ -0,0 +1,101 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2021 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_tools_SharedRingBuffer_h
+#define __PLUMED_tools_SharedRingBuffer_h
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+namespace PLMD {
+
+/// \ingroup TOOLBOX
+/// A ring buffer of fixed size records stored in a memory-mapped file.
+///
+/// It is used to pass data between processes running on the same node
+/// (e.g. multiple walkers) without reading and writing text files.
+/// Each buffer has a single writer, which appends records, and any number of readers,
+/// each of them keeping track of the records it has already consumed.
+/// No lock is used: the writer publishes a record by incrementing an atomic counter
+/// after the record has been stored. A reader that falls behind by more than the
+/// capacity of the buffer would lose records, and this is reported as an error.
+///
+/// When the writer creates a buffer that already exists, the file is reused and its
+/// generation number is incremented, so that readers attached to it start again from the first record.
+/// Records are numbered across generations, starting from the number of records that the writer
+/// declares to have produced before (e.g. the hills read from its file when restarting).
+/// A reader that already has some of them (e.g. because it read the same file) can thus skip them.
+/// The writer marks the buffer as closed when it is destroyed, so that a buffer left by a previous
+/// run is not read before it is created again.
+/// To use memory rather than disk, files should be located on a tmpfs (e.g. /dev/shm).
+class SharedRingBuffer {
+/// Layout of the beginning of the file
+  struct Header;
+  std::string path;
+  int fd;
+  void* map;
+  std::size_t mapsize;
+/// True for the writer
+  bool writer;
+/// Generation number of the buffer when it was attached
+  std::uint64_t generation;
+/// Number of records of this generation already consumed by this reader
+  std::uint64_t nread;
+/// Capacity and size of records, as they were when the buffer was mapped
+  std::uint64_t nrecords;
+  std::uint64_t recordsize;
+  Header* header() const;
+  double* records() const;
+/// Map the file, with a given size
+  void mapFile(std::size_t size);
+  void unmapFile();
+/// Map the current generation of an existing buffer for reading. Returns false if it is not available
+  bool mapForReading();
+public:
+/// Passed to attach() to skip all the records written before attaching
+  static constexpr std::uint64_t allWritten=std::numeric_limits<std::uint64_t>::max();
+/// Check if memory-mapped files are supported
+  static bool isAvailable();
+  SharedRingBuffer();
+  ~SharedRingBuffer();
+  SharedRingBuffer(const SharedRingBuffer&) = delete;
+  SharedRingBuffer& operator=(const SharedRingBuffer&) = delete;
+/// Create (or reinitialize) a buffer for writing, with room for nrecords records of recordsize doubles.
+/// first is the index of the first record, i.e. the number of records produced before
+  void create(const std::string& path,unsigned nrecords,unsigned recordsize,std::uint64_t first=0);
+/// Attach to an existing buffer for reading. Returns false if it has not been created yet or has been closed.
+/// Records with index lower than start are skipped, since the reader already has them
+  bool attach(const std::string& path,std::uint64_t start=0);
+/// Check if the buffer has been created or attached
+  bool isOpen() const { return map!=nullptr; }
+/// Size of a record
+  unsigned getRecordSize() const;
+/// Append a record, which should contain getRecordSize() elements
+  void push(const std::vector<double>& record);
+/// Append the records written since the last call to data, and return their number
+  unsigned read(std::vector<double>& data);
+};
+
+}
+
+#endif
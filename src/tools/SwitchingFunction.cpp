@@ -168,6 +168,22 @@ removed in the future. Similarly, the STRETCH keyword is still allowed but has n
 Notice that switching functions defined with the simplified syntax are never stretched
 for backward compatibility. This might change in the future.
 
+Functions that are expensive to compute, such as SMAP, TANH and especially CUSTOM, can be tabulated
+by adding the TABULATE keyword followed by a tolerance. This requires D_MAX.
+\verbatim
+KEYWORD={CUSTOM FUNC=1/(1+x^6) R_0=0.3 D_MAX=1.0 TABULATE=1e-6}
+\endverbatim
+When the switching function is set, it is interpolated with a cubic spline in \f$r^2\f$ between 0 and \f$d_{\textrm{max}}\f$.
+The spline uses the value and the derivative of the function on equally spaced nodes.
+The number of nodes is doubled until the difference between the spline and the function is lower than the tolerance.
+This difference is only sampled at five points in each interval, both on the function and on its derivative
+times \f$r_0^2\f$, so the tolerance is an estimate of the error rather than a guaranteed bound:
+features of the function that are narrower than an interval could be missed.
+For this reason, it is safer to use a tolerance well below the accuracy that you need.
+The function is then obtained with a table lookup.
+In the few intervals where the tolerance cannot be reached (e.g. close to a point where the derivative is not continuous)
+the function is computed exactly. The number of intervals is written in the log.
+
 */
 //+ENDPLUMEDOC
 
@@ -196,6 +212,8 @@ void SwitchingFunction::set(const std::string & definition,std::string& errormsg
   dmax_2=std::numeric_limits<double>::max();
   stretch=1.0;
   shift=0.0;
+  table.clear();
+  table_exact.clear();
   init=true;
 
   bool present;
@@ -212,6 +230,11 @@ void SwitchingFunction::set(const std::string & definition,std::string& errormsg
   bool dontstretch=false;
   Tools::parseFlag(data,"NOSTRETCH",dontstretch); // this is ignored now
   if(dontstretch) dostretch=false;
+  double tolerance=0.0;
+  present=Tools::findKeyword(data,"TABULATE");
+  if(present && !Tools::parse(data,"TABULATE",tolerance)) errormsg="could not parse TABULATE";
+  if(present && !(tolerance>0.0)) errormsg="TABULATE should be positive";
+  if(present && dmax==std::numeric_limits<double>::max()) errormsg="TABULATE requires D_MAX";
   double r0;
   if(name=="CUBIC") {
     r0 = dmax - d0;
@@ -264,36 +287,26 @@ void SwitchingFunction::set(const std::string & definition,std::string& errormsg
     Tools::parse(data,"FUNC",func);
     lepton::ParsedExpression pe=lepton::Parser::parse(func).optimize(lepton::Constants());
     lepton_func=func;
+    {
+      lepton::CompiledExpression ce=pe.createCompiledExpression();
+      leptonx2=(ce.getVariables().count("x")==0 && ce.getVariables().count("x2")>0);
+    }
+    std::string arg="x";
+    if(leptonx2) arg="x2";
+// function and derivative share their common subexpressions
+    std::vector<lepton::ParsedExpression> ped;
+    ped.push_back(pe);
+    ped.push_back(lepton::Parser::parse(func).differentiate(arg).optimize(lepton::Constants()));
     expression.resize(OpenMP::getNumThreads());
-    for(auto & e : expression) e=pe.createCompiledExpression();
+    for(auto & e : expression) e=lepton::CompiledExpression(ped);
     lepton_ref.resize(expression.size());
     for(unsigned t=0; t<lepton_ref.size(); t++) {
       try {
-        lepton_ref[t]=&const_cast<lepton::CompiledExpression*>(&expression[t])->getVariableReference("x");
+        lepton_ref[t]=&expression[t].getVariableReference(arg);
       } catch(const PLMD::lepton::Exception& exc) {
-        try {
-          lepton_ref[t]=&const_cast<lepton::CompiledExpression*>(&expression[t])->getVariableReference("x2");
-          leptonx2=true;
-        } catch(const PLMD::lepton::Exception& exc) {
 // this is necessary since in some cases lepton things a variable is not present even though it is present
 // e.g. func=0*x
-          lepton_ref[t]=nullptr;
-        }
-      }
-    }
-    std::string arg="x";
-    if(leptonx2) arg="x2";
-    lepton::ParsedExpression ped=lepton::Parser::parse(func).differentiate(arg).optimize(lepton::Constants());
-    expression_deriv.resize(OpenMP::getNumThreads());
-    for(auto & e : expression_deriv) e=ped.createCompiledExpression();
-    lepton_ref_deriv.resize(expression_deriv.size());
-    for(unsigned t=0; t<lepton_ref_deriv.size(); t++) {
-      try {
-        lepton_ref_deriv[t]=&const_cast<lepton::CompiledExpression*>(&expression_deriv[t])->getVariableReference(arg);
-      } catch(const PLMD::lepton::Exception& exc) {
-// this is necessary since in some cases lepton things a variable is not present even though it is present
-// e.g. func=3*x
-        lepton_ref_deriv[t]=nullptr;
+        lepton_ref[t]=nullptr;
       }
     }
 
@@ -313,6 +326,73 @@ void SwitchingFunction::set(const std::string & definition,std::string& errormsg
   }
   plumed_assert(!(leptonx2 && d0!=0.0)) << "You cannot use lepton x2 optimization with d0!=0.0 (d0=" << d0 <<")\n"
                                         << "Please rewrite your function using x as a variable";
+  if(tolerance>0.0 && errormsg.empty()) buildTable(tolerance);
+}
+
+void SwitchingFunction::buildTable(double tolerance) {
+  plumed_assert(table.empty());
+  const unsigned minsize=16;
+// 16384 intervals take 512 KB
+  const unsigned maxsize=16384;
+  const double tolerance_deriv=tolerance*invr0*invr0;
+// the error of the value is largest in the middle of the interval, that of the derivative close to 0.2 and 0.8.
+// the error is only sampled here, since a bound would need the higher derivatives of arbitrary (e.g. lepton) functions
+  const double check[5]= {0.2,0.35,0.5,0.65,0.8};
+  std::vector<double> coeff;
+  std::vector<char> exact;
+  for(unsigned nint=minsize; nint<=maxsize; nint*=2) {
+    const double h=dmax_2/nint;
+// value and derivative with respect to the position inside the interval
+    std::vector<double> f(nint+1),g(nint+1);
+    for(unsigned i=0; i<=nint; i++) {
+      double df;
+      f[i]=calculateSqr(i*h,df);
+      g[i]=0.5*df*h;
+    }
+    coeff.resize(4*nint);
+    exact.assign(nint,0);
+    unsigned nexact=0;
+    for(unsigned i=0; i<nint; i++) {
+      double* a=&coeff[4*i];
+      a[0]=f[i];
+      a[1]=g[i];
+      a[2]=3*(f[i+1]-f[i])-2*g[i]-g[i+1];
+      a[3]=2*(f[i]-f[i+1])+g[i]+g[i+1];
+      for(unsigned j=0; j<5; j++) {
+        const double u=check[j];
+        double df;
+        const double s=calculateSqr((i+u)*h,df);
+        const double ts=a[0]+u*(a[1]+u*(a[2]+u*a[3]));
+        const double tdf=2*(a[1]+u*(2*a[2]+3*u*a[3]))/h;
+// written so that nan are not accepted
+        if(!(std::fabs(ts-s)<=tolerance && std::fabs(tdf-df)<=tolerance_deriv)) exact[i]=1;
+      }
+      if(exact[i]) nexact++;
+    }
+    if(nexact==0 || nint==maxsize) {
+      table_invh=1.0/h;
+      break;
+    }
+  }
+  table_exact.swap(exact);
+  table.swap(coeff);
+}
+
+inline bool SwitchingFunction::lookupTable(double distance2,double&result,double&dfunc)const {
+  if(distance2>dmax_2) {
+    result=0.0;
+    dfunc=0.0;
+    return true;
+  }
+  const double x=distance2*table_invh;
+  unsigned k=static_cast<unsigned>(x);
+  if(k>=table_exact.size()) k=table_exact.size()-1;
+  if(table_exact[k]) return false;
+  const double u=x-k;
+  const double* a=&table[4*k];
+  result=a[0]+u*(a[1]+u*(a[2]+u*a[3]));
+  dfunc=2*(a[1]+u*(2*a[2]+3*u*a[3]))*table_invh;
+  return true;
 }
 
 std::string SwitchingFunction::description() const {
@@ -352,6 +432,12 @@ std::string SwitchingFunction::description() const {
     ostr<<" func="<<lepton_func;
 
   }
+  if(!table.empty()) {
+    unsigned nexact=0;
+    for(const auto & e : table_exact) if(e) nexact++;
+    ostr<<", tabulated with "<<table_exact.size()<<" intervals up to dmax="<<dmax;
+    if(nexact>0) ostr<<" ("<<nexact<<" intervals computed exactly)";
+  }
   return ostr.str();
 }
 
@@ -381,6 +467,10 @@ double SwitchingFunction::do_rational(double rdist,double&dfunc,int nn,int mm)co
 }
 
 double SwitchingFunction::calculateSqr(double distance2,double&dfunc)const {
+  if(!table.empty()) {
+    double result;
+    if(lookupTable(distance2,result,dfunc)) return result;
+  }
   if(fastrational) {
     if(distance2>dmax_2) {
       dfunc=0.0;
@@ -403,9 +493,10 @@ double SwitchingFunction::calculateSqr(double distance2,double&dfunc)const {
     const double rdist_2 = distance2*invr0_2;
     plumed_assert(t<expression.size());
     if(lepton_ref[t]) *lepton_ref[t]=rdist_2;
-    if(lepton_ref_deriv[t]) *lepton_ref_deriv[t]=rdist_2;
-    double result=expression[t].evaluate();
-    dfunc=expression_deriv[t].evaluate();
+    double results[2];
+    expression[t].evaluate(results);
+    double result=results[0];
+    dfunc=results[1];
 // chain rule:
     dfunc*=2*invr0_2;
 // stretch:
@@ -418,12 +509,158 @@ double SwitchingFunction::calculateSqr(double distance2,double&dfunc)const {
   }
 }
 
+namespace {
+
+/// Same as Tools::fastpow() with a positive exponent known at compile time.
+/// Multiplications are done in the same order, so that results are identical
+template<int exp>
+inline double fastpowStep(double result,double base) {
+  return fastpowStep<(exp>>1)>((exp&1)?result*base:result,base*base);
+}
+
+template<>
+inline double fastpowStep<0>(double result,double) {
+  return result;
+}
+
+template<int exp>
+inline double fastpowFixed(double base) {
+  return fastpowStep<exp>(1.0,base);
+}
+
+/// Loop for rational functions of x**2, with 2*N==M and N known at compile time.
+/// Same arithmetic as SwitchingFunction::calculateSqr()
+template<int N>
+void rationalSqrLoop(const double* distance2,double* result,double* dfunc,std::size_t n,
+                     double invr0_2,double dmax_2,double stretch,double shift) {
+  #pragma omp simd
+  for(std::size_t k=0; k<n; k++) {
+    const double rdist_2=distance2[k]*invr0_2;
+    const double rNdist=fastpowFixed<N-1>(rdist_2);
+    const double iden=1.0/(1+rNdist*rdist_2);
+    double df=-N*rNdist*iden*iden;
+    df*=2*invr0_2;
+    const bool inside=(distance2[k]<=dmax_2);
+    result[k]=(inside?iden*stretch+shift:0.0);
+    dfunc[k]=(inside?df*stretch:0.0);
+  }
+}
+
+}
+
+void SwitchingFunction::calculateSqr(const double* distance2,double* result,double* dfunc,std::size_t n)const {
+  plumed_massert(init,"you are trying to use an unset SwitchingFunction");
+  if(!table.empty()) {
+    for(std::size_t k=0; k<n; k++) {
+      if(!lookupTable(distance2[k],result[k],dfunc[k])) result[k]=calculateSqr(distance2[k],dfunc[k]);
+    }
+  } else if(fastrational) {
+    const int n2=nn/2;
+    const int m2=mm/2;
+    if(2*n2==m2) {
+      switch(n2) {
+      case 1: rationalSqrLoop<1>(distance2,result,dfunc,n,invr0_2,dmax_2,stretch,shift); return;
+      case 2: rationalSqrLoop<2>(distance2,result,dfunc,n,invr0_2,dmax_2,stretch,shift); return;
+      case 3: rationalSqrLoop<3>(distance2,result,dfunc,n,invr0_2,dmax_2,stretch,shift); return;
+      case 4: rationalSqrLoop<4>(distance2,result,dfunc,n,invr0_2,dmax_2,stretch,shift); return;
+      case 5: rationalSqrLoop<5>(distance2,result,dfunc,n,invr0_2,dmax_2,stretch,shift); return;
+      case 6: rationalSqrLoop<6>(distance2,result,dfunc,n,invr0_2,dmax_2,stretch,shift); return;
+      }
+    }
+    const double dmax_2=this->dmax_2;
+    const double invr0_2=this->invr0_2;
+    const double stretch=this->stretch;
+    const double shift=this->shift;
+    for(std::size_t k=0; k<n; k++) {
+      const double rdist_2=distance2[k]*invr0_2;
+      double df;
+      const double r=do_rational(rdist_2,df,n2,m2);
+      df*=2*invr0_2;
+      const bool inside=(distance2[k]<=dmax_2);
+      result[k]=(inside?r*stretch+shift:0.0);
+      dfunc[k]=(inside?df*stretch:0.0);
+    }
+  } else if(type==exponential) {
+    const double dmax=this->dmax;
+    const double d0=this->d0;
+    const double invr0=this->invr0;
+    const double stretch=this->stretch;
+    const double shift=this->shift;
+    #pragma omp simd
+    for(std::size_t k=0; k<n; k++) {
+      // same arithmetic as calculate()
+      const double distance=std::sqrt(distance2[k]);
+      const double rdist=(distance-d0)*invr0;
+      const double e=std::exp(-rdist);
+      double df=-e;
+      df*=invr0;
+      df/=distance;
+      const bool inside=(distance<=dmax);
+      const bool positive=(rdist>0.);
+      const double r=(positive?e:1.);
+      df=(positive?df:0.0);
+      result[k]=(inside?r*stretch+shift:0.0);
+      dfunc[k]=(inside?df*stretch:0.0);
+    }
+  } else if(type==leptontype && expression[0].getVariables().size()<=1) {
+// the expressions are evaluated on all the points at once with the thread safe interface,
+// the per-thread copies are only needed by the scalar version
+    std::vector<double> arg(n),value(n),deriv(n),workspace;
+    for(std::size_t k=0; k<n; k++) {
+      if(leptonx2) arg[k]=distance2[k]*invr0_2;
+      else arg[k]=(std::sqrt(distance2[k])-d0)*invr0;
+    }
+    const double* values=arg.data();
+    double* results[2]= {value.data(),deriv.data()};
+    expression[0].evaluate(&values,results,n,workspace);
+// same as calculateSqr() and calculate()
+    for(std::size_t k=0; k<n; k++) {
+      double r,df;
+      if(leptonx2) {
+        if(distance2[k]>dmax_2) {
+          result[k]=0.0;
+          dfunc[k]=0.0;
+          continue;
+        }
+        r=value[k];
+        df=deriv[k];
+        df*=2*invr0_2;
+      } else {
+        const double distance=std::sqrt(distance2[k]);
+        if(distance>dmax) {
+          result[k]=0.0;
+          dfunc[k]=0.0;
+          continue;
+        }
+        if(arg[k]<=0.) {
+          r=1.;
+          df=0.0;
+        } else {
+          r=value[k];
+          df=deriv[k];
+          df*=invr0;
+          df/=distance;
+        }
+      }
+      result[k]=r*stretch+shift;
+      dfunc[k]=df*stretch;
+    }
+  } else {
+    for(std::size_t k=0; k<n; k++) result[k]=calculateSqr(distance2[k],dfunc[k]);
+  }
+}
+
 double SwitchingFunction::calculate(double distance,double&dfunc)const {
   plumed_massert(init,"you are trying to use an unset SwitchingFunction");
   if(distance>dmax) {
     dfunc=0.0;
     return 0.0;
   }
+// the table is in distance**2, so it cannot be used for negative arguments
+  if(!table.empty() && distance>=0.0) {
+    double result;
+    if(lookupTable(distance*distance,result,dfunc)) return result;
+  }
 // in this case, the lepton object stores only the calculateSqr function
 // so we have to implement calculate in terms of calculateSqr
   if(leptonx2) {
@@ -481,9 +718,10 @@ double SwitchingFunction::calculate(double distance,double&dfunc)const {
       const unsigned t=OpenMP::getThreadNum();
       plumed_assert(t<expression.size());
       if(lepton_ref[t]) *lepton_ref[t]=rdist;
-      if(lepton_ref_deriv[t]) *lepton_ref_deriv[t]=rdist;
-      result=expression[t].evaluate();
-      dfunc=expression_deriv[t].evaluate();
+      double results[2];
+      expression[t].evaluate(results);
+      result=results[0];
+      dfunc=results[1];
     } else plumed_merror("Unknown switching function type");
 // this is for the chain rule:
     dfunc*=invr0;
@@ -511,6 +749,8 @@ void SwitchingFunction::set(int nn,int mm,double r0,double d0) {
   this->dmax_2=this->dmax*this->dmax;
   this->leptonx2=false;
   this->fastrational=(nn%2==0 && mm%2==0 && d0==0.0);
+  this->table.clear();
+  this->table_exact.clear();
 
   double dummy;
   double s0=calculate(0.0,dummy);
@@ -24,6 +24,7 @@
 
 #include <string>
 #include <vector>
+#include <cstddef>
 #include "lepton/Lepton.h"
 
 namespace PLMD {
@@ -75,18 +76,25 @@ class SwitchingFunction {
   double do_rational(double rdist,double&dfunc,int nn,int mm)const;
 /// Function for lepton;
   std::string lepton_func;
-/// Lepton expression.
+/// Lepton expression, computing the function and its derivative in a single program.
 /// \warning Since lepton::CompiledExpression is mutable, a vector is necessary for multithreading!
   std::vector<lepton::CompiledExpression> expression;
-/// Lepton expression for derivative
-/// \warning Since lepton::CompiledExpression is mutable, a vector is necessary for multithreading!
-  std::vector<lepton::CompiledExpression> expression_deriv;
   std::vector<double*> lepton_ref;
-  std::vector<double*> lepton_ref_deriv;
 /// Set to true for fast rational functions (depending on x**2 only)
   bool fastrational=false;
 /// Set to true if lepton only uses x2
   bool leptonx2=false;
+/// Cubic spline in distance**2 between 0 and dmax, used when TABULATE is given.
+/// Four coefficients per interval, empty if the function is not tabulated
+  std::vector<double> table;
+/// Intervals where the spline does not reach the requested tolerance and the function is computed
+  std::vector<char> table_exact;
+/// Inverse of the width of the intervals
+  double table_invh=0.0;
+/// Build the table, doubling the number of intervals until the tolerance is reached
+  void buildTable(double tolerance);
+/// Look up the table. Returns false if the function should be computed directly
+  bool lookupTable(double distance2,double&result,double&dfunc)const;
 public:
   static void registerKeywords( Keywords& keys );
 /// Set a "rational" switching function.
@@ -110,6 +118,13 @@ public:
 /// The advantage is that in some case the expensive square root can be avoided
 /// (namely for rational functions, if nn and mm are even and d0 is zero)
   double calculateSqr(double distance2,double&dfunc)const;
+/// Compute the switching function on n squared distances at once.
+/// Results are the same as calling calculateSqr() on each distance, but the type of
+/// switching function is only checked once, and for rational (with even exponents and d0 equal to zero)
+/// and exponential functions the loop has no branches, so that the compiler can vectorize it.
+/// The most common exponents are also specialized at compile time.
+/// Lepton functions are evaluated on all the distances at once.
+  void calculateSqr(const double* distance2,double* result,double* dfunc,std::size_t n)const;
 /// Returns d0
   double get_d0() const;
 /// Returns r0
@@ -0,0 +1,102 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2021 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_tools_ThreadBuffer_h
+#define __PLUMED_tools_ThreadBuffer_h
+
+#include "Exception.h"
+#include <vector>
+
+namespace PLMD {
+
+/// \ingroup TOOLBOX
+/// Per-thread accumulation buffers for OpenMP loops.
+///
+/// Each thread of a team accumulates on its own array, and the arrays are
+/// then summed in parallel, each thread taking care of a block of elements.
+/// Memory is kept between calls, so that objects owning a ThreadBuffer
+/// do not allocate anything at each step. Typical usage:
+///
+/// \verbatim
+/// buffer.resize(nt,n);                // outside the parallel region
+/// #pragma omp parallel num_threads(nt)
+/// {
+///   T* mine=buffer.getClearedBuffer(OpenMP::getThreadNum());
+///   #pragma omp for nowait
+///   for(...) mine[j]+=...;
+///   buffer.reduce(result);            // called by all the threads
+/// }
+/// \endverbatim
+template<typename T>
+class ThreadBuffer {
+/// Number of threads
+  unsigned nthreads;
+/// Number of elements per thread
+  unsigned nelements;
+/// Storage for all threads, thread t uses elements from t*nelements
+  std::vector<T> buffer;
+public:
+  ThreadBuffer(): nthreads(0), nelements(0) {}
+/// Set the number of threads and of elements. Memory is only reallocated when it grows
+  void resize(unsigned nt,unsigned n);
+/// Zero the buffer of thread t and return a pointer to it.
+/// It should be called by thread t itself, so that memory is first touched by the thread that uses it
+  T* getClearedBuffer(unsigned t);
+/// Add the buffers of all threads to out, which should have at least n elements.
+/// It should be called by all the threads of the team (it contains a barrier and a worksharing loop)
+  void reduce(T* out);
+  void reduce(std::vector<T>& out);
+};
+
+template<typename T>
+void ThreadBuffer<T>::resize(unsigned nt,unsigned n) {
+  nthreads=nt;
+  nelements=n;
+  if(buffer.size()<static_cast<size_t>(nt)*n) buffer.resize(static_cast<size_t>(nt)*n);
+}
+
+template<typename T>
+T* ThreadBuffer<T>::getClearedBuffer(unsigned t) {
+  plumed_dbg_assert(t<nthreads);
+  T* mine=buffer.data()+static_cast<size_t>(t)*nelements;
+  for(unsigned i=0; i<nelements; i++) mine[i]=T();
+  return mine;
+}
+
+template<typename T>
+void ThreadBuffer<T>::reduce(T* out) {
+// all threads should have completed their contributions
+  #pragma omp barrier
+  #pragma omp for
+  for(unsigned i=0; i<nelements; i++) {
+    for(unsigned t=0; t<nthreads; t++) out[i]+=buffer[static_cast<size_t>(t)*nelements+i];
+  }
+}
+
+template<typename T>
+void ThreadBuffer<T>::reduce(std::vector<T>& out) {
+  plumed_dbg_assert(out.size()>=nelements);
+  reduce(out.data());
+}
+
+}
+
+#endif
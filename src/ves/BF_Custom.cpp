@@ -104,14 +104,14 @@ BF_CUSTOM ...
 
 class BF_Custom : public BasisFunctions {
 private:
-  lepton::CompiledExpression transf_value_expression_;
-  lepton::CompiledExpression transf_deriv_expression_;
-  double* transf_value_lepton_ref_;
-  double* transf_deriv_lepton_ref_;
-  std::vector<lepton::CompiledExpression> bf_values_expressions_;
-  std::vector<lepton::CompiledExpression> bf_derivs_expressions_;
-  std::vector<double*> bf_values_lepton_ref_;
-  std::vector<double*> bf_derivs_lepton_ref_;
+  // value and derivative of the transform
+  lepton::CompiledExpression transf_expression_;
+  double* transf_lepton_ref_;
+  // values and derivatives of all the basis functions but the constant one,
+  // computed by a single program so that common subexpressions are only computed once
+  lepton::CompiledExpression bf_expression_;
+  double* bf_lepton_ref_;
+  mutable std::vector<double> bf_results_;
   std::string variable_str_;
   std::string transf_variable_str_;
   bool do_transf_;
@@ -138,12 +138,8 @@ void BF_Custom::registerKeywords(Keywords& keys) {
 
 BF_Custom::BF_Custom(const ActionOptions&ao):
   PLUMED_VES_BASISFUNCTIONS_INIT(ao),
-  transf_value_lepton_ref_(nullptr),
-  transf_deriv_lepton_ref_(nullptr),
-  bf_values_expressions_(0),
-  bf_derivs_expressions_(0),
-  bf_values_lepton_ref_(0,nullptr),
-  bf_derivs_lepton_ref_(0,nullptr),
+  transf_lepton_ref_(nullptr),
+  bf_lepton_ref_(nullptr),
   variable_str_("x"),
   transf_variable_str_("t"),
   do_transf_(false),
@@ -178,25 +174,25 @@ BF_Custom::BF_Custom(const ActionOptions&ao):
   bf_values_parsed[0] = "1";
   bf_derivs_parsed[0] = "0";
   //
-  bf_values_expressions_.resize(getNumberOfBasisFunctions());
-  bf_derivs_expressions_.resize(getNumberOfBasisFunctions());
-  bf_values_lepton_ref_.resize(getNumberOfBasisFunctions());
-  bf_derivs_lepton_ref_.resize(getNumberOfBasisFunctions());
+  // values and derivatives are stored alternately
+  std::vector<lepton::ParsedExpression> bf_expressions;
   //
   for(unsigned int i=1; i<getNumberOfBasisFunctions(); i++) {
     std::string is; Tools::convert(i,is);
+    lepton::CompiledExpression bf_value_expression;
     try {
       lepton::ParsedExpression pe_value = lepton::Parser::parse(bf_str[i]).optimize(lepton::Constants());
       std::ostringstream tmp_stream; tmp_stream << pe_value;
       bf_values_parsed[i] = tmp_stream.str();
-      bf_values_expressions_[i] = pe_value.createCompiledExpression();
+      bf_value_expression = pe_value.createCompiledExpression();
+      bf_expressions.push_back(pe_value);
     }
     catch(PLMD::lepton::Exception& exc) {
       plumed_merror("There was some problem in parsing the function "+bf_str[i]+" given in FUNC"+is + " with lepton");
     }
 
     std::vector<std::string> var_str;
-    for(auto &p: bf_values_expressions_[i].getVariables()) {
+    for(auto &p: bf_value_expression.getVariables()) {
       var_str.push_back(p);
     }
     if(var_str.size()!=1) {
@@ -210,21 +206,18 @@ BF_Custom::BF_Custom(const ActionOptions&ao):
       lepton::ParsedExpression pe_deriv = lepton::Parser::parse(bf_str[i]).differentiate(variable_str_).optimize(lepton::Constants());
       std::ostringstream tmp_stream2; tmp_stream2 << pe_deriv;
       bf_derivs_parsed[i] = tmp_stream2.str();
-      bf_derivs_expressions_[i] = pe_deriv.createCompiledExpression();
+      bf_expressions.push_back(pe_deriv);
     }
     catch(PLMD::lepton::Exception& exc) {
       plumed_merror("There was some problem in parsing the derivative of the function "+bf_str[i]+" given in FUNC"+is + " with lepton");
     }
 
-    try {
-      bf_values_lepton_ref_[i] = &bf_values_expressions_[i].getVariableReference(variable_str_);
-    } catch(PLMD::lepton::Exception& exc) {}
-
-    try {
-      bf_derivs_lepton_ref_[i] = &bf_derivs_expressions_[i].getVariableReference(variable_str_);
-    } catch(PLMD::lepton::Exception& exc) {}
-
   }
+  bf_expression_ = lepton::CompiledExpression(bf_expressions);
+  bf_results_.resize(bf_expressions.size());
+  try {
+    bf_lepton_ref_ = &bf_expression_.getVariableReference(variable_str_);
+  } catch(PLMD::lepton::Exception& exc) {}
 
   std::string transf_value_parsed;
   std::string transf_deriv_parsed;
@@ -242,18 +235,21 @@ BF_Custom::BF_Custom(const ActionOptions&ao):
       else {break;}
     }
 
+    std::vector<lepton::ParsedExpression> transf_expressions;
+    lepton::CompiledExpression transf_value_expression;
     try {
       lepton::ParsedExpression pe_value = lepton::Parser::parse(transf_str).optimize(lepton::Constants());;
       std::ostringstream tmp_stream; tmp_stream << pe_value;
       transf_value_parsed = tmp_stream.str();
-      transf_value_expression_ = pe_value.createCompiledExpression();
+      transf_value_expression = pe_value.createCompiledExpression();
+      transf_expressions.push_back(pe_value);
     }
     catch(PLMD::lepton::Exception& exc) {
       plumed_merror("There was some problem in parsing the function "+transf_str+" given in TRANSFORM with lepton");
     }
 
     std::vector<std::string> var_str;
-    for(auto &p: transf_value_expression_.getVariables()) {
+    for(auto &p: transf_value_expression.getVariables()) {
       var_str.push_back(p);
     }
     if(var_str.size()!=1) {
@@ -267,18 +263,15 @@ BF_Custom::BF_Custom(const ActionOptions&ao):
       lepton::ParsedExpression pe_deriv = lepton::Parser::parse(transf_str).differentiate(transf_variable_str_).optimize(lepton::Constants());;
       std::ostringstream tmp_stream2; tmp_stream2 << pe_deriv;
       transf_deriv_parsed = tmp_stream2.str();
-      transf_deriv_expression_ = pe_deriv.createCompiledExpression();
+      transf_expressions.push_back(pe_deriv);
     }
     catch(PLMD::lepton::Exception& exc) {
       plumed_merror("There was some problem in parsing the derivative of the function "+transf_str+" given in TRANSFORM with lepton");
     }
 
+    transf_expression_ = lepton::CompiledExpression(transf_expressions);
     try {
-      transf_value_lepton_ref_ = &transf_value_expression_.getVariableReference(transf_variable_str_);
-    } catch(PLMD::lepton::Exception& exc) {}
-
-    try {
-      transf_deriv_lepton_ref_ = &transf_deriv_expression_.getVariableReference(transf_variable_str_);
+      transf_lepton_ref_ = &transf_expression_.getVariableReference(transf_variable_str_);
     } catch(PLMD::lepton::Exception& exc) {}
 
   }
@@ -318,11 +311,12 @@ void BF_Custom::getAllValues(const double arg, double& argT, bool& inside_range,
   //
   if(do_transf_) {
 
-    if(transf_value_lepton_ref_) {*transf_value_lepton_ref_ = argT;}
-    if(transf_deriv_lepton_ref_) {*transf_deriv_lepton_ref_ = argT;}
+    if(transf_lepton_ref_) {*transf_lepton_ref_ = argT;}
 
-    argT = transf_value_expression_.evaluate();
-    transf_derivf = transf_deriv_expression_.evaluate();
+    double transf_results[2];
+    transf_expression_.evaluate(transf_results);
+    argT = transf_results[0];
+    transf_derivf = transf_results[1];
 
     if(check_nan_inf_ && (std::isnan(argT) || std::isinf(argT)) ) {
       std::string vs; Tools::convert(argT,vs);
@@ -337,13 +331,12 @@ void BF_Custom::getAllValues(const double arg, double& argT, bool& inside_range,
   //
   values[0]=1.0;
   derivs[0]=0.0;
+  if(bf_lepton_ref_) {*bf_lepton_ref_ = argT;}
+  bf_expression_.evaluate(bf_results_.data());
   for(unsigned int i=1; i < getNumberOfBasisFunctions(); i++) {
 
-    if(bf_values_lepton_ref_[i]) {*bf_values_lepton_ref_[i] = argT;}
-    if(bf_derivs_lepton_ref_[i]) {*bf_derivs_lepton_ref_[i] = argT;}
-
-    values[i] = bf_values_expressions_[i].evaluate();
-    derivs[i] = bf_derivs_expressions_[i].evaluate();
+    values[i] = bf_results_[2*(i-1)];
+    derivs[i] = bf_results_[2*(i-1)+1];
 
     if(do_transf_) {derivs[i]*=transf_derivf;}
     // NaN checks